@@ -0,0 +1,224 @@
+#include "metrosystem.h"
+#include "parallel.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+
+// k shortest loopless routes by Yen's algorithm. Each route after the
+// first leaves an earlier one at some station (the spur) and takes the
+// best way on from there that avoids the stations before the spur and the
+// arcs the earlier routes with the same beginning took next.
+//
+// Every spur search asks the same question, "how far is end from here",
+// so one search out from end answers it for the whole query: its distances
+// guide each spur search as an A* bound. Taking arcs and stations away
+// only makes routes longer, so the bound stays admissible, and where
+// nothing is taken away it is exact and the search walks straight to end.
+// Routes only spur from the station where they left their own parent
+// onwards (Lawler); earlier spurs were all tried for the parent already.
+
+namespace {
+
+// Slots of the search from end, which lives for the whole query, and of
+// the spur searches run meanwhile
+constexpr int kTreeSlot = 0;
+constexpr int kSpurSlot = 1;
+
+template <typename Value>
+struct YenRoute {
+    Value value;
+    std::vector<StationId> stations; // From start to end
+    std::vector<EdgeId> arcs;        // arcs[i] leads from stations[i] to stations[i + 1]
+    size_t deviation;                // Index of the spur station it was found from
+};
+
+// Stations a spur search must not enter: those of the route before the spur
+struct StationMarks {
+    std::vector<uint32_t> stamps;
+    uint32_t epoch = 0;
+
+    void reset(size_t stationCount) {
+        if (stamps.size() != stationCount || ++epoch == 0) {
+            stamps.assign(stationCount, 0);
+            epoch = 1;
+        }
+    }
+    void mark(StationId v) { stamps[v] = epoch; }
+    bool marked(StationId v) const { return stamps[v] == epoch; }
+};
+
+// Best route from spur to end that avoids the marked stations and, on
+// leaving spur, the blocked arcs. toEnd holds every station's value to end
+// in the whole graph. Appends the route to stations and arcs and returns
+// its value, or the unreached value if there is none.
+template <typename Weight>
+typename Weight::Value spurSearch(const MetroGraph& graph, const SearchWorkspace<typename Weight::Value>& toEnd,
+                                  StationId spur, StationId end, const StationMarks& marks,
+                                  const std::vector<EdgeId>& blockedArcs, std::vector<StationId>& stations,
+                                  std::vector<EdgeId>& arcs) {
+    using Value = typename Weight::Value;
+    SearchWorkspace<Value>& workspace = threadSearchWorkspace<Value, kSpurSlot>();
+    workspace.reset(graph.stationCount());
+
+    // Heap ordered on g + h, as in MetroSystem::astar
+    struct Entry {
+        Value key;
+        Value value;
+        StationId node;
+    };
+    auto cmp = [](const Entry& a, const Entry& b) { return a.key > b.key; };
+    thread_local std::vector<Entry> heap;
+    heap.clear();
+
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    workspace.label(spur, 0, kInvalidStation, kInvalidEdge);
+    heap.push_back({toEnd.distance(spur), 0, spur});
+    bool found = false;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        const Entry top = heap.back();
+        heap.pop_back();
+        if (top.value > workspace.distance(top.node)) {
+            METRO_STAT(counters.stalePops++);
+            continue;
+        }
+        METRO_STAT(counters.settled++);
+        if (top.node == end) {
+            found = true;
+            break;
+        }
+        METRO_STAT(counters.relaxed += graph.edgesEnd(top.node) - graph.edgesBegin(top.node));
+        for (EdgeId e = graph.edgesBegin(top.node); e < graph.edgesEnd(top.node); ++e) {
+            const StationId next = graph.targets[e];
+            if (marks.marked(next) || !toEnd.reached(next)) continue;
+            if (top.node == spur && std::find(blockedArcs.begin(), blockedArcs.end(), e) != blockedArcs.end()) continue;
+            const Value candidate = top.value + Weight::weight(graph, e);
+            if (candidate < workspace.distance(next)) {
+                workspace.label(next, candidate, top.node, e);
+                heap.push_back({candidate + toEnd.distance(next), candidate, next});
+                std::push_heap(heap.begin(), heap.end(), cmp);
+                METRO_STAT(counters.pushes++);
+            }
+        }
+    }
+    if (!found) return unreachedValue<Weight>();
+
+    const size_t first = arcs.size();
+    for (StationId v = end; v != spur; v = workspace.parent(v)) {
+        stations.push_back(v);
+        arcs.push_back(workspace.parentEdge(v));
+    }
+    std::reverse(stations.begin() + first + 1, stations.end());
+    std::reverse(arcs.begin() + first, arcs.end());
+    return workspace.distance(end);
+}
+
+} // namespace
+
+template <typename Weight>
+std::vector<std::vector<PathSegment>> MetroSystem::alternativeRoutes(const NetworkState& network, StationId start,
+                                                                    StationId end, size_t k, unsigned threads,
+                                                                    const CancelFlag* cancel) const {
+    using Value = typename Weight::Value;
+    using Route = YenRoute<Value>;
+    const MetroGraph& graph = network.graph;
+    const Value unreached = unreachedValue<Weight>();
+
+    SearchWorkspace<Value>& toEnd = threadSearchWorkspace<Value, kTreeSlot>();
+    withThreadDijkstraQueue<Weight>(graph, [&](auto& queue) {
+        runShortestPathKernel<Weight>(graph, end, queue, toEnd,
+                                      [cancel](StationId, Value) { return isCancelled(cancel); });
+    });
+    if (!toEnd.reached(start) || isCancelled(cancel)) return {};
+
+    std::vector<Route> routes; // Found, best first
+    std::vector<Route> candidates;
+    {
+        thread_local StationMarks marks;
+        marks.reset(graph.stationCount());
+        Route first{0, {start}, {}, 0};
+        first.value = spurSearch<Weight>(graph, toEnd, start, end, marks, {}, first.stations, first.arcs);
+        routes.push_back(std::move(first));
+    }
+
+    std::vector<Route> spurs;
+    while (routes.size() < k) {
+        const Route& last = routes.back();
+        // One spur search per station of the last route from its deviation
+        // on; they are independent, so they may run on several threads
+        const size_t spurCount = last.arcs.size() - last.deviation;
+        spurs.assign(spurCount, Route{unreached, {}, {}, 0});
+        parallelFor(spurCount, threads, [&](unsigned, size_t s) {
+            if (isCancelled(cancel)) return;
+            const size_t i = last.deviation + s;
+            thread_local StationMarks marks;
+            thread_local std::vector<EdgeId> blockedArcs;
+            marks.reset(graph.stationCount());
+            blockedArcs.clear();
+            Value rootValue = 0;
+            for (size_t j = 0; j < i; ++j) {
+                marks.mark(last.stations[j]);
+                rootValue += Weight::weight(graph, last.arcs[j]);
+            }
+            for (const Route& route : routes) {
+                if (route.arcs.size() > i && std::equal(last.arcs.begin(), last.arcs.begin() + i, route.arcs.begin())) {
+                    blockedArcs.push_back(route.arcs[i]);
+                }
+            }
+            Route& spur = spurs[s];
+            spur.stations.assign(last.stations.begin(), last.stations.begin() + i + 1);
+            spur.arcs.assign(last.arcs.begin(), last.arcs.begin() + i);
+            spur.deviation = i;
+            const Value value = spurSearch<Weight>(graph, toEnd, last.stations[i], end, marks, blockedArcs,
+                                                   spur.stations, spur.arcs);
+            spur.value = value == unreached ? unreached : rootValue + value;
+        });
+        if (isCancelled(cancel)) return {};
+
+        for (Route& spur : spurs) {
+            if (spur.value == unreached) continue;
+            bool known = false;
+            for (const Route& candidate : candidates) known = known || candidate.arcs == spur.arcs;
+            if (!known) candidates.push_back(std::move(spur));
+        }
+        if (candidates.empty()) break;
+        // Best candidate; the earliest found wins a tie
+        auto best = candidates.begin();
+        for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+            if (it->value < best->value) best = it;
+        }
+        routes.push_back(std::move(*best));
+        candidates.erase(best);
+    }
+
+    std::vector<std::vector<PathSegment>> paths;
+    paths.reserve(routes.size());
+    std::vector<ContractionHierarchy::PathStep> steps;
+    for (const Route& route : routes) {
+        steps.clear();
+        for (size_t i = 0; i < route.arcs.size(); ++i) steps.emplace_back(route.stations[i + 1], route.arcs[i]);
+        paths.push_back(buildPath(network, start, steps));
+    }
+    return paths;
+}
+
+std::vector<std::vector<PathSegment>> MetroSystem::findAlternativeRoutes(const std::string& start, const std::string& end,
+                                                                        RouteCriterion criterion, size_t k,
+                                                                        unsigned threads, const CancelFlag* cancel) const {
+    StationId startId = stationId(start);
+    StationId endId = stationId(end);
+    if (startId == kInvalidStation || endId == kInvalidStation || k == 0) return {};
+    if (startId == endId) return {{PathSegment(start, "", 0, 0, true)}};
+
+    const std::shared_ptr<const NetworkState> network = this->network();
+    switch (criterion) {
+    case RouteCriterion::LeastStops:
+        return alternativeRoutes<HopWeight>(*network, startId, endId, k, threads, cancel);
+    case RouteCriterion::Time:
+        return alternativeRoutes<TimeWeight>(*network, startId, endId, k, threads, cancel);
+    case RouteCriterion::Cost:
+        return alternativeRoutes<CostWeight>(*network, startId, endId, k, threads, cancel);
+    case RouteCriterion::Distance:
+        return alternativeRoutes<DistanceWeight>(*network, startId, endId, k, threads, cancel);
+    }
+    return {};
+}
@@ -0,0 +1,111 @@
+#include "metrosystem.h"
+#include "parallel.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+
+// Each origin runs one kernel search that stops once every destination has
+// been settled (or the component is exhausted); the rows are then read off
+// the parent arcs left in the worker's workspace.
+template <typename Weight, typename Queue>
+void MetroSystem::fillRouteMatrix(const NetworkState& network, RouteMatrix& matrix, bool includePaths, unsigned threads,
+                                  const Queue& queue) const {
+    using Workspace = SearchWorkspace<typename Weight::Value>;
+    const std::vector<std::string>& origins = matrix.origins;
+    const std::vector<std::string>& destinations = matrix.destinations;
+    const MetroGraph& graph = network.graph;
+
+    std::vector<StationId> destinationIds(destinations.size());
+    std::vector<char> isTarget(graph.stationCount(), 0);
+    size_t targetCount = 0;
+    for (size_t d = 0; d < destinations.size(); ++d) {
+        destinationIds[d] = stationId(destinations[d]);
+        if (destinationIds[d] != kInvalidStation && !isTarget[destinationIds[d]]) {
+            isTarget[destinationIds[d]] = 1;
+            targetCount++;
+        }
+    }
+    if (targetCount == 0) return;
+
+    if (threads == 0) threads = defaultThreadCount();
+    std::vector<Workspace> workspaces(std::min<size_t>(threads, origins.size()));
+    std::vector<Queue> queues(workspaces.size(), queue);
+
+    parallelFor(origins.size(), threads, [&](unsigned worker, size_t o) {
+        StationId source = stationId(origins[o]);
+        if (source == kInvalidStation) return;
+        Workspace& workspace = workspaces[worker];
+        size_t remaining = targetCount;
+        runShortestPathKernel<Weight>(graph, source, queues[worker], workspace,
+                                      [&](StationId v, typename Weight::Value) {
+                                          return isTarget[v] && --remaining == 0;
+                                      });
+
+        for (size_t d = 0; d < destinations.size(); ++d) {
+            StationId target = destinationIds[d];
+            if (target == kInvalidStation || !workspace.reached(target)) continue;
+
+            long long time = 0;
+            long long cost = 0;
+            double distance = 0.0;
+            int hops = 0;
+            for (StationId v = target; v != source; v = workspace.parent(v)) {
+                EdgeId e = workspace.parentEdge(v);
+                time += graph.times[e];
+                cost += graph.costs[e];
+                distance += graph.distances[e];
+                hops++;
+            }
+            const size_t cell = matrix.index(o, d);
+            matrix.time[cell] = time;
+            matrix.cost[cell] = cost;
+            matrix.distance[cell] = distance;
+            matrix.hops[cell] = hops;
+
+            if (includePaths) {
+                std::vector<PathSegment>& path = matrix.paths[cell];
+                path.reserve(hops + 1);
+                for (StationId v = target; v != source; v = workspace.parent(v)) {
+                    path.push_back(segmentFor(network, v, workspace.parentEdge(v)));
+                }
+                path.push_back(PathSegment(stationNames_[source], "", 0, 0, true));
+                std::reverse(path.begin(), path.end());
+                countTransfers(path);
+            }
+        }
+    });
+}
+
+RouteMatrix MetroSystem::computeRouteMatrix(const std::vector<std::string>& origins,
+                                            const std::vector<std::string>& destinations,
+                                            RouteCriterion criterion,
+                                            bool includePaths,
+                                            unsigned threads) const {
+    RouteMatrix matrix;
+    matrix.origins = origins;
+    matrix.destinations = destinations;
+    matrix.criterion = criterion;
+    const size_t cells = origins.size() * destinations.size();
+    matrix.time.assign(cells, -1);
+    matrix.cost.assign(cells, -1);
+    matrix.distance.assign(cells, -1.0);
+    matrix.hops.assign(cells, -1);
+    if (includePaths) matrix.paths.assign(cells, {});
+    const std::shared_ptr<const NetworkState> network = this->network();
+    const MetroGraph& graph = network->graph;
+
+    switch (criterion) {
+    case RouteCriterion::LeastStops:
+        fillRouteMatrix<HopWeight>(*network, matrix, includePaths, threads, FifoQueue<HopWeight::Value>());
+        break;
+    case RouteCriterion::Time:
+        withDijkstraQueue<TimeWeight>(graph, [&](auto& queue) { fillRouteMatrix<TimeWeight>(*network, matrix, includePaths, threads, queue); });
+        break;
+    case RouteCriterion::Cost:
+        withDijkstraQueue<CostWeight>(graph, [&](auto& queue) { fillRouteMatrix<CostWeight>(*network, matrix, includePaths, threads, queue); });
+        break;
+    case RouteCriterion::Distance:
+        withDijkstraQueue<DistanceWeight>(graph, [&](auto& queue) { fillRouteMatrix<DistanceWeight>(*network, matrix, includePaths, threads, queue); });
+        break;
+    }
+    return matrix;
+}
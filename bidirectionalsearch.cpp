@@ -0,0 +1,200 @@
+#include "metrosystem.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+
+// Both searches run on the same CSR graph: every segment was inserted in
+// both directions, so the backward search needs no reverse graph. Each
+// direction labels stations in its own per-thread workspace slot.
+
+namespace {
+
+using PathStep = ContractionHierarchy::PathStep;
+
+// Steps of the path start ... u -> v ... end, where the arc e leaves u and
+// the searches met on it. side is the search that relaxed e; the backward
+// search's parent arcs point towards end, so they are followed through
+// their reverse arcs.
+template <typename Value>
+void joinAtMeeting(const MetroGraph& graph, const SearchWorkspace<Value>& forward, const SearchWorkspace<Value>& backward,
+                   int side, StationId u, EdgeId e, std::vector<PathStep>& steps) {
+    const StationId v = graph.targets[e];
+    const StationId forwardEnd = side == 0 ? u : v;
+    const StationId backwardStart = side == 0 ? v : u;
+    steps.clear();
+    for (StationId w = forwardEnd; forward.parentEdge(w) != kInvalidEdge; w = forward.parent(w)) {
+        steps.emplace_back(w, forward.parentEdge(w));
+    }
+    std::reverse(steps.begin(), steps.end());
+    steps.emplace_back(backwardStart, side == 0 ? e : graph.reverseArc(u, e));
+    for (StationId w = backwardStart; backward.parentEdge(w) != kInvalidEdge; w = backward.parent(w)) {
+        steps.emplace_back(backward.parent(w), graph.reverseArc(backward.parent(w), backward.parentEdge(w)));
+    }
+}
+
+// Alternates between the two queues, always advancing the one with the
+// smaller key. best is the lightest start-end connection seen through any
+// relaxed arc; once the two queue minima add up to at least best, no
+// unexplored path can be lighter. Fills steps and returns true, or returns
+// false if end is unreachable.
+template <typename Weight, typename Forward, typename Backward>
+bool bidirectionalKernel(const MetroGraph& graph, StationId startId, StationId endId, Forward& forwardQueue,
+                         Backward& backwardQueue, const CancelFlag* cancel, std::vector<PathStep>& steps) {
+    using Value = typename Weight::Value;
+    const Value unreached = unreachedValue<Weight>();
+    SearchWorkspace<Value>* workspace[2] = {&threadSearchWorkspace<Value, 0>(), &threadSearchWorkspace<Value, 1>()};
+    workspace[0]->reset(graph.stationCount());
+    workspace[1]->reset(graph.stationCount());
+    forwardQueue.clear();
+    backwardQueue.clear();
+
+    workspace[0]->label(startId, 0, kInvalidStation, kInvalidEdge);
+    workspace[1]->label(endId, 0, kInvalidStation, kInvalidEdge);
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    forwardQueue.push(0, startId);
+    backwardQueue.push(0, endId);
+    METRO_STAT(counters.pushes += 2);
+
+    Value best = unreached;
+    int meetSide = 0;
+    StationId meetStation = kInvalidStation;
+    EdgeId meetEdge = kInvalidEdge;
+
+    // Settles one station of the side's search and relaxes its arcs
+    auto step = [&](int side, auto& queue) {
+        SearchWorkspace<Value>& mine = *workspace[side];
+        const SearchWorkspace<Value>& theirs = *workspace[1 - side];
+        auto top = queue.pop();
+        StationId u = top.second;
+        if (top.first > mine.distance(u)) {
+            METRO_STAT(counters.stalePops++);
+            return;
+        }
+        METRO_STAT(counters.settled++);
+        METRO_STAT(counters.relaxed += graph.edgesEnd(u) - graph.edgesBegin(u));
+
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            StationId v = graph.targets[e];
+            Value candidate = top.first + Weight::weight(graph, e);
+            if (candidate < mine.distance(v)) {
+                mine.label(v, candidate, u, e);
+                queue.push(candidate, v);
+                METRO_STAT(counters.pushes++);
+            }
+            // A closed arc loops back to u and never shortens a path
+            if (v != u && theirs.reached(v) && candidate + theirs.distance(v) < best) {
+                best = candidate + theirs.distance(v);
+                meetSide = side;
+                meetStation = u;
+                meetEdge = e;
+            }
+        }
+    };
+
+    while (!forwardQueue.empty() && !backwardQueue.empty()) {
+        const Value forwardKey = forwardQueue.top().first;
+        const Value backwardKey = backwardQueue.top().first;
+        if (best != unreached && forwardKey + backwardKey >= best) break;
+        if (isCancelled(cancel)) return false;
+        if (forwardKey <= backwardKey) {
+            step(0, forwardQueue);
+        } else {
+            step(1, backwardQueue);
+        }
+    }
+
+    if (best == unreached) return false;
+    joinAtMeeting(graph, *workspace[0], *workspace[1], meetSide, meetStation, meetEdge, steps);
+    return true;
+}
+
+// The two queues for Weight: per-thread, in slots 0 and 1
+template <typename Weight>
+bool bidirectionalDijkstraKernel(const MetroGraph& graph, StationId startId, StationId endId, const CancelFlag* cancel,
+                                 std::vector<PathStep>& steps) {
+    return withThreadDijkstraQueue<Weight, 0>(graph, [&](auto& forwardQueue) {
+        return withThreadDijkstraQueue<Weight, 1>(graph, [&](auto& backwardQueue) {
+            return bidirectionalKernel<Weight>(graph, startId, endId, forwardQueue, backwardQueue, cancel, steps);
+        });
+    });
+}
+
+} // namespace
+
+// Expands whole BFS levels, always on the side with the smaller frontier.
+// Once a level touches the other side, the best meeting of that level is a
+// shortest path, so the search stops after finishing it.
+std::vector<PathSegment> MetroSystem::bidirectionalBfs(const NetworkState& network, StationId startId, StationId endId,
+                                                       const CancelFlag* cancel) const {
+    using Depth = HopWeight::Value;
+    const MetroGraph& graph = network.graph;
+    SearchWorkspace<Depth>* depth[2] = {&threadSearchWorkspace<Depth, 0>(), &threadSearchWorkspace<Depth, 1>()};
+    thread_local std::vector<StationId> frontier[2];
+    thread_local std::vector<StationId> nextFrontier;
+    thread_local std::vector<PathStep> steps;
+    depth[0]->reset(graph.stationCount());
+    depth[1]->reset(graph.stationCount());
+    depth[0]->label(startId, 0, kInvalidStation, kInvalidEdge);
+    depth[1]->label(endId, 0, kInvalidStation, kInvalidEdge);
+    frontier[0].assign(1, startId);
+    frontier[1].assign(1, endId);
+
+    Depth best = std::numeric_limits<Depth>::max();
+    int meetSide = 0;
+    StationId meetStation = kInvalidStation;
+    EdgeId meetEdge = kInvalidEdge;
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    METRO_STAT(counters.pushes += 2);
+
+    while (!frontier[0].empty() && !frontier[1].empty() && best == std::numeric_limits<Depth>::max()) {
+        const int side = frontier[0].size() <= frontier[1].size() ? 0 : 1;
+        SearchWorkspace<Depth>& mine = *depth[side];
+        const SearchWorkspace<Depth>& theirs = *depth[1 - side];
+        if (isCancelled(cancel)) return {};
+        nextFrontier.clear();
+        for (StationId u : frontier[side]) {
+            METRO_STAT(counters.settled++);
+            METRO_STAT(counters.relaxed += graph.edgesEnd(u) - graph.edgesBegin(u));
+            for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+                StationId v = graph.targets[e];
+                if (v != u && theirs.reached(v) && mine.distance(u) + 1 + theirs.distance(v) < best) {
+                    best = mine.distance(u) + 1 + theirs.distance(v);
+                    meetSide = side;
+                    meetStation = u;
+                    meetEdge = e;
+                }
+                if (!mine.reached(v)) {
+                    mine.label(v, mine.distance(u) + 1, u, e);
+                    nextFrontier.push_back(v);
+                    METRO_STAT(counters.pushes++);
+                }
+            }
+        }
+        frontier[side].swap(nextFrontier);
+    }
+
+    if (best == std::numeric_limits<Depth>::max()) return {};
+    joinAtMeeting(graph, *depth[0], *depth[1], meetSide, meetStation, meetEdge, steps);
+    return buildPath(network, startId, steps);
+}
+
+std::vector<PathSegment> MetroSystem::bidirectionalDijkstra(const NetworkState& network, StationId startId, StationId endId,
+                                                            RouteCriterion criterion, const CancelFlag* cancel) const {
+    const MetroGraph& graph = network.graph;
+    thread_local std::vector<PathStep> steps;
+    bool found = false;
+    switch (criterion) {
+    case RouteCriterion::LeastStops:
+        return bidirectionalBfs(network, startId, endId, cancel);
+    case RouteCriterion::Time:
+        found = bidirectionalDijkstraKernel<TimeWeight>(graph, startId, endId, cancel, steps);
+        break;
+    case RouteCriterion::Cost:
+        found = bidirectionalDijkstraKernel<CostWeight>(graph, startId, endId, cancel, steps);
+        break;
+    case RouteCriterion::Distance:
+        found = bidirectionalDijkstraKernel<DistanceWeight>(graph, startId, endId, cancel, steps);
+        break;
+    }
+    if (!found) return {};
+    return buildPath(network, startId, steps);
+}
@@ -0,0 +1,325 @@
+#include "contractionhierarchy.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+
+#include "searchstats.h"
+#include "searchworkspace.h"
+
+namespace {
+
+constexpr long long kInfinity = std::numeric_limits<long long>::max();
+
+// Witness searches give up after this many settled stations. Missing a
+// witness only costs an unnecessary shortcut, never a wrong answer.
+constexpr int kWitnessSettleLimit = 500;
+
+struct Neighbor {
+    StationId node;
+    long long weight;
+    uint32_t arc;
+};
+
+struct PendingShortcut {
+    StationId a;
+    StationId b;
+    long long weight;
+    uint32_t firstChild;
+    uint32_t secondChild;
+};
+
+using QueueEntry = std::pair<long long, StationId>;
+using MinQueue = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>>;
+
+// Bounded Dijkstra on the not-yet-contracted graph that ignores one station
+class WitnessSearch {
+public:
+    explicit WitnessSearch(size_t stationCount) : distance_(stationCount, kInfinity) {}
+
+    void run(const std::vector<std::vector<Neighbor>>& adjacency, StationId source, StationId excluded, long long limit) {
+        for (StationId node : touched_) distance_[node] = kInfinity;
+        touched_.clear();
+
+        MinQueue queue;
+        distance_[source] = 0;
+        touched_.push_back(source);
+        queue.push({0, source});
+        int settled = 0;
+        while (!queue.empty()) {
+            QueueEntry top = queue.top(); queue.pop();
+            if (top.first > distance_[top.second]) continue;
+            if (top.first > limit || ++settled > kWitnessSettleLimit) break;
+            for (const Neighbor& nb : adjacency[top.second]) {
+                if (nb.node == excluded) continue;
+                long long candidate = top.first + nb.weight;
+                if (candidate < distance_[nb.node]) {
+                    if (distance_[nb.node] == kInfinity) touched_.push_back(nb.node);
+                    distance_[nb.node] = candidate;
+                    queue.push({candidate, nb.node});
+                }
+            }
+        }
+    }
+
+    long long distance(StationId node) const { return distance_[node]; }
+
+private:
+    std::vector<long long> distance_;
+    std::vector<StationId> touched_;
+};
+
+Neighbor* findNeighbor(std::vector<std::vector<Neighbor>>& adjacency, StationId from, StationId to) {
+    for (Neighbor& nb : adjacency[from]) {
+        if (nb.node == to) return &nb;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void ContractionHierarchy::clear() {
+    arcs_.clear();
+    rank_.clear();
+    upOffsets_.clear();
+    upTargets_.clear();
+    upWeights_.clear();
+    upArcs_.clear();
+    shortcutCount_ = 0;
+}
+
+size_t ContractionHierarchy::memoryFootprint() const {
+    return arcs_.capacity() * sizeof(Arc) + rank_.capacity() * sizeof(uint32_t)
+           + upOffsets_.capacity() * sizeof(uint32_t) + upTargets_.capacity() * sizeof(StationId)
+           + upWeights_.capacity() * sizeof(long long) + upArcs_.capacity() * sizeof(uint32_t);
+}
+
+void ContractionHierarchy::build(const MetroGraph& graph, const std::vector<int>& weights) {
+    clear();
+    const size_t n = graph.stationCount();
+    std::vector<std::vector<Neighbor>> adjacency(n);
+
+    auto setArc = [&](StationId a, StationId b, uint32_t arc, long long weight) {
+        Neighbor* forward = findNeighbor(adjacency, a, b);
+        if (forward) {
+            *forward = Neighbor{b, weight, arc};
+            *findNeighbor(adjacency, b, a) = Neighbor{a, weight, arc};
+        } else {
+            adjacency[a].push_back(Neighbor{b, weight, arc});
+            adjacency[b].push_back(Neighbor{a, weight, arc});
+        }
+    };
+
+    // Original arcs: one per station pair, keeping the lightest of any
+    // parallel segments (the first one on ties).
+    for (StationId u = 0; u < n; ++u) {
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            StationId v = graph.targets[e];
+            if (v <= u) continue;
+            Neighbor* existing = findNeighbor(adjacency, u, v);
+            if (existing && existing->weight <= weights[e]) continue;
+            arcs_.push_back(Arc{u, v, weights[e], e, kInvalidStation, 0, 0});
+            setArc(u, v, static_cast<uint32_t>(arcs_.size() - 1), weights[e]);
+        }
+    }
+
+    WitnessSearch witness(n);
+    // Shortcuts needed to contract v, given the stations still present
+    auto findShortcuts = [&](StationId v, std::vector<PendingShortcut>* out) {
+        const std::vector<Neighbor>& neighbors = adjacency[v];
+        int needed = 0;
+        for (size_t i = 0; i + 1 < neighbors.size(); ++i) {
+            long long limit = 0;
+            for (size_t j = i + 1; j < neighbors.size(); ++j) {
+                limit = std::max(limit, neighbors[i].weight + neighbors[j].weight);
+            }
+            witness.run(adjacency, neighbors[i].node, v, limit);
+            for (size_t j = i + 1; j < neighbors.size(); ++j) {
+                long long viaWeight = neighbors[i].weight + neighbors[j].weight;
+                if (witness.distance(neighbors[j].node) <= viaWeight) continue;
+                needed++;
+                if (out) {
+                    out->push_back(PendingShortcut{neighbors[i].node, neighbors[j].node, viaWeight,
+                                                   neighbors[i].arc, neighbors[j].arc});
+                }
+            }
+        }
+        return needed;
+    };
+
+    // Edge difference plus the number of already contracted neighbours,
+    // which spreads contraction evenly over the network.
+    std::vector<int> contractedNeighbors(n, 0);
+    auto priority = [&](StationId v) {
+        return 2 * findShortcuts(v, nullptr) - static_cast<int>(adjacency[v].size()) + contractedNeighbors[v];
+    };
+
+    using PriorityEntry = std::pair<int, StationId>;
+    std::priority_queue<PriorityEntry, std::vector<PriorityEntry>, std::greater<PriorityEntry>> order;
+    for (StationId v = 0; v < n; ++v) {
+        order.push({priority(v), v});
+    }
+
+    rank_.assign(n, 0);
+    std::vector<char> contracted(n, 0);
+    std::vector<std::vector<Neighbor>> upward(n);
+    std::vector<PendingShortcut> shortcuts;
+    uint32_t nextRank = 0;
+
+    while (!order.empty()) {
+        StationId v = order.top().second;
+        order.pop();
+        if (contracted[v]) continue;
+
+        // Lazy update: priorities of remaining stations go stale as their
+        // neighbours are contracted, so re-check before committing.
+        int current = priority(v);
+        if (!order.empty() && current > order.top().first) {
+            order.push({current, v});
+            continue;
+        }
+
+        shortcuts.clear();
+        findShortcuts(v, &shortcuts);
+        rank_[v] = nextRank++;
+        contracted[v] = 1;
+        upward[v] = adjacency[v];
+        for (const Neighbor& nb : adjacency[v]) {
+            std::vector<Neighbor>& back = adjacency[nb.node];
+            back.erase(std::remove_if(back.begin(), back.end(), [v](const Neighbor& x) { return x.node == v; }), back.end());
+            contractedNeighbors[nb.node]++;
+        }
+        adjacency[v].clear();
+        adjacency[v].shrink_to_fit();
+
+        for (const PendingShortcut& sc : shortcuts) {
+            Neighbor* existing = findNeighbor(adjacency, sc.a, sc.b);
+            if (existing && existing->weight <= sc.weight) continue;
+            arcs_.push_back(Arc{sc.a, sc.b, sc.weight, kInvalidEdge, v, sc.firstChild, sc.secondChild});
+            setArc(sc.a, sc.b, static_cast<uint32_t>(arcs_.size() - 1), sc.weight);
+            shortcutCount_++;
+        }
+    }
+
+    upOffsets_.assign(n + 1, 0);
+    for (StationId v = 0; v < n; ++v) {
+        upOffsets_[v + 1] = upOffsets_[v] + static_cast<uint32_t>(upward[v].size());
+    }
+    upTargets_.reserve(upOffsets_.back());
+    upWeights_.reserve(upOffsets_.back());
+    upArcs_.reserve(upOffsets_.back());
+    for (StationId v = 0; v < n; ++v) {
+        for (const Neighbor& nb : upward[v]) {
+            upTargets_.push_back(nb.node);
+            upWeights_.push_back(nb.weight);
+            upArcs_.push_back(nb.arc);
+        }
+    }
+}
+
+bool ContractionHierarchy::query(StationId source, StationId target, std::vector<PathStep>& steps, long long* totalWeight) const {
+    steps.clear();
+    if (empty() || source >= rank_.size() || target >= rank_.size()) return false;
+    if (source == target) {
+        if (totalWeight) *totalWeight = 0;
+        return true;
+    }
+
+    // Labels live in the calling thread's epoch-stamped workspaces, one
+    // slot per direction, so a query only touches its two upward search
+    // spaces; a label's parent arc is the hierarchy arc it came through.
+    // The heaps are vectors run like the priority_queue they replace, so
+    // they keep their storage between queries.
+    SearchWorkspace<long long>* labels[2] = {&threadSearchWorkspace<long long, 0>(), &threadSearchWorkspace<long long, 1>()};
+    thread_local std::vector<QueueEntry> queues[2];
+    thread_local std::vector<std::pair<uint32_t, StationId>> forwardArcs;
+    const std::greater<QueueEntry> later;
+    for (int side = 0; side < 2; ++side) {
+        labels[side]->reset(rank_.size());
+        queues[side].clear();
+    }
+    labels[0]->label(source, 0, kInvalidStation, 0);
+    labels[1]->label(target, 0, kInvalidStation, 0);
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    queues[0].push_back({0, source});
+    queues[1].push_back({0, target});
+    METRO_STAT(counters.pushes += 2);
+
+    long long best = kInfinity;
+    StationId meeting = kInvalidStation;
+
+    while (!queues[0].empty() || !queues[1].empty()) {
+        int side;
+        if (queues[0].empty()) side = 1;
+        else if (queues[1].empty()) side = 0;
+        else side = queues[0].front().first <= queues[1].front().first ? 0 : 1;
+
+        std::vector<QueueEntry>& queue = queues[side];
+        SearchWorkspace<long long>& mine = *labels[side];
+        if (queue.front().first >= best) {
+            queue.clear(); // this direction cannot improve on best any more
+            continue;
+        }
+        std::pop_heap(queue.begin(), queue.end(), later);
+        QueueEntry top = queue.back();
+        queue.pop_back();
+        StationId u = top.second;
+        if (top.first > mine.distance(u)) {
+            METRO_STAT(counters.stalePops++);
+            continue;
+        }
+        METRO_STAT(counters.settled++);
+        METRO_STAT(counters.relaxed += upOffsets_[u + 1] - upOffsets_[u]);
+
+        const SearchWorkspace<long long>& other = *labels[1 - side];
+        if (other.reached(u) && top.first + other.distance(u) < best) {
+            best = top.first + other.distance(u);
+            meeting = u;
+        }
+
+        for (uint32_t i = upOffsets_[u]; i < upOffsets_[u + 1]; ++i) {
+            StationId v = upTargets_[i];
+            long long candidate = top.first + upWeights_[i];
+            if (candidate < mine.distance(v)) {
+                mine.label(v, candidate, u, upArcs_[i]);
+                queue.push_back({candidate, v});
+                std::push_heap(queue.begin(), queue.end(), later);
+                METRO_STAT(counters.pushes++);
+            }
+        }
+    }
+
+    if (meeting == kInvalidStation) return false;
+    METRO_STAT(ReconstructTimer reconstructTimer);
+
+    // source ... meeting: walk the forward labels back, then unpack in order
+    forwardArcs.clear();
+    for (StationId v = meeting; v != source; v = labels[0]->parent(v)) {
+        forwardArcs.push_back({labels[0]->parentEdge(v), labels[0]->parent(v)});
+    }
+    for (auto it = forwardArcs.rbegin(); it != forwardArcs.rend(); ++it) {
+        unpack(it->first, it->second, steps);
+    }
+    // meeting ... target: backward labels already point towards target
+    for (StationId v = meeting; v != target; v = labels[1]->parent(v)) {
+        unpack(labels[1]->parentEdge(v), v, steps);
+    }
+
+    if (totalWeight) *totalWeight = best;
+    return true;
+}
+
+void ContractionHierarchy::unpack(uint32_t arcIndex, StationId from, std::vector<PathStep>& steps) const {
+    const Arc& arc = arcs_[arcIndex];
+    if (arc.baseEdge != kInvalidEdge) {
+        steps.push_back({from == arc.a ? arc.b : arc.a, arc.baseEdge});
+        return;
+    }
+    if (from == arc.a) {
+        unpack(arc.firstChild, arc.a, steps);
+        unpack(arc.secondChild, arc.via, steps);
+    } else {
+        unpack(arc.secondChild, arc.b, steps);
+        unpack(arc.firstChild, arc.via, steps);
+    }
+}
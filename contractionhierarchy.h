@@ -0,0 +1,60 @@
+#ifndef CONTRACTIONHIERARCHY_H
+#define CONTRACTIONHIERARCHY_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "metrograph.h"
+
+// Contraction hierarchy over one weight of a MetroGraph (times or costs).
+//
+// Stations are contracted one by one in order of importance; whenever
+// removing a station would lengthen a shortest path between two of its
+// neighbours, a shortcut arc is added. Queries then only have to search
+// "upward" (towards more important stations) from both ends. Because the
+// metro graph is undirected, one upward graph serves both search
+// directions.
+class ContractionHierarchy {
+public:
+    // One hop of an unpacked path: the station reached and the original
+    // graph arc used to reach it.
+    using PathStep = std::pair<StationId, EdgeId>;
+
+    void build(const MetroGraph& graph, const std::vector<int>& weights);
+    void clear();
+    bool empty() const { return rank_.empty(); }
+
+    // Shortest source -> target path as original graph arcs. Returns false
+    // if target is unreachable. totalWeight receives the path weight.
+    bool query(StationId source, StationId target, std::vector<PathStep>& steps, long long* totalWeight = nullptr) const;
+
+    size_t shortcutCount() const { return shortcutCount_; }
+    size_t memoryFootprint() const; // Bytes held by the hierarchy
+
+private:
+    // An arc of the hierarchy. Original arcs carry the graph arc they stand
+    // for; shortcuts remember the two arcs (a-via, via-b) they replace.
+    struct Arc {
+        StationId a;
+        StationId b;
+        long long weight;
+        EdgeId baseEdge;       // kInvalidEdge for shortcuts
+        StationId via;
+        uint32_t firstChild;   // arc a-via
+        uint32_t secondChild;  // arc via-b
+    };
+
+    void unpack(uint32_t arc, StationId from, std::vector<PathStep>& steps) const;
+
+    std::vector<Arc> arcs_;
+    std::vector<uint32_t> rank_;
+    // Upward adjacency: for every station the arcs to higher-ranked stations
+    std::vector<uint32_t> upOffsets_;
+    std::vector<StationId> upTargets_;
+    std::vector<long long> upWeights_;
+    std::vector<uint32_t> upArcs_;
+    size_t shortcutCount_ = 0;
+};
+
+#endif // CONTRACTIONHIERARCHY_H
@@ -0,0 +1,373 @@
+// Engine equivalence test, run by ctest.
+//
+// Asks the contraction hierarchies, A* and the bidirectional search for
+// routes between random pairs of stations, by every criterion, and checks
+// them against plain Dijkstra / BFS on the bundled CSV and on synthetic
+// networks from the metrobench generator. It also loads every network with
+// one thread and with several and checks that both give the same network,
+// and checks the hierarchies against Dijkstra again under live updates.
+//
+// Equally good routes are common (parallel lines, uniform weights), and the
+// engines break ties differently: the bucket queue pops equal keys last in
+// first out where the heap does not, and the other engines meet or settle in
+// another order altogether. So a route only has to have the same value as
+// Dijkstra's and be a real route (start to end along arcs of the CSV with
+// their weights); the two loads, which run the same search on the same
+// graph, must give identical routes.
+//
+//   ./engineequivalence [metroFinalData.csv]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "metrocsv.h"
+#include "metrosystem.h"
+#include "networkgenerator.h"
+
+namespace {
+
+constexpr size_t kPairsPerNetwork = 300;
+constexpr unsigned kParallelLoadThreads = 4;
+
+struct ArcWeights {
+    int time;
+    int cost;
+    double distance;
+};
+
+// Arcs of a CSV by "from\nto\nline", both directions of every valid row
+using ArcIndex = std::unordered_map<std::string, std::vector<ArcWeights>>;
+
+std::string arcKey(std::string_view from, std::string_view to, std::string_view line) {
+    std::string key(from);
+    key += '\n';
+    key += to;
+    key += '\n';
+    key += line;
+    return key;
+}
+
+bool readFile(const std::string& filename, std::string& text) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool indexArcs(const std::string& filename, ArcIndex& arcs) {
+    std::string text;
+    if (!readFile(filename, text)) return false;
+    std::string_view rest(text);
+    bool header = true;
+    while (!rest.empty()) {
+        const size_t end = rest.find('\n');
+        const std::string_view line = rest.substr(0, end);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        MetroCsvRow row;
+        if (std::exchange(header, false) || parseMetroCsvRow(line, row) != CsvIssue::None) continue;
+        const ArcWeights weights{row.time, row.cost, row.distance};
+        arcs[arcKey(row.fromStation, row.toStation, row.line)].push_back(weights);
+        arcs[arcKey(row.toStation, row.fromStation, row.line)].push_back(weights);
+    }
+    return true;
+}
+
+const char* criterionName(RouteCriterion criterion) {
+    switch (criterion) {
+    case RouteCriterion::LeastStops: return "stops";
+    case RouteCriterion::Time: return "time";
+    case RouteCriterion::Cost: return "cost";
+    case RouteCriterion::Distance: return "distance";
+    }
+    return "";
+}
+
+double routeValue(const std::vector<PathSegment>& path, RouteCriterion criterion) {
+    double value = 0.0;
+    for (size_t i = 1; i < path.size(); ++i) {
+        switch (criterion) {
+        case RouteCriterion::LeastStops: value += 1; break;
+        case RouteCriterion::Time: value += path[i].timeForSegment; break;
+        case RouteCriterion::Cost: value += path[i].costForSegment; break;
+        case RouteCriterion::Distance: value += path[i].distanceForSegment; break;
+        }
+    }
+    return value;
+}
+
+bool sameRoute(const std::vector<PathSegment>& a, const std::vector<PathSegment>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].stationName != b[i].stationName || a[i].lineTakenToReach != b[i].lineTakenToReach ||
+            a[i].timeForSegment != b[i].timeForSegment || a[i].costForSegment != b[i].costForSegment ||
+            a[i].distanceForSegment != b[i].distanceForSegment) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Empty if path runs from start to end along arcs of the CSV, otherwise why not
+std::string routeError(const std::vector<PathSegment>& path, const std::string& start, const std::string& end,
+                       const ArcIndex& arcs) {
+    if (path.front().stationName != start || !path.front().isFirstSegment) return "does not begin at the start";
+    if (path.back().stationName != end) return "does not reach the end";
+    for (size_t i = 1; i < path.size(); ++i) {
+        const PathSegment& segment = path[i];
+        auto it = arcs.find(arcKey(path[i - 1].stationName, segment.stationName, segment.lineTakenToReach));
+        bool found = false;
+        if (it != arcs.end()) {
+            for (const ArcWeights& weights : it->second) {
+                found = found || (weights.time == segment.timeForSegment && weights.cost == segment.costForSegment &&
+                                  weights.distance == segment.distanceForSegment);
+            }
+        }
+        if (!found) return "no such arc " + path[i - 1].stationName + " -> " + segment.stationName + " on " +
+                           segment.lineTakenToReach;
+    }
+    return "";
+}
+
+struct EngineTally {
+    const char* name;
+    SearchEngine engine;
+    size_t routes = 0;
+    size_t identical = 0; // Same segments as Dijkstra
+    size_t ties = 0;      // Another route of the same value
+    size_t failures = 0;
+};
+
+class Checker {
+public:
+    explicit Checker(std::string network) : network_(std::move(network)) {}
+
+    void fail(const std::string& what) {
+        failures_++;
+        if (failures_ <= 20) std::fprintf(stderr, "FAIL %s: %s\n", network_.c_str(), what.c_str());
+    }
+    size_t failures() const { return failures_; }
+
+private:
+    std::string network_;
+    size_t failures_ = 0;
+};
+
+bool load(MetroSystem& system, const std::string& csv, unsigned threads) {
+    std::string errorMsg;
+    system.setLoadThreads(threads);
+    if (!system.loadMetroData(csv, errorMsg)) {
+        std::fprintf(stderr, "Load of %s with %u threads failed: %s\n", csv.c_str(), threads, errorMsg.c_str());
+        return false;
+    }
+    system.setRouteCacheCapacity(0); // Every query searches
+    return true;
+}
+
+// The snapshot holds the whole built network, so equal snapshots mean
+// equal networks down to the order of every station's arcs
+void checkLoadsMatch(const MetroSystem& sequential, const MetroSystem& parallel, Checker& checker) {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::string prefix = "engineequivalence-" + std::to_string(getpid());
+    const std::string sequentialFile = (dir / (prefix + "-1.snap")).string();
+    const std::string parallelFile = (dir / (prefix + "-n.snap")).string();
+    std::string errorMsg;
+    std::string sequentialBytes;
+    std::string parallelBytes;
+    if (!sequential.saveSnapshot(sequentialFile, errorMsg) || !parallel.saveSnapshot(parallelFile, errorMsg) ||
+        !readFile(sequentialFile, sequentialBytes) || !readFile(parallelFile, parallelBytes)) {
+        checker.fail("could not write snapshots: " + errorMsg);
+    } else if (sequentialBytes != parallelBytes) {
+        checker.fail("loading with 1 and " + std::to_string(kParallelLoadThreads) + " threads gave different networks");
+    }
+    std::filesystem::remove(sequentialFile);
+    std::filesystem::remove(parallelFile);
+
+    const std::vector<LoadIssue>& a = sequential.getLoadIssues();
+    const std::vector<LoadIssue>& b = parallel.getLoadIssues();
+    bool sameIssues = a.size() == b.size();
+    for (size_t i = 0; sameIssues && i < a.size(); ++i) {
+        sameIssues = a[i].lineNumber == b[i].lineNumber && a[i].issue == b[i].issue;
+    }
+    if (!sameIssues) checker.fail("loading with 1 and several threads skipped different rows");
+}
+
+// Closes some stations and slows down and raises the fare of a segment on
+// some of the routes, then checks the contraction hierarchies, which still
+// answer the routes the changes leave alone, against Dijkstra
+void checkHierarchiesUnderUpdates(MetroSystem& system, const std::vector<std::pair<std::string, std::string>>& pairs,
+                                  uint32_t seed, Checker& checker, const std::string& name) {
+    const std::vector<std::string> stations = system.getStationNames();
+    std::mt19937 rng(seed);
+    std::vector<NetworkUpdate> updates;
+    for (int i = 0; i < 10; ++i) {
+        NetworkUpdate update;
+        update.kind = NetworkUpdate::Kind::CloseStation;
+        update.from = stations[rng() % stations.size()];
+        updates.push_back(update);
+    }
+    system.setSearchEngine(SearchEngine::Dijkstra);
+    for (size_t i = 0; i < pairs.size(); i += 5) {
+        const std::vector<PathSegment> route = system.findPath(pairs[i].first, pairs[i].second, RouteCriterion::Time);
+        if (route.size() < 3) continue;
+        const size_t middle = route.size() / 2;
+        NetworkUpdate update;
+        update.kind = NetworkUpdate::Kind::SetSegmentWeights;
+        update.from = route[middle - 1].stationName;
+        update.to = route[middle].stationName;
+        update.line = route[middle].lineTakenToReach;
+        update.time = route[middle].timeForSegment + 5;
+        update.cost = route[middle].costForSegment + 10;
+        updates.push_back(update);
+    }
+    std::string errorMsg;
+    if (!system.applyUpdates(updates, errorMsg)) return checker.fail("updates rejected: " + errorMsg);
+
+    size_t hierarchyAnswers = 0;
+    size_t fallbacks = 0;
+    for (RouteCriterion criterion : {RouteCriterion::Time, RouteCriterion::Cost}) {
+        for (const auto& [start, end] : pairs) {
+            system.setSearchEngine(SearchEngine::Dijkstra);
+            const std::vector<PathSegment> expected = system.findPath(start, end, criterion);
+            system.setSearchEngine(SearchEngine::ContractionHierarchy);
+            SearchStats stats;
+            const std::vector<PathSegment> route = system.findPath(start, end, criterion, nullptr, &stats);
+            (stats.counters.hierarchyFallbacks ? fallbacks : hierarchyAnswers)++;
+            const std::string what = std::string("ch after updates ") + criterionName(criterion) + " " + start + " -> " + end;
+            if (route.empty() != expected.empty()) {
+                checker.fail(what + (route.empty() ? ": no route, Dijkstra found one" : ": route where Dijkstra found none"));
+            } else if (!route.empty() && routeValue(route, criterion) != routeValue(expected, criterion)) {
+                checker.fail(what + ": value " + std::to_string(routeValue(route, criterion)) + ", Dijkstra " +
+                             std::to_string(routeValue(expected, criterion)));
+            } else if (!route.empty() && (route.front().stationName != start || route.back().stationName != end)) {
+                checker.fail(what + ": wrong ends");
+            }
+        }
+    }
+    std::printf("%s ch after updates: %zu answered by the hierarchies, %zu by Dijkstra\n", name.c_str(),
+                hierarchyAnswers, fallbacks);
+    system.clearUpdates();
+}
+
+bool checkNetwork(const std::string& name, const std::string& csv, uint32_t seed) {
+    Checker checker(name);
+    ArcIndex arcs;
+    MetroSystem sequential;
+    MetroSystem parallel;
+    if (!indexArcs(csv, arcs) || !load(sequential, csv, 1) || !load(parallel, csv, kParallelLoadThreads)) {
+        std::fprintf(stderr, "FAIL %s: could not read %s\n", name.c_str(), csv.c_str());
+        return false;
+    }
+    checkLoadsMatch(sequential, parallel, checker);
+
+    const std::vector<std::string> stations = sequential.getStationNames();
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, stations.size() - 1);
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (size_t i = 0; i < kPairsPerNetwork; ++i) pairs.emplace_back(stations[pick(rng)], stations[pick(rng)]);
+
+    const RouteCriterion criteria[] = {RouteCriterion::LeastStops, RouteCriterion::Time, RouteCriterion::Cost,
+                                       RouteCriterion::Distance};
+    std::vector<EngineTally> tallies = {{"ch", SearchEngine::ContractionHierarchy},
+                                        {"astar", SearchEngine::AStar},
+                                        {"bidirectional", SearchEngine::Bidirectional}};
+    for (RouteCriterion criterion : criteria) {
+        std::vector<std::vector<PathSegment>> reference;
+        sequential.setSearchEngine(SearchEngine::Dijkstra);
+        parallel.setSearchEngine(SearchEngine::Dijkstra);
+        for (const auto& [start, end] : pairs) {
+            reference.push_back(sequential.findPath(start, end, criterion));
+            const std::string what = std::string(criterionName(criterion)) + " " + start + " -> " + end;
+            if (!sameRoute(reference.back(), parallel.findPath(start, end, criterion))) {
+                checker.fail("dijkstra " + what + ": the two loads give different routes");
+            }
+            if (!reference.back().empty()) {
+                const std::string error = routeError(reference.back(), start, end, arcs);
+                if (!error.empty()) checker.fail("dijkstra " + what + ": " + error);
+            }
+        }
+
+        for (EngineTally& tally : tallies) {
+            sequential.setSearchEngine(tally.engine);
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                const auto& [start, end] = pairs[i];
+                const std::vector<PathSegment> route = sequential.findPath(start, end, criterion);
+                const std::vector<PathSegment>& expected = reference[i];
+                const std::string what = std::string(tally.name) + " " + criterionName(criterion) + " " + start +
+                                         " -> " + end;
+                tally.routes++;
+                const size_t before = checker.failures();
+                if (route.empty() != expected.empty()) {
+                    checker.fail(what + (route.empty() ? ": no route, Dijkstra found one" : ": route where Dijkstra found none"));
+                } else if (sameRoute(route, expected)) {
+                    tally.identical++;
+                } else {
+                    const double value = routeValue(route, criterion);
+                    const double expectedValue = routeValue(expected, criterion);
+                    const std::string error = routeError(route, start, end, arcs);
+                    if (std::abs(value - expectedValue) > 1e-9 * std::max(1.0, std::abs(expectedValue))) {
+                        checker.fail(what + ": value " + std::to_string(value) + ", Dijkstra " + std::to_string(expectedValue));
+                    } else if (!error.empty()) {
+                        checker.fail(what + ": " + error);
+                    } else {
+                        tally.ties++;
+                    }
+                }
+                if (checker.failures() != before) tally.failures++;
+            }
+        }
+    }
+
+    checkHierarchiesUnderUpdates(sequential, pairs, seed, checker, name);
+
+    for (const EngineTally& tally : tallies) {
+        std::printf("%s %s: %zu routes, %zu identical to Dijkstra, %zu equally good, %zu wrong\n", name.c_str(),
+                    tally.name, tally.routes, tally.identical, tally.ties, tally.failures);
+    }
+    return checker.failures() == 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const std::string bundled = argc > 1 ? argv[1] : "metroFinalData.csv";
+    bool ok = checkNetwork("bundled", bundled, 1);
+
+    // Weights that follow length, and narrow uniform ones full of ties;
+    // enough stations that the parallel load splits the graph into ranges
+    NetworkSpec spec;
+    spec.stations = 6000;
+    spec.lines = 24;
+    spec.interchangeRate = 0.15;
+    spec.seed = 7;
+    NetworkSpec uniform = spec;
+    uniform.weights = "uniform";
+    uniform.minTime = 1;
+    uniform.maxTime = 3;
+    uniform.minCost = 10;
+    uniform.maxCost = 12;
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    for (const auto& [name, networkSpec] : {std::pair<std::string, NetworkSpec>{"synthetic", spec},
+                                            std::pair<std::string, NetworkSpec>{"synthetic-uniform", uniform}}) {
+        const std::string csv = (dir / ("engineequivalence-" + std::to_string(getpid()) + "-" + name + ".csv")).string();
+        GeneratedNetwork generated;
+        if (!generateNetwork(networkSpec, csv, generated)) {
+            std::fprintf(stderr, "FAIL %s: could not write %s\n", name.c_str(), csv.c_str());
+            ok = false;
+            continue;
+        }
+        ok = checkNetwork(name, csv, networkSpec.seed) && ok;
+        std::filesystem::remove(csv);
+    }
+    std::printf(ok ? "All engines agree\n" : "Engines disagree\n");
+    return ok ? 0 : 1;
+}
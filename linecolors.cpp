@@ -0,0 +1,17 @@
+#include "linecolors.h"
+
+QString getLineColor(const QString& lineName) {
+    QString lowerLineName = lineName.toLower();
+    if (lowerLineName.contains("blue")) return "blue";
+    if (lowerLineName.contains("red")) return "red";
+    if (lowerLineName.contains("green")) return "green";
+    if (lowerLineName.contains("yellow")) return "darkgoldenrod";
+    if (lowerLineName.contains("pink")) return "deeppink";
+    if (lowerLineName.contains("magenta")) return "magenta";
+    if (lowerLineName.contains("orange")) return "orange";
+    if (lowerLineName.contains("aqua")) return "darkcyan";
+    if (lowerLineName.contains("violet") || lowerLineName.contains("voilet")) return "darkviolet";
+    if (lowerLineName.contains("gray") || lowerLineName.contains("grey")) return "gray";
+    if (lowerLineName.contains("rapid")) return "saddlebrown";
+    return "black";
+}
@@ -0,0 +1,10 @@
+#ifndef LINECOLORS_H
+#define LINECOLORS_H
+
+#include <QString>
+
+// Display colour for a metro line, picked from the colour word in its name.
+// Returns an SVG colour name usable both in HTML and with QColor.
+QString getLineColor(const QString& lineName);
+
+#endif // LINECOLORS_H
@@ -0,0 +1,105 @@
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// Bounded least-recently-used map, safe to share between threads. Every
+// operation takes one mutex; values are copied in and out so no reference
+// into the cache escapes the lock.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity) : capacity_(capacity) {}
+
+    bool lookup(const Key& key, Value& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        out = it->second->second;
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void insert(const Key& key, Value value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ == 0) return;
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->second = std::move(value);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        entries_.emplace_front(key, std::move(value));
+        index_.emplace(key, entries_.begin());
+        evictOverflow();
+    }
+
+    // Removes every entry for which pred(key, value) is true
+    template <typename Predicate>
+    size_t eraseIf(Predicate pred) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t erased = 0;
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (pred(it->first, it->second)) {
+                index_.erase(it->first);
+                it = entries_.erase(it);
+                erased++;
+            } else {
+                ++it;
+            }
+        }
+        return erased;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        index_.clear();
+    }
+
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        evictOverflow();
+    }
+
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return capacity_;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return index_.size();
+    }
+
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    void evictOverflow() {
+        while (index_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    using Entry = std::pair<Key, Value>;
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    std::list<Entry> entries_; // most recently used first
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+#endif // LRUCACHE_H
@@ -3,6 +3,8 @@
 #include <QHBoxLayout>
 #include <QGridLayout>
 #include <QComboBox>
+#include <QCompleter>
+#include <QLineEdit>
 #include <QLabel>
 #include <QPushButton>
 #include <QTextEdit>
@@ -13,38 +15,41 @@
 #include <QFont>
 #include <QPropertyAnimation>
 #include <QGraphicsOpacityEffect>
+#include <QProgressBar>
+#include <QCheckBox>
+#include <QTime>
+#include <QTimeEdit>
+#include <QSpinBox>
 #include <QProcess>         // <<<< For launching Python
 #include <QJsonDocument>    // <<<< For creating JSON for Python
 #include <QJsonObject>      // <<<<
 #include <QJsonArray>       // <<<<
-
-// getLineColor function (can be shared or duplicated if not in a common utility)
-QString getLineColor(const QString& lineName) {
-    QString lowerLineName = lineName.toLower();
-    if (lowerLineName.contains("blue")) return "blue";
-    if (lowerLineName.contains("red")) return "red";
-    if (lowerLineName.contains("green")) return "green";
-    if (lowerLineName.contains("yellow")) return "darkgoldenrod";
-    if (lowerLineName.contains("pink")) return "deeppink";
-    if (lowerLineName.contains("magenta")) return "magenta";
-    if (lowerLineName.contains("orange")) return "orange";
-    if (lowerLineName.contains("aqua")) return "darkcyan";
-    if (lowerLineName.contains("violet") || lowerLineName.contains("voilet")) return "darkviolet";
-    if (lowerLineName.contains("gray") || lowerLineName.contains("grey")) return "gray";
-    if (lowerLineName.contains("rapid")) return "saddlebrown";
-    return "black";
-}
-
+#include "linecolors.h"
+#include "metromapview.h"
+#include "stationsearchmodel.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent) {
     setupUi();
-    loadData();
+    queryRunner_ = new RouteQueryRunner(metroSystem_, this);
+    connect(queryRunner_, &RouteQueryRunner::loadProgress, loadProgressBar_, &QProgressBar::setValue);
+    connect(queryRunner_, &RouteQueryRunner::loadFinished, this, &MainWindow::onLoadFinished);
+    connect(queryRunner_, &RouteQueryRunner::routeReady, this, &MainWindow::showRoute);
     connect(findPathButton_, &QPushButton::clicked, this, &MainWindow::findPath);
+    connect(reachButton_, &QPushButton::clicked, this, &MainWindow::findReach);
+    connect(criteriaComboBox_, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::updateCriterionControls);
+    connect(transferCheckBox_, &QCheckBox::toggled, this, &MainWindow::updateCriterionControls);
+    connect(diagnosticsCheckBox_, &QCheckBox::toggled, this, [this](bool checked) {
+        diagnosticsDisplay_->setVisible(checked);
+        updateDiagnostics();
+    });
+    loadData(); // Returns at once; the window shows a loading state until onLoadFinished
 }
 
 MainWindow::~MainWindow() {
     // QObject parent-child mechanism will clean up most widgets.
+    // The runner is deleted after metroSystem_, so stop its workers first.
+    queryRunner_->cancelAndWait();
 }
 
 void MainWindow::setupUi() {
@@ -57,23 +62,67 @@ void MainWindow::setupUi() {
     QGridLayout *mainLayout = new QGridLayout(centralWidget);
 
     sourceLabel_ = new QLabel("Source Station:", this);
-    sourceComboBox_ = new QComboBox(this);
-    sourceComboBox_->setEditable(false);
-    sourceComboBox_->setMinimumWidth(250);
+    sourceComboBox_ = createStationComboBox();
 
     destinationLabel_ = new QLabel("Destination Station:", this);
-    destinationComboBox_ = new QComboBox(this);
-    destinationComboBox_->setEditable(false);
-    destinationComboBox_->setMinimumWidth(250);
+    destinationComboBox_ = createStationComboBox();
 
     criteriaLabel_ = new QLabel("Optimize By:", this);
     criteriaComboBox_ = new QComboBox(this);
     criteriaComboBox_->addItem("Least Stops", 1);
     criteriaComboBox_->addItem("Least Cost", 2);
     criteriaComboBox_->addItem("Least Time", 3);
+    criteriaComboBox_->addItem("Shortest Distance", 4);
+    criteriaComboBox_->addItem("Earliest Arrival (Timetable)", 5);
+    criteriaComboBox_->addItem("Trade-offs (Time, Cost, Line Changes)", 6);
     criteriaComboBox_->setMinimumWidth(250);
 
+    departureLabel_ = new QLabel("Leave At:", this);
+    departureTimeEdit_ = new QTimeEdit(QTime::currentTime(), this);
+    departureTimeEdit_->setDisplayFormat("HH:mm");
+    departureTimeEdit_->setEnabled(false);
+
+    // Each change of line counts as this many minutes or INR on top of the route
+    transferCheckBox_ = new QCheckBox("Penalise line changes:", this);
+    transferCheckBox_->setToolTip("Least Time and Least Cost routes only change lines where it saves more than this");
+    transferMinutesSpinBox_ = new QSpinBox(this);
+    transferMinutesSpinBox_->setRange(0, 120);
+    transferMinutesSpinBox_->setValue(TransferPenalties().minutes);
+    transferMinutesSpinBox_->setSuffix(" min");
+    transferCostSpinBox_ = new QSpinBox(this);
+    transferCostSpinBox_->setRange(0, 500);
+    transferCostSpinBox_->setValue(TransferPenalties().cost);
+    transferCostSpinBox_->setPrefix("INR ");
+
+    // Above 1, the next best routes are listed under the best one
+    alternativesLabel_ = new QLabel("Alternatives:", this);
+    alternativesSpinBox_ = new QSpinBox(this);
+    alternativesSpinBox_->setRange(1, 5);
+    alternativesSpinBox_->setValue(1);
+    alternativesSpinBox_->setToolTip("List this many routes, best first, each different from the ones before it");
+
     findPathButton_ = new QPushButton("Find Route", this);
+    reachButton_ = new QPushButton("Show Reach", this);
+    reachButton_->setToolTip("Colour the stations reachable from the source station by stops, time or cost");
+
+    // The native map below is always drawn; the folium map needs Python
+    pythonMapCheckBox_ = new QCheckBox("Also open in browser (Python)", this);
+    pythonMapCheckBox_->setChecked(false);
+
+    diagnosticsCheckBox_ = new QCheckBox("Diagnostics", this);
+    diagnosticsCheckBox_->setChecked(false);
+    diagnosticsDisplay_ = new QTextEdit(this);
+    diagnosticsDisplay_->setReadOnly(true);
+    diagnosticsDisplay_->setFont(QFont("Courier New", 9));
+    diagnosticsDisplay_->setMinimumHeight(150);
+    diagnosticsDisplay_->hide();
+
+    mapView_ = new MetroMapView(this);
+
+    loadProgressBar_ = new QProgressBar(this);
+    loadProgressBar_->setRange(0, 100);
+    loadProgressBar_->setFormat("Loading metro data... %p%");
+    loadProgressBar_->hide();
 
     outputLabel_ = new QLabel("Route Details:", this);
     outputDisplay_ = new QTextEdit(this);
@@ -99,225 +148,513 @@ void MainWindow::setupUi() {
     QVBoxLayout* criteriaVLayout = new QVBoxLayout();
     criteriaVLayout->addWidget(criteriaLabel_);
     criteriaVLayout->addWidget(criteriaComboBox_);
+    QHBoxLayout* departureHLayout = new QHBoxLayout();
+    departureHLayout->addWidget(departureLabel_);
+    departureHLayout->addWidget(departureTimeEdit_, 1);
+    criteriaVLayout->addLayout(departureHLayout);
+    QHBoxLayout* transferHLayout = new QHBoxLayout();
+    transferHLayout->addWidget(transferCheckBox_);
+    transferHLayout->addWidget(transferMinutesSpinBox_);
+    transferHLayout->addWidget(transferCostSpinBox_);
+    criteriaVLayout->addLayout(transferHLayout);
+    QHBoxLayout* alternativesHLayout = new QHBoxLayout();
+    alternativesHLayout->addWidget(alternativesLabel_);
+    alternativesHLayout->addWidget(alternativesSpinBox_, 1);
+    criteriaVLayout->addLayout(alternativesHLayout);
     criteriaVLayout->setSpacing(2);
 
     mainLayout->addLayout(sourceVLayout, 0, 0);
     mainLayout->addLayout(destVLayout, 1, 0);
     mainLayout->addLayout(criteriaVLayout, 2, 0);
-    mainLayout->addWidget(findPathButton_, 3, 0, Qt::AlignCenter);
-    mainLayout->addWidget(outputLabel_, 4, 0, Qt::AlignLeft);
-    mainLayout->addWidget(outputDisplay_, 5, 0); // Output display takes the rest of this column
-
-    mainLayout->setRowStretch(5, 1); // outputDisplay_ expands vertically
+    QHBoxLayout* findHLayout = new QHBoxLayout();
+    findHLayout->addWidget(findPathButton_);
+    findHLayout->addWidget(reachButton_);
+    findHLayout->addWidget(pythonMapCheckBox_);
+    findHLayout->addWidget(diagnosticsCheckBox_);
+    findHLayout->setAlignment(Qt::AlignCenter);
+
+    mainLayout->addLayout(findHLayout, 3, 0);
+    mainLayout->addWidget(loadProgressBar_, 4, 0);
+    mainLayout->addWidget(outputLabel_, 5, 0, Qt::AlignLeft);
+    mainLayout->addWidget(outputDisplay_, 6, 0); // Output display takes the rest of this column
+    mainLayout->addWidget(diagnosticsDisplay_, 7, 0);
+    mainLayout->addWidget(mapView_, 0, 1, 8, 1); // Map fills the second column
+
+    mainLayout->setRowStretch(6, 1); // outputDisplay_ expands vertically
     mainLayout->setColumnStretch(0, 1); // The first column expands horizontally
+    mainLayout->setColumnStretch(1, 2); // The map gets the larger share
 
     mainLayout->setContentsMargins(10, 10, 10, 10);
     mainLayout->setVerticalSpacing(10);
 
     centralWidget->setLayout(mainLayout);
-    setMinimumSize(450, 550); // Adjusted for a single column layout
+    setMinimumSize(900, 550); // Controls on the left, map on the right
 }
 
-void MainWindow::loadData() {
-    std::string errorMsg;
-    // Ensure this matches your 10-column CSV for segment data + Lat/Lon
-    std::string dataFileName = "metroFinalData.csv";
-    std::string dataFilePath = QCoreApplication::applicationDirPath().toStdString() + "/" + dataFileName;
-    qDebug() << "Attempting to load data from (app dir):" << QString::fromStdString(dataFilePath);
-
-    if (!metroSystem_.loadMetroData(dataFilePath, errorMsg)) {
-        std::string relativeDataFilePath = dataFileName;
-        qDebug() << "Failed to load from app dir. Attempting to load data from (relative path):" << QString::fromStdString(relativeDataFilePath);
-        if (!metroSystem_.loadMetroData(relativeDataFilePath, errorMsg)) {
-            QMessageBox::critical(this, "Error Loading Data", QString::fromStdString(errorMsg + "\nPlease ensure '" + dataFileName + "' is in the application directory or the current working directory. Check Application Output for parsing details."));
-            sourceComboBox_->setEnabled(false);
-            destinationComboBox_->setEnabled(false);
-            criteriaComboBox_->setEnabled(false);
-            findPathButton_->setEnabled(false);
-            outputDisplay_->setHtml("<b>Failed to load metro data.</b> Application may not function correctly.");
-            return;
+namespace {
+// Minutes after midnight as HH:MM on a 24-hour clock
+QString clockText(int minutes) {
+    return QString("%1:%2").arg((minutes / 60) % 24, 2, 10, QChar('0')).arg(minutes % 60, 2, 10, QChar('0'));
+}
+
+// The lines a route rides, in order and in their colours
+QString lineSequenceHtml(const std::vector<PathSegment>& path) {
+    QStringList lines;
+    QString previous;
+    for (const PathSegment& segment : path) {
+        const QString line = QString::fromStdString(segment.lineTakenToReach);
+        if (line.isEmpty() || line == previous) continue;
+        lines << QString("<font color='%1'>%2</font>").arg(getLineColor(line)).arg(line.toHtmlEscaped());
+        previous = line;
+    }
+    return lines.join(" &rarr; ");
+}
+
+// Table of the routes of a Pareto query, each with what it is best at.
+// The directions and the map show the first, fastest one.
+QString tradeOffsHtml(const std::vector<ParetoRoute>& routes) {
+    long long leastCost = routes.front().cost;
+    int leastTransfers = routes.front().transfers;
+    for (const ParetoRoute& route : routes) {
+        leastCost = std::min(leastCost, route.cost);
+        leastTransfers = std::min(leastTransfers, route.transfers);
+    }
+    QString html = QString("<h4>%1 Trade-off(s):</h4>").arg(routes.size());
+    html += "<table border='1' cellspacing='0' cellpadding='3'><tr><th>#</th><th>Time</th><th>Cost</th>"
+            "<th>Changes</th><th>Stops</th><th>Lines</th><th>Best For</th></tr>";
+    for (size_t i = 0; i < routes.size(); ++i) {
+        const ParetoRoute& route = routes[i];
+        QStringList bestFor;
+        if (route.time == routes.front().time) bestFor << "Time";
+        if (route.cost == leastCost) bestFor << "Cost";
+        if (route.transfers == leastTransfers) bestFor << "Changes";
+        html += QString("<tr><td>%1</td><td>%2 min</td><td>INR %3</td><td>%4</td><td>%5</td><td>%6</td><td>%7</td></tr>")
+                    .arg(i + 1).arg(route.time).arg(route.cost).arg(route.transfers).arg(route.path.size() - 1)
+                    .arg(lineSequenceHtml(route.path)).arg(bestFor.join(", "));
+    }
+    html += "</table><p><i>Directions and map: option 1.</i></p><hr>";
+    return html;
+}
+
+// Table of the ranked routes of an alternatives query, by each criterion.
+// The directions and the map show the first, best one.
+QString alternativesHtml(const std::vector<std::vector<PathSegment>>& routes) {
+    QString html = QString("<h4>%1 Route(s), Best First:</h4>").arg(routes.size());
+    html += "<table border='1' cellspacing='0' cellpadding='3'><tr><th>#</th><th>Stops</th><th>Time</th>"
+            "<th>Cost</th><th>Distance</th><th>Changes</th><th>Lines</th></tr>";
+    for (size_t i = 0; i < routes.size(); ++i) {
+        const std::vector<PathSegment>& path = routes[i];
+        long long time = 0;
+        long long cost = 0;
+        double distance = 0.0;
+        for (size_t j = 1; j < path.size(); ++j) {
+            time += path[j].timeForSegment;
+            cost += path[j].costForSegment;
+            distance += path[j].distanceForSegment;
         }
+        html += QString("<tr><td>%1</td><td>%2</td><td>%3 min</td><td>INR %4</td><td>%5 km</td><td>%6</td><td>%7</td></tr>")
+                    .arg(i + 1).arg(path.size() - 1).arg(time).arg(cost).arg(distance, 0, 'f', 1)
+                    .arg(path.back().transfers).arg(lineSequenceHtml(path));
     }
+    html += "</table><p><i>Directions and map: route 1.</i></p><hr>";
+    return html;
+}
+
+// Ensure this matches your 10-column CSV for segment data + Lat/Lon
+const char* const kDataFileName = "metroFinalData.csv";
+}
+
+void MainWindow::loadData() {
+    setControlsEnabled(false);
+    outputDisplay_->setHtml("<p><b>Loading metro data...</b></p>");
+    loadProgressBar_->setValue(0);
+    loadProgressBar_->show();
+
+    // Application directory first, then the working directory
+    QStringList candidateFiles;
+    candidateFiles << QCoreApplication::applicationDirPath() + "/" + kDataFileName << kDataFileName;
+    queryRunner_->loadNetwork(candidateFiles);
+}
+
+void MainWindow::onLoadFinished(bool ok, const QString& errorMessage) {
+    loadProgressBar_->hide();
+    if (!ok) {
+        QMessageBox::critical(this, "Error Loading Data", errorMessage + "\nPlease ensure '" + kDataFileName + "' is in the application directory or the current working directory. Check Application Output for parsing details.");
+        setControlsEnabled(false);
+        outputDisplay_->setHtml("<b>Failed to load metro data.</b> Application may not function correctly.");
+        return;
+    }
+    mapView_->setNetwork(metroSystem_.getMapSegments(), metroSystem_.getStationCoordinates());
     populateComboBoxes();
+    updateDiagnostics();
+}
+
+void MainWindow::setControlsEnabled(bool enabled) {
+    sourceComboBox_->setEnabled(enabled);
+    destinationComboBox_->setEnabled(enabled);
+    criteriaComboBox_->setEnabled(enabled);
+    updateCriterionControls();
+    findPathButton_->setEnabled(enabled);
+    reachButton_->setEnabled(enabled);
+}
+
+// The departure time belongs to the timetable criterion, the transfer
+// penalties to time and cost, and alternatives to the four plain criteria
+// without penalties
+void MainWindow::updateCriterionControls() {
+    const bool enabled = criteriaComboBox_->isEnabled();
+    const int criteriaChoice = criteriaComboBox_->currentData().toInt();
+    departureTimeEdit_->setEnabled(enabled && criteriaChoice == 5);
+    transferCheckBox_->setEnabled(enabled && (criteriaChoice == 2 || criteriaChoice == 3));
+    transferMinutesSpinBox_->setEnabled(transferCheckBox_->isEnabled() && transferCheckBox_->isChecked() && criteriaChoice == 3);
+    transferCostSpinBox_->setEnabled(transferCheckBox_->isEnabled() && transferCheckBox_->isChecked() && criteriaChoice == 2);
+    alternativesSpinBox_->setEnabled(enabled && criteriaChoice >= 1 && criteriaChoice <= 4 &&
+                                     !(transferCheckBox_->isEnabled() && transferCheckBox_->isChecked()));
+}
+
+// Station boxes are editable: the drop-down pages through every station
+// alphabetically, and typing brings up the best matches from the network's
+// search index (prefix, word start, substring, then misspellings).
+QComboBox* MainWindow::createStationComboBox() {
+    QComboBox *comboBox = new QComboBox(this);
+    comboBox->setEditable(true);
+    comboBox->setInsertPolicy(QComboBox::NoInsert);
+    comboBox->setMinimumWidth(250);
+    StationSearchModel *listModel = new StationSearchModel(metroSystem_, comboBox);
+    comboBox->setModel(listModel);
+
+    StationSearchModel *completionModel = new StationSearchModel(metroSystem_, comboBox);
+    QCompleter *completer = new QCompleter(completionModel, comboBox);
+    // The model is already filtered and ranked; show it as it is
+    completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    completer->setMaxVisibleItems(12);
+    comboBox->setCompleter(completer);
+    // textEdited is emitted before the line edit asks the completer for its
+    // popup, so the popup already shows the new matches
+    connect(comboBox->lineEdit(), &QLineEdit::textEdited, completionModel, &StationSearchModel::setQuery);
+
+    stationModels_.push_back(listModel);
+    stationModels_.push_back(completionModel);
+    return comboBox;
 }
 
 void MainWindow::populateComboBoxes() {
-    std::vector<std::string> stations = metroSystem_.getStationNames();
-    QStringList stationList;
-    for (const auto& s : stations) {
-        stationList.append(QString::fromStdString(s));
-    }
-    sourceComboBox_->clear();
-    destinationComboBox_->clear();
-    if (stationList.isEmpty()) {
+    for (StationSearchModel *model : stationModels_) model->reload();
+    if (sourceComboBox_->count() == 0) {
         outputDisplay_->setHtml("<b>No stations loaded. Check data file and format. See Application Output for parsing details.</b>");
-        sourceComboBox_->setEnabled(false);
-        destinationComboBox_->setEnabled(false);
-        criteriaComboBox_->setEnabled(false);
-        findPathButton_->setEnabled(false);
+        setControlsEnabled(false);
     } else {
-        sourceComboBox_->addItems(stationList);
-        destinationComboBox_->addItems(stationList);
+        sourceComboBox_->setCurrentIndex(0);
+        destinationComboBox_->setCurrentIndex(0);
         outputDisplay_->setHtml("<p>Select source, destination, and optimization criteria, then click 'Find Route'.</p>");
-        sourceComboBox_->setEnabled(true);
-        destinationComboBox_->setEnabled(true);
-        criteriaComboBox_->setEnabled(true);
-        findPathButton_->setEnabled(true);
+        setControlsEnabled(true);
     }
 }
 
-void MainWindow::findPath() {
-    outputOpacityEffect_->setOpacity(0.0); // Make text output transparent for animation
+// Station names can be typed, so they are checked before a search
+bool MainWindow::checkStation(const QString& name, const QString& role) {
+    if (name.isEmpty()) {
+        QMessageBox::warning(this, "Input Missing", QString("Please select a %1 station.").arg(role));
+        return false;
+    }
+    if (!metroSystem_.hasStation(name.toStdString())) {
+        QMessageBox::warning(this, "Unknown Station",
+                             QString("There is no %1 station called '%2'. Pick one from the suggestions.").arg(role, name));
+        return false;
+    }
+    return true;
+}
 
-    if (sourceComboBox_->currentIndex() < 0 || destinationComboBox_->currentIndex() < 0) {
-        QMessageBox::warning(this, "Input Missing", "Please select both source and destination stations.");
-        outputOpacityEffect_->setOpacity(1.0);
+void MainWindow::findPath() {
+    QString qSource = sourceComboBox_->currentText().trimmed();
+    QString qDest = destinationComboBox_->currentText().trimmed();
+    if (!checkStation(qSource, "source") || !checkStation(qDest, "destination")) {
         return;
     }
-    std::string sourceStdStr = sourceComboBox_->currentText().toStdString();
-    std::string destStdStr = destinationComboBox_->currentText().toStdString();
     int criteriaChoice = criteriaComboBox_->currentData().toInt();
-    QString criteriaText = criteriaComboBox_->currentText();
-    QString qSource = QString::fromStdString(sourceStdStr);
-    QString qDest = QString::fromStdString(destStdStr);
 
-    QString htmlOutputContent;
-    std::vector<PathSegment> pathSegments;
+    if (qSource == qDest) {
+        queryRunner_->cancelRoute();
+        mapView_->clearRoute();
+        showOutput(QString("<h3>Route from %1 to %2</h3><hr><p>Source and Destination are the same station: <b>%3</b></p>")
+                   .arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped(), qSource.toHtmlEscaped()));
+        return;
+    }
 
-    if (sourceStdStr == destStdStr) {
-        htmlOutputContent = QString("<h3>Route from %1 to %2</h3><hr><p>Source and Destination are the same station: <b>%3</b></p>")
-        .arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped(), qSource.toHtmlEscaped());
-    } else {
-        switch (criteriaChoice) {
-        case 1: pathSegments = metroSystem_.findPathLeastStops(sourceStdStr, destStdStr); break;
-        case 2: pathSegments = metroSystem_.findPathByCost(sourceStdStr, destStdStr); break;
-        case 3: pathSegments = metroSystem_.findPathByTime(sourceStdStr, destStdStr); break;
-        default:
-            QMessageBox::critical(this, "Error", "Invalid criteria selected.");
-            outputOpacityEffect_->setOpacity(1.0);
+    RouteQuery query;
+    query.source = qSource;
+    query.destination = qDest;
+    query.criterionLabel = criteriaComboBox_->currentText();
+    switch (criteriaChoice) {
+    case 1: query.criterion = RouteCriterion::LeastStops; break;
+    case 2: query.criterion = RouteCriterion::Cost; break;
+    case 3: query.criterion = RouteCriterion::Time; break;
+    case 4: query.criterion = RouteCriterion::Distance; break;
+    case 5:
+        if (!metroSystem_.hasTimetable()) {
+            QMessageBox::information(this, "No Timetable",
+                                     "No timetable was loaded with the network. Place a timetable file next to the data file to plan by departure time.");
             return;
         }
+        query.criterion = RouteCriterion::Time;
+        query.departureMinute = departureTimeEdit_->time().hour() * 60 + departureTimeEdit_->time().minute();
+        break;
+    case 6:
+        query.criterion = RouteCriterion::Time;
+        query.pareto = true;
+        break;
+    default:
+        QMessageBox::critical(this, "Error", "Invalid criteria selected.");
+        return;
+    }
+    if (transferCheckBox_->isEnabled() && transferCheckBox_->isChecked()) {
+        query.penaliseTransfers = true;
+        query.transferPenalties.minutes = transferMinutesSpinBox_->value();
+        query.transferPenalties.cost = transferCostSpinBox_->value();
+        query.criterionLabel += query.criterion == RouteCriterion::Time
+                                    ? QString(", %1 min per line change").arg(query.transferPenalties.minutes)
+                                    : QString(", INR %1 per line change").arg(query.transferPenalties.cost);
+    }
+    if (alternativesSpinBox_->isEnabled()) query.alternatives = alternativesSpinBox_->value();
 
-        if (pathSegments.empty()) {
-            htmlOutputContent = QString("<h3>Route from %1 to %2</h3><hr><p><b>No path found.</b></p><p><i>Criteria: %3</i></p>")
-            .arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped(), criteriaText.toHtmlEscaped());
-        } else {
-            // --- Build HTML for textual output ---
-            htmlOutputContent = QString("<h3>Route from %1 to %2</h3>").arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped());
-            htmlOutputContent += QString("<p><i>Optimized for: %1</i></p><hr>").arg(criteriaText.toHtmlEscaped());
-            long long totalTime = 0; long long totalCost = 0; int lineChanges = 0; int totalSegments = 0;
-            QString prevLineForSummary = "";
-            if (pathSegments.size() > 1) {
-                for (size_t i = 1; i < pathSegments.size(); ++i) {
-                    const auto& seg = pathSegments[i];
-                    totalTime += seg.timeForSegment; totalCost += seg.costForSegment; totalSegments++;
-                    QString currentSegLine = QString::fromStdString(seg.lineTakenToReach);
-                    if (!currentSegLine.isEmpty() && currentSegLine != prevLineForSummary && !prevLineForSummary.isEmpty()) lineChanges++;
-                    prevLineForSummary = currentSegLine;
-                }
+    // Runs on the worker pool; a route still being searched is cancelled.
+    // The answer arrives in showRoute().
+    outputDisplay_->setHtml(QString("<p><i>Searching for a route from %1 to %2...</i></p>")
+                            .arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped()));
+    queryRunner_->findRoute(query);
+}
+
+void MainWindow::findReach() {
+    RouteQuery query;
+    query.source = sourceComboBox_->currentText().trimmed();
+    if (!checkStation(query.source, "source")) {
+        return;
+    }
+    query.criterionLabel = criteriaComboBox_->currentText();
+    // Band bounds per criterion, in stops, minutes and INR
+    switch (criteriaComboBox_->currentData().toInt()) {
+    case 1: query.criterion = RouteCriterion::LeastStops; query.isochroneBounds = {2, 4, 6, 8, 12}; break;
+    case 2: query.criterion = RouteCriterion::Cost; query.isochroneBounds = {10, 20, 30, 40, 60}; break;
+    case 3: query.criterion = RouteCriterion::Time; query.isochroneBounds = {10, 20, 30, 45, 60}; break;
+    default:
+        QMessageBox::information(this, "Not Available", "Reach can be shown by Least Stops, Least Cost or Least Time.");
+        return;
+    }
+    outputDisplay_->setHtml(QString("<p><i>Finding the stations within reach of %1...</i></p>").arg(query.source.toHtmlEscaped()));
+    queryRunner_->findRoute(query);
+}
+
+void MainWindow::showReach(const RouteQueryResult& result) {
+    const RouteQuery& query = result.query;
+    mapView_->showIsochrone(query.source.toStdString(), result.bands);
+    const char* unit = query.criterion == RouteCriterion::LeastStops ? "stops"
+                       : query.criterion == RouteCriterion::Cost ? "INR" : "min";
+    QString html = QString("<h3>Reach from %1</h3><p><i>By: %2</i></p><hr><ul>")
+                       .arg(query.source.toHtmlEscaped(), query.criterionLabel.toHtmlEscaped());
+    for (const IsochroneBand& band : result.bands) {
+        QStringList names;
+        for (const std::string& station : band.stations) {
+            if (QString::fromStdString(station) != query.source) names << QString::fromStdString(station).toHtmlEscaped();
+        }
+        html += QString("<li><b>Up to %1 %2:</b> %3 station(s)").arg(band.upTo).arg(unit).arg(names.size());
+        if (!names.isEmpty()) html += "<br>" + names.join(", ");
+        html += "</li>";
+    }
+    html += "</ul>";
+    showOutput(html);
+}
+
+void MainWindow::showRoute(const RouteQueryResult& result) {
+    if (!result.query.isochroneBounds.empty()) {
+        showReach(result);
+        return;
+    }
+    const std::vector<PathSegment>& pathSegments = result.path;
+    const QString& qSource = result.query.source;
+    const QString& qDest = result.query.destination;
+    const QString& criteriaText = result.query.criterionLabel;
+    QString htmlOutputContent;
+
+    mapView_->showRoute(pathSegments); // Clears the map when there is no route
+    lastSearchStats_ = result.stats;
+    hasLastSearchStats_ = true;
+    updateDiagnostics();
+
+    if (pathSegments.empty()) {
+        htmlOutputContent = QString("<h3>Route from %1 to %2</h3><hr><p><b>No path found.</b></p><p><i>Criteria: %3</i></p>")
+        .arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped(), criteriaText.toHtmlEscaped());
+    } else {
+        // --- Build HTML for textual output ---
+        htmlOutputContent = QString("<h3>Route from %1 to %2</h3>").arg(qSource.toHtmlEscaped(), qDest.toHtmlEscaped());
+        htmlOutputContent += QString("<p><i>Optimized for: %1</i></p><hr>").arg(criteriaText.toHtmlEscaped());
+        if (!result.routes.empty()) htmlOutputContent += tradeOffsHtml(result.routes);
+        if (result.alternatives.size() > 1) htmlOutputContent += alternativesHtml(result.alternatives);
+        long long totalTime = 0; long long totalCost = 0; double totalDistance = 0.0; int totalSegments = 0;
+        const int lineChanges = pathSegments.back().transfers;
+        if (pathSegments.size() > 1) {
+            for (size_t i = 1; i < pathSegments.size(); ++i) {
+                const auto& seg = pathSegments[i];
+                totalTime += seg.waitForSegment + seg.timeForSegment; totalCost += seg.costForSegment; totalDistance += seg.distanceForSegment; totalSegments++;
             }
-            htmlOutputContent += "<h4>Summary:</h4><ul>";
-            htmlOutputContent += QString("<li><b>Total Stations in Path:</b> %1 (%2 hops)</li>").arg(pathSegments.size()).arg(totalSegments);
-            htmlOutputContent += QString("<li><b>Estimated Time:</b> %1 minutes</li>").arg(totalTime);
-            htmlOutputContent += QString("<li><b>Estimated Cost:</b> INR %1</li>").arg(totalCost);
-            htmlOutputContent += QString("<li><b>Line Changes:</b> %1</li>").arg(lineChanges);
-            htmlOutputContent += "</ul><hr><h4>Directions:</h4><ol>";
-            QString currentActiveLine = "";
-            for (size_t i = 0; i < pathSegments.size(); ++i) {
-                const auto& segment = pathSegments[i];
-                QString qStationName = QString::fromStdString(segment.stationName);
-                QString stationNameHtml = QString("<b>%1</b>").arg(qStationName.toHtmlEscaped());
-                if (segment.isFirstSegment) {
-                    htmlOutputContent += QString("<li>Start at %1.</li>").arg(stationNameHtml);
-                    if (pathSegments.size() > 1) {
-                        currentActiveLine = QString::fromStdString(pathSegments[i+1].lineTakenToReach);
-                        if (!currentActiveLine.isEmpty()){
-                            QString firstLineHtml = QString("<font color='%1'>%2</font>").arg(getLineColor(currentActiveLine)).arg(currentActiveLine.toHtmlEscaped());
-                            htmlOutputContent += QString("<li>Board %1.</li>").arg(firstLineHtml);
-                        }
+        }
+        htmlOutputContent += "<h4>Summary:</h4><ul>";
+        htmlOutputContent += QString("<li><b>Total Stations in Path:</b> %1 (%2 hops)</li>").arg(pathSegments.size()).arg(totalSegments);
+        htmlOutputContent += QString("<li><b>Estimated Time:</b> %1 minutes</li>").arg(totalTime);
+        const int departureMinute = result.query.departureMinute;
+        if (departureMinute >= 0) {
+            htmlOutputContent += QString("<li><b>Leave / Arrive:</b> %1 / %2</li>")
+                                     .arg(clockText(departureMinute), clockText(departureMinute + static_cast<int>(totalTime)));
+        }
+        htmlOutputContent += QString("<li><b>Estimated Cost:</b> INR %1</li>").arg(totalCost);
+        htmlOutputContent += QString("<li><b>Distance:</b> %1 km</li>").arg(totalDistance, 0, 'f', 1);
+        htmlOutputContent += QString("<li><b>Line Changes:</b> %1</li>").arg(lineChanges);
+        htmlOutputContent += "</ul><hr><h4>Directions:</h4><ol>";
+        QString currentActiveLine = "";
+        for (size_t i = 0; i < pathSegments.size(); ++i) {
+            const auto& segment = pathSegments[i];
+            QString qStationName = QString::fromStdString(segment.stationName);
+            QString stationNameHtml = QString("<b>%1</b>").arg(qStationName.toHtmlEscaped());
+            if (segment.isFirstSegment) {
+                htmlOutputContent += QString("<li>Start at %1.</li>").arg(stationNameHtml);
+                if (pathSegments.size() > 1) {
+                    currentActiveLine = QString::fromStdString(pathSegments[i+1].lineTakenToReach);
+                    if (!currentActiveLine.isEmpty()){
+                        QString firstLineHtml = QString("<font color='%1'>%2</font>").arg(getLineColor(currentActiveLine)).arg(currentActiveLine.toHtmlEscaped());
+                        htmlOutputContent += QString("<li>Board %1.</li>").arg(firstLineHtml);
                     }
-                } else {
-                    QString qLineTaken = QString::fromStdString(segment.lineTakenToReach);
-                    QString lineHtml = "";
-                    if(!qLineTaken.isEmpty()) lineHtml = QString("<font color='%1'>%2</font>").arg(getLineColor(qLineTaken)).arg(qLineTaken.toHtmlEscaped());
-                    if (!qLineTaken.isEmpty() && qLineTaken != currentActiveLine && !currentActiveLine.isEmpty()) htmlOutputContent += QString("<li>Change to %1.</li>").arg(lineHtml);
-                    currentActiveLine = qLineTaken;
-                    htmlOutputContent += QString("<li>Arrive at %1 ").arg(stationNameHtml);
-                    if (!lineHtml.isEmpty()) htmlOutputContent += QString("via %1 ").arg(lineHtml);
-                    htmlOutputContent += QString("(Segment: %1 min, INR %2).</li>").arg(segment.timeForSegment).arg(segment.costForSegment);
                 }
+            } else {
+                QString qLineTaken = QString::fromStdString(segment.lineTakenToReach);
+                QString lineHtml = "";
+                if(!qLineTaken.isEmpty()) lineHtml = QString("<font color='%1'>%2</font>").arg(getLineColor(qLineTaken)).arg(qLineTaken.toHtmlEscaped());
+                if (!qLineTaken.isEmpty() && qLineTaken != currentActiveLine && !currentActiveLine.isEmpty()) htmlOutputContent += QString("<li>Change to %1.</li>").arg(lineHtml);
+                currentActiveLine = qLineTaken;
+                if (segment.waitForSegment > 0) htmlOutputContent += QString("<li>Wait %1 min.</li>").arg(segment.waitForSegment);
+                htmlOutputContent += QString("<li>Arrive at %1 ").arg(stationNameHtml);
+                if (!lineHtml.isEmpty()) htmlOutputContent += QString("via %1 ").arg(lineHtml);
+                htmlOutputContent += QString("(Segment: %1 min, INR %2).</li>").arg(segment.timeForSegment).arg(segment.costForSegment);
             }
-            htmlOutputContent += "</ol>";
-            // --- End of HTML generation ---
-
-            // --- Launch Python Script for Map Visualization ---
-            if (!pathSegments.empty()) {
-                QStringList pythonArgs;
-                QString pythonScriptPath = QCoreApplication::applicationDirPath() + "/map_generator.py";
-
-                pythonArgs << pythonScriptPath;
-
-                QJsonArray pathForPythonJsonArray;
-                const auto& stationCoordsMap = metroSystem_.getStationCoordinates();
-
-                for (const auto& seg : pathSegments) {
-                    auto it = stationCoordsMap.find(seg.stationName);
-                    if (it != stationCoordsMap.end()) {
-                        QJsonObject stationObj;
-                        stationObj["name"] = QString::fromStdString(seg.stationName);
-                        stationObj["lat"] = it->second.y(); // Latitude from QPointF's y()
-                        stationObj["lng"] = it->second.x(); // Longitude from QPointF's x()
-                        pathForPythonJsonArray.append(stationObj);
-                    } else {
-                        qWarning() << "findPath (for Python): Coordinate not found for station:" << QString::fromStdString(seg.stationName);
-                    }
+        }
+        htmlOutputContent += "</ol>";
+        // --- End of HTML generation ---
+
+        // --- Launch Python Script for Map Visualization (optional) ---
+        if (pythonMapCheckBox_->isChecked()) {
+            QStringList pythonArgs;
+            QString pythonScriptPath = QCoreApplication::applicationDirPath() + "/map_generator.py";
+
+            pythonArgs << pythonScriptPath;
+
+            QJsonArray pathForPythonJsonArray;
+            const auto& stationCoordsMap = metroSystem_.getStationCoordinates();
+
+            for (const auto& seg : pathSegments) {
+                auto it = stationCoordsMap.find(seg.stationName);
+                if (it != stationCoordsMap.end()) {
+                    QJsonObject stationObj;
+                    stationObj["name"] = QString::fromStdString(seg.stationName);
+                    stationObj["lat"] = it->second.y(); // Latitude from QPointF's y()
+                    stationObj["lng"] = it->second.x(); // Longitude from QPointF's x()
+                    pathForPythonJsonArray.append(stationObj);
+                } else {
+                    qWarning() << "findPath (for Python): Coordinate not found for station:" << QString::fromStdString(seg.stationName);
                 }
+            }
 
-                if (!pathForPythonJsonArray.isEmpty()) {
-                    QJsonDocument doc(pathForPythonJsonArray);
-                    QString jsonDataString = doc.toJson(QJsonDocument::Compact);
-                    pythonArgs << jsonDataString;
-
-                    QProcess *pythonMapProcess = new QProcess(this);
-
-                    // Connect signals for debugging python script execution (optional)
-                    connect(pythonMapProcess, &QProcess::errorOccurred, this, [=](QProcess::ProcessError error){
-                        qWarning() << "Python script error occurred:" << error << pythonMapProcess->readAllStandardError();
-                        pythonMapProcess->deleteLater();
-                    });
-                    connect(pythonMapProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
-                            [=](int exitCode, QProcess::ExitStatus exitStatus){
-                                qDebug() << "Python script finished. Exit code:" << exitCode << "Exit status:" << exitStatus;
-                                if (exitStatus == QProcess::CrashExit || exitCode != 0) {
-                                    qWarning() << "Python script seems to have failed. STDERR:" << pythonMapProcess->readAllStandardError();
-                                } else {
-                                    qDebug() << "Python script STDOUT:" << pythonMapProcess->readAllStandardOutput();
-                                }
-                                pythonMapProcess->deleteLater();
-                            });
-
-
-                    QString pythonExecutable = "python3"; // Or "python"
+            if (!pathForPythonJsonArray.isEmpty()) {
+                QJsonDocument doc(pathForPythonJsonArray);
+                QString jsonDataString = doc.toJson(QJsonDocument::Compact);
+                pythonArgs << jsonDataString;
+
+                QProcess *pythonMapProcess = new QProcess(this);
+
+                // Connect signals for debugging python script execution (optional)
+                connect(pythonMapProcess, &QProcess::errorOccurred, this, [=](QProcess::ProcessError error){
+                    qWarning() << "Python script error occurred:" << error << pythonMapProcess->readAllStandardError();
+                    pythonMapProcess->deleteLater();
+                });
+                connect(pythonMapProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+                        [=](int exitCode, QProcess::ExitStatus exitStatus){
+                            qDebug() << "Python script finished. Exit code:" << exitCode << "Exit status:" << exitStatus;
+                            if (exitStatus == QProcess::CrashExit || exitCode != 0) {
+                                qWarning() << "Python script seems to have failed. STDERR:" << pythonMapProcess->readAllStandardError();
+                            } else {
+                                qDebug() << "Python script STDOUT:" << pythonMapProcess->readAllStandardOutput();
+                            }
+                            pythonMapProcess->deleteLater();
+                        });
+
+
+                QString pythonExecutable = "python3"; // Or "python"
 #ifdef Q_OS_WIN
-                    pythonExecutable = "python"; // Or full path to python.exe if not in PATH
+                pythonExecutable = "python"; // Or full path to python.exe if not in PATH
 #endif
 
-                    qDebug() << "Launching Python Map:" << pythonExecutable << pythonArgs;
-                    // Using startDetached because we don't need to wait for it,
-                    // and we want its window to be independent.
-                    bool started = pythonMapProcess->startDetached(pythonExecutable, pythonArgs);
-                    if(!started) {
-                        qWarning() << "Failed to start Python map process (startDetached failed):" << pythonMapProcess->errorString();
-                        delete pythonMapProcess; // Clean up if startDetached itself fails
-                    }
-                    // If you don't use startDetached, you must manage the QProcess object more carefully
-                    // or connect its finished signal to deleteLater().
+                qDebug() << "Launching Python Map:" << pythonExecutable << pythonArgs;
+                // Using startDetached because we don't need to wait for it,
+                // and we want its window to be independent.
+                bool started = pythonMapProcess->startDetached(pythonExecutable, pythonArgs);
+                if(!started) {
+                    qWarning() << "Failed to start Python map process (startDetached failed):" << pythonMapProcess->errorString();
+                    delete pythonMapProcess; // Clean up if startDetached itself fails
                 }
+                // If you don't use startDetached, you must manage the QProcess object more carefully
+                // or connect its finished signal to deleteLater().
             }
         }
     }
 
-    outputDisplay_->setHtml(htmlOutputContent);
+    showOutput(htmlOutputContent);
+}
+
+// Plain-text report of the last search and the running totals. Only
+// refreshed while the panel is shown.
+void MainWindow::updateDiagnostics() {
+    if (!diagnosticsCheckBox_->isChecked() || queryRunner_->isLoading()) return;
+    if (!METRO_ENABLE_STATS) {
+        diagnosticsDisplay_->setPlainText("Search statistics were disabled at build time (METRO_ENABLE_STATS=OFF).");
+        return;
+    }
+    const MetroStats stats = metroSystem_.statistics();
+    QString text;
+    if (hasLastSearchStats_) {
+        const SearchCounters& c = lastSearchStats_.counters;
+        text += "Last query";
+        text += lastSearchStats_.cacheHit ? " (route cache hit)\n" : "\n";
+        text += QString("  settled %1, relaxed %2, pushes %3, stale pops %4\n")
+                    .arg(c.settled).arg(c.relaxed).arg(c.pushes).arg(c.stalePops);
+        if (c.hierarchyFallbacks) text += "  answered by Dijkstra: live updates make the hierarchies stale for this route\n";
+        text += QString("  total %1 ms, path reconstruction %2 ms\n\n")
+                    .arg(lastSearchStats_.totalMs, 0, 'f', 3).arg(lastSearchStats_.reconstructMs, 0, 'f', 3);
+    }
+
+    const char* const criterionNames[] = {"Least stops", "Time", "Cost", "Distance"};
+    text += "Latency per criterion (us; percentiles are bucket upper bounds)\n";
+    for (size_t i = 0; i < stats.latency.size(); ++i) {
+        const LatencyHistogram::Snapshot& latency = stats.latency[i];
+        if (latency.count == 0) continue;
+        text += QString("  %1: n=%2 mean %3 p50 <%4 p90 <%5 p99 <%6\n")
+                    .arg(criterionNames[i]).arg(latency.count).arg(latency.meanMicros(), 0, 'f', 1)
+                    .arg(latency.percentileMicros(0.5)).arg(latency.percentileMicros(0.9)).arg(latency.percentileMicros(0.99));
+    }
+    text += QString("Searches %1 (settled %2, relaxed %3); route cache %4 hits / %5 misses\n\n")
+                .arg(stats.searches).arg(stats.searchTotals.settled).arg(stats.searchTotals.relaxed)
+                .arg(stats.cache.hits).arg(stats.cache.misses);
+
+    const LoadTimings& load = stats.load;
+    if (load.fromSnapshot) {
+        text += QString("Load from snapshot: %1 ms (read %2, index %3)\n")
+                    .arg(load.totalMs, 0, 'f', 1).arg(load.readMs, 0, 'f', 1).arg(load.indexMs, 0, 'f', 1);
+    } else {
+        text += QString("Load from CSV: %1 ms (read %2, parse %3, build %4, index %5)\n")
+                    .arg(load.totalMs, 0, 'f', 1).arg(load.readMs, 0, 'f', 1).arg(load.parseMs, 0, 'f', 1)
+                    .arg(load.buildMs, 0, 'f', 1).arg(load.indexMs, 0, 'f', 1);
+    }
+    diagnosticsDisplay_->setPlainText(text);
+}
+
+void MainWindow::showOutput(const QString& html) {
+    outputDisplay_->setHtml(html);
     // Textual output fade-in animation
     QPropertyAnimation *fadeInAnimation = new QPropertyAnimation(outputOpacityEffect_, "opacity", this);
     fadeInAnimation->setDuration(400);
@@ -3,6 +3,7 @@
 
 #include <QMainWindow>
 #include "metrosystem.h" // Assuming MetroSystem is correctly set up for metroFinalData.csv
+#include "routequeryrunner.h"
 
 QT_BEGIN_NAMESPACE
 class QComboBox;
@@ -12,9 +13,16 @@ class QTextEdit;
 class QVBoxLayout;
 class QPropertyAnimation;
 class QGraphicsOpacityEffect;
+class QProgressBar;
+class QCheckBox;
+class QTimeEdit;
+class QSpinBox;
 class QProcess; // For launching Python script
 QT_END_NAMESPACE
 
+class MetroMapView;
+class StationSearchModel;
+
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
@@ -24,6 +32,9 @@ public:
 
 private slots:
     void findPath();
+    void findReach();
+    void onLoadFinished(bool ok, const QString& errorMessage);
+    void showRoute(const RouteQueryResult& result);
     // Optional slots for QProcess feedback
     // void onPythonProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
     // void onPythonProcessError(QProcess::ProcessError error);
@@ -31,21 +42,45 @@ private slots:
 private:
     void setupUi();
     void populateComboBoxes();
+    QComboBox* createStationComboBox();
+    bool checkStation(const QString& name, const QString& role);
     void loadData();
+    void setControlsEnabled(bool enabled);
+    void showOutput(const QString& html);
+    void showReach(const RouteQueryResult& result);
+    void updateDiagnostics();
+    void updateCriterionControls();
 
     MetroSystem metroSystem_;
+    RouteQueryRunner *queryRunner_;
 
     // UI Elements
     QComboBox *sourceComboBox_;
     QComboBox *destinationComboBox_;
     QComboBox *criteriaComboBox_;
+    std::vector<StationSearchModel*> stationModels_; // Lists and completions of the station boxes
+    QTimeEdit *departureTimeEdit_; // Used by the timetable criterion only
+    QCheckBox *transferCheckBox_;  // Time and cost routes: penalise changes of line
+    QSpinBox *transferMinutesSpinBox_;
+    QSpinBox *transferCostSpinBox_;
+    QSpinBox *alternativesSpinBox_; // Stops, time, cost and distance: how many ranked routes to list
     QPushButton *findPathButton_;
+    QPushButton *reachButton_; // Isochrone bands from the source station
     QTextEdit *outputDisplay_;
     QGraphicsOpacityEffect *outputOpacityEffect_;
+    QProgressBar *loadProgressBar_;
+    QCheckBox *pythonMapCheckBox_;
+    QCheckBox *diagnosticsCheckBox_;
+    QTextEdit *diagnosticsDisplay_; // Search counters and latencies, hidden unless asked for
+    SearchStats lastSearchStats_;
+    bool hasLastSearchStats_ = false;
+    MetroMapView *mapView_;
 
     QLabel *sourceLabel_;
     QLabel *destinationLabel_;
     QLabel *criteriaLabel_;
+    QLabel *departureLabel_;
+    QLabel *alternativesLabel_;
     QLabel *outputLabel_;
 
     QWidget* controlsWidget_; // To group controls (if using splitter, not strictly needed for simpler layout)
@@ -0,0 +1,597 @@
+// Routing benchmark.
+//
+// Generates a synthetic metro network in the same 10-column CSV schema as
+// metroFinalData.csv (or takes an existing CSV), then times loading, the
+// snapshot round trip, single route queries per engine and criterion, route
+// matrices, budgeted one-to-all searches, betweenness centrality,
+// transfer-aware, Pareto and alternative-route (k shortest) queries, and
+// timetable (Connection Scan) queries over a generated headway
+// timetable. Every measurement is printed as one JSON object per line on
+// stdout so results can be collected and compared between commits; logging
+// goes to stderr.
+//
+//   ./metrobench --stations 200000 --lines 60 --interchange 0.15 --label "$(git rev-parse --short HEAD)"
+//   ./metrobench --csv metroFinalData.csv --engines dijkstra,ch,astar,bidirectional
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "metrosystem.h"
+#include "networkgenerator.h"
+#include "parallel.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// Resident set size in bytes, or -1 where /proc is not available
+long long residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    long long pages = 0;
+    long long resident = 0;
+    if (!(statm >> pages >> resident)) return -1;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+struct Percentiles {
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+Percentiles summarize(std::vector<double> samples) {
+    Percentiles result;
+    if (samples.empty()) return result;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples) sum += s;
+    auto at = [&](double q) { return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))]; };
+    result.mean = sum / samples.size();
+    result.p50 = at(0.50);
+    result.p90 = at(0.90);
+    result.p99 = at(0.99);
+    result.max = samples.back();
+    return result;
+}
+
+const char* criterionName(RouteCriterion criterion) {
+    switch (criterion) {
+    case RouteCriterion::LeastStops: return "stops";
+    case RouteCriterion::Time: return "time";
+    case RouteCriterion::Cost: return "cost";
+    case RouteCriterion::Distance: return "distance";
+    }
+    return "";
+}
+
+bool parseEngine(const QString& name, SearchEngine& engine) {
+    if (name == "dijkstra") engine = SearchEngine::Dijkstra;
+    else if (name == "ch") engine = SearchEngine::ContractionHierarchy;
+    else if (name == "astar") engine = SearchEngine::AStar;
+    else if (name == "bidirectional") engine = SearchEngine::Bidirectional;
+    else return false;
+    return true;
+}
+
+// Every result line carries the run's label and network size
+class Reporter {
+public:
+    Reporter(QString label, size_t stations, size_t edges) : label_(std::move(label)), stations_(stations), edges_(edges) {}
+
+    void emit(const QString& bench, QJsonObject fields) const {
+        fields["bench"] = bench;
+        if (!label_.isEmpty()) fields["label"] = label_;
+        fields["stations"] = static_cast<qint64>(stations_);
+        fields["edges"] = static_cast<qint64>(edges_);
+        const QByteArray line = QJsonDocument(fields).toJson(QJsonDocument::Compact);
+        std::fwrite(line.constData(), 1, line.size(), stdout);
+        std::fputc('\n', stdout);
+        std::fflush(stdout);
+    }
+
+    void setNetwork(size_t stations, size_t edges) {
+        stations_ = stations;
+        edges_ = edges;
+    }
+
+private:
+    QString label_;
+    size_t stations_;
+    size_t edges_;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("metrobench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks loading and routing on synthetic or given metro networks; prints JSON lines.");
+    parser.addHelpOption();
+    QCommandLineOption csvOption("csv", "Benchmark this CSV instead of generating one.", "file");
+    QCommandLineOption outOption("out", "Where to write the generated CSV (default: a temporary file).", "file");
+    QCommandLineOption stationsOption("stations", "Stations to generate.", "n", "10000");
+    QCommandLineOption linesOption("lines", "Lines to generate.", "n", "20");
+    QCommandLineOption interchangeOption("interchange", "Chance that a line step reuses a nearby station (0-1).", "p", "0.1");
+    QCommandLineOption weightsOption("weights", "distance (time/cost follow length) or uniform.", "mode", "distance");
+    QCommandLineOption timeRangeOption("time-range", "Segment time range in minutes.", "min:max", "1:6");
+    QCommandLineOption costRangeOption("cost-range", "Segment cost range.", "min:max", "10:60");
+    QCommandLineOption seedOption("seed", "Random seed for the network and the query pairs.", "n", "42");
+    QCommandLineOption queriesOption("queries", "Random single queries per engine and criterion.", "n", "1000");
+    QCommandLineOption matrixOption("matrix", "Origins and destinations per route matrix (0 to skip).", "n", "100");
+    QCommandLineOption threadsOption("threads", "Worker threads for route matrices, reachability and betweenness (0 = one per core).", "n", "0");
+    QCommandLineOption loadThreadsOption("load-threads", "Comma-separated thread counts to load the CSV with (0 = one per core).", "list", "0");
+    QCommandLineOption enginesOption("engines", "Comma-separated: dijkstra, ch, astar, bidirectional.", "list", "dijkstra");
+    QCommandLineOption reachBudgetOption("reach-budget", "Budget (stops, minutes, cost) of the reachability runs (0 to skip).", "n", "30");
+    QCommandLineOption centralityOption("centrality-sources", "Sampled sources of the betweenness runs (0 to skip).", "n", "256");
+    QCommandLineOption headwayOption("headway", "Headway of the generated timetable in minutes (0 to skip).", "min", "5");
+    QCommandLineOption labelOption("label", "Tag copied into every result line, e.g. a commit hash.", "text");
+    for (const QCommandLineOption* option : {&csvOption, &outOption, &stationsOption, &linesOption, &interchangeOption,
+                                             &weightsOption, &timeRangeOption, &costRangeOption, &seedOption, &queriesOption,
+                                             &matrixOption, &threadsOption, &loadThreadsOption, &enginesOption, &reachBudgetOption, &centralityOption, &headwayOption,
+                                             &labelOption}) {
+        parser.addOption(*option);
+    }
+    parser.process(app);
+
+    std::vector<SearchEngine> engines;
+    std::vector<QString> engineNames;
+    for (const QString& name : parser.value(enginesOption).split(',', Qt::SkipEmptyParts)) {
+        SearchEngine engine;
+        if (!parseEngine(name.trimmed(), engine)) {
+            qCritical() << "Unknown engine:" << name;
+            return 1;
+        }
+        engines.push_back(engine);
+        engineNames.push_back(name.trimmed());
+    }
+
+    Reporter reporter(parser.value(labelOption), 0, 0);
+    std::string csvPath = parser.value(csvOption).toStdString();
+    bool temporaryCsv = false;
+    if (csvPath.empty()) {
+        NetworkSpec spec;
+        spec.stations = parser.value(stationsOption).toULongLong();
+        spec.lines = parser.value(linesOption).toULongLong();
+        spec.interchangeRate = parser.value(interchangeOption).toDouble();
+        spec.weights = parser.value(weightsOption).toStdString();
+        spec.seed = parser.value(seedOption).toUInt();
+        const QStringList timeRange = parser.value(timeRangeOption).split(':');
+        const QStringList costRange = parser.value(costRangeOption).split(':');
+        if (timeRange.size() != 2 || costRange.size() != 2) {
+            qCritical() << "Ranges are given as min:max";
+            return 1;
+        }
+        spec.minTime = timeRange[0].toInt();
+        spec.maxTime = timeRange[1].toInt();
+        spec.minCost = costRange[0].toInt();
+        spec.maxCost = costRange[1].toInt();
+
+        csvPath = parser.value(outOption).toStdString();
+        if (csvPath.empty()) {
+            csvPath = QDir::temp().filePath(QString("metrobench-%1.csv").arg(QCoreApplication::applicationPid())).toStdString();
+            temporaryCsv = true;
+        }
+        GeneratedNetwork generated;
+        auto start = Clock::now();
+        if (!generateNetwork(spec, csvPath, generated)) {
+            qCritical() << "Could not write" << QString::fromStdString(csvPath);
+            return 1;
+        }
+        reporter.setNetwork(generated.stations, generated.edges);
+        QJsonObject fields;
+        fields["ms"] = elapsedMs(start);
+        fields["lines"] = static_cast<qint64>(spec.lines);
+        fields["interchange"] = spec.interchangeRate;
+        fields["weights"] = QString::fromStdString(spec.weights);
+        fields["seed"] = static_cast<qint64>(spec.seed);
+        reporter.emit("generate", fields);
+    }
+
+    // ---- Loading ----
+    // The first thread count loads the network the rest of the run uses;
+    // any further ones load a scratch copy to show how loading scales
+    std::vector<unsigned> loadThreads;
+    for (const QString& count : parser.value(loadThreadsOption).split(',', Qt::SkipEmptyParts)) {
+        loadThreads.push_back(count.trimmed().toUInt());
+    }
+    if (loadThreads.empty()) loadThreads.push_back(0);
+    MetroSystem system;
+    system.setLoadThreads(loadThreads.front());
+    std::string errorMsg;
+    const long long rssBefore = residentBytes();
+    auto start = Clock::now();
+    if (!system.loadMetroData(csvPath, errorMsg)) {
+        qCritical() << "Load failed:" << QString::fromStdString(errorMsg);
+        return 1;
+    }
+    const double loadMs = elapsedMs(start);
+    auto addLoadPhases = [](QJsonObject& fields, const LoadTimings& timings, unsigned threads) {
+        fields["threads"] = static_cast<qint64>(threads == 0 ? defaultThreadCount() : threads);
+        fields["parse_ms"] = timings.parseMs;
+        fields["build_ms"] = timings.buildMs;
+        fields["index_ms"] = timings.indexMs;
+    };
+    const std::vector<std::string> stations = system.getStationNames();
+    if (stations.empty()) {
+        qCritical() << "The network has no stations";
+        return 1;
+    }
+    reporter.setNetwork(stations.size(), system.getMapSegments().size());
+    {
+        QJsonObject fields;
+        fields["ms"] = loadMs;
+        addLoadPhases(fields, system.statistics().load, loadThreads.front());
+        fields["footprint_bytes"] = static_cast<qint64>(system.memoryFootprint());
+        if (rssBefore >= 0) fields["rss_delta_bytes"] = residentBytes() - rssBefore;
+        reporter.emit("load_csv", fields);
+    }
+    for (size_t i = 1; i < loadThreads.size(); ++i) {
+        MetroSystem scratch;
+        scratch.setLoadThreads(loadThreads[i]);
+        start = Clock::now();
+        if (!scratch.loadMetroData(csvPath, errorMsg)) {
+            qCritical() << "Load failed:" << QString::fromStdString(errorMsg);
+            return 1;
+        }
+        QJsonObject fields;
+        fields["ms"] = elapsedMs(start);
+        addLoadPhases(fields, scratch.statistics().load, loadThreads[i]);
+        reporter.emit("load_csv", fields);
+    }
+
+    const std::string snapshotPath = csvPath + ".bench.mfsnap";
+    start = Clock::now();
+    if (system.saveSnapshot(snapshotPath, errorMsg)) {
+        QJsonObject saveFields;
+        saveFields["ms"] = elapsedMs(start);
+        reporter.emit("snapshot_save", saveFields);
+        MetroSystem reloaded;
+        start = Clock::now();
+        if (reloaded.loadSnapshot(snapshotPath, errorMsg)) {
+            QJsonObject loadFields;
+            loadFields["ms"] = elapsedMs(start);
+            reporter.emit("snapshot_load", loadFields);
+        }
+        std::remove(snapshotPath.c_str());
+    }
+
+    // ---- Single queries ----
+    // Same random pairs for every engine and criterion; the cache is off so
+    // every query is a real search.
+    system.setRouteCacheCapacity(0);
+    const size_t queryCount = parser.value(queriesOption).toULongLong();
+    std::mt19937 rng(parser.value(seedOption).toUInt() + 1);
+    std::uniform_int_distribution<size_t> pick(0, stations.size() - 1);
+    std::vector<std::pair<size_t, size_t>> pairs(queryCount);
+    for (auto& pair : pairs) pair = {pick(rng), pick(rng)};
+
+    const RouteCriterion criteria[] = {RouteCriterion::LeastStops, RouteCriterion::Time, RouteCriterion::Cost, RouteCriterion::Distance};
+    for (size_t e = 0; e < engines.size(); ++e) {
+        system.setSearchEngine(engines[e]);
+        if (engines[e] == SearchEngine::ContractionHierarchy) {
+            start = Clock::now();
+            system.buildContractionHierarchies();
+            QJsonObject fields;
+            fields["ms"] = elapsedMs(start);
+            fields["footprint_bytes"] = static_cast<qint64>(system.memoryFootprint());
+            reporter.emit("ch_build", fields);
+        }
+        for (RouteCriterion criterion : criteria) {
+            std::vector<double> samples;
+            samples.reserve(pairs.size());
+            size_t found = 0;
+            uint64_t settled = 0;
+            auto total = Clock::now();
+            for (const auto& pair : pairs) {
+                auto queryStart = Clock::now();
+                SearchStats stats;
+                const std::vector<PathSegment> path = system.findPath(stations[pair.first], stations[pair.second], criterion,
+                                                                      nullptr, &stats);
+                settled += stats.counters.settled;
+                samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+                if (!path.empty()) found++;
+            }
+            const double totalMs = elapsedMs(total);
+            const Percentiles p = summarize(samples);
+            QJsonObject fields;
+            fields["engine"] = engineNames[e];
+            fields["criterion"] = criterionName(criterion);
+            fields["queries"] = static_cast<qint64>(pairs.size());
+            fields["found"] = static_cast<qint64>(found);
+            fields["qps"] = totalMs > 0 ? pairs.size() * 1000.0 / totalMs : 0.0;
+            fields["mean_us"] = p.mean;
+            fields["p50_us"] = p.p50;
+            fields["p90_us"] = p.p90;
+            fields["p99_us"] = p.p99;
+            fields["max_us"] = p.max;
+            if (METRO_ENABLE_STATS && !pairs.empty()) fields["settled_mean"] = static_cast<double>(settled) / pairs.size();
+            reporter.emit("query", fields);
+        }
+    }
+
+    // ---- Transfer-aware queries ----
+    // Same pairs on the (station, line) state graph with the default
+    // penalties, next to the line changes of the plain routes
+    system.setSearchEngine(SearchEngine::Dijkstra);
+    for (RouteCriterion criterion : {RouteCriterion::Time, RouteCriterion::Cost}) {
+        std::vector<double> samples;
+        samples.reserve(pairs.size());
+        size_t found = 0;
+        uint64_t transfers = 0;
+        uint64_t plainTransfers = 0;
+        auto total = Clock::now();
+        for (const auto& pair : pairs) {
+            auto queryStart = Clock::now();
+            const std::vector<PathSegment> path = system.findPathWithTransfers(stations[pair.first], stations[pair.second],
+                                                                               criterion, TransferPenalties());
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+            if (!path.empty()) {
+                found++;
+                transfers += path.back().transfers;
+            }
+        }
+        const double totalMs = elapsedMs(total);
+        for (const auto& pair : pairs) {
+            const std::vector<PathSegment> path = system.findPath(stations[pair.first], stations[pair.second], criterion);
+            if (!path.empty()) plainTransfers += path.back().transfers;
+        }
+        const Percentiles p = summarize(samples);
+        QJsonObject fields;
+        fields["criterion"] = criterionName(criterion);
+        fields["queries"] = static_cast<qint64>(pairs.size());
+        fields["found"] = static_cast<qint64>(found);
+        fields["qps"] = totalMs > 0 ? pairs.size() * 1000.0 / totalMs : 0.0;
+        fields["mean_us"] = p.mean;
+        fields["p50_us"] = p.p50;
+        fields["p99_us"] = p.p99;
+        fields["transfers_mean"] = found > 0 ? static_cast<double>(transfers) / found : 0.0;
+        fields["plain_transfers_mean"] = found > 0 ? static_cast<double>(plainTransfers) / found : 0.0;
+        reporter.emit("transfer_query", fields);
+    }
+
+    // ---- Pareto queries ----
+    // One multi-criteria search per pair, against the time and cost
+    // searches it replaces
+    if (!pairs.empty()) {
+        std::vector<double> samples;
+        samples.reserve(pairs.size());
+        size_t found = 0;
+        size_t routes = 0;
+        size_t mostRoutes = 0;
+        auto total = Clock::now();
+        for (const auto& pair : pairs) {
+            auto queryStart = Clock::now();
+            const size_t count = system.findParetoRoutes(stations[pair.first], stations[pair.second]).size();
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+            if (count > 0) found++;
+            routes += count;
+            mostRoutes = std::max(mostRoutes, count);
+        }
+        const double totalMs = elapsedMs(total);
+        auto single = Clock::now();
+        for (const auto& pair : pairs) {
+            system.findPath(stations[pair.first], stations[pair.second], RouteCriterion::Time);
+            system.findPath(stations[pair.first], stations[pair.second], RouteCriterion::Cost);
+        }
+        const double singleMs = elapsedMs(single);
+        const Percentiles p = summarize(samples);
+        QJsonObject fields;
+        fields["queries"] = static_cast<qint64>(pairs.size());
+        fields["found"] = static_cast<qint64>(found);
+        fields["qps"] = totalMs > 0 ? pairs.size() * 1000.0 / totalMs : 0.0;
+        fields["mean_us"] = p.mean;
+        fields["p50_us"] = p.p50;
+        fields["p99_us"] = p.p99;
+        fields["routes_mean"] = found > 0 ? static_cast<double>(routes) / found : 0.0;
+        fields["routes_max"] = static_cast<qint64>(mostRoutes);
+        fields["time_and_cost_us"] = singleMs * 1000.0 / pairs.size();
+        reporter.emit("pareto_query", fields);
+    }
+
+    // ---- Alternative routes ----
+    // The five best routes per pair, against one plain search of the same
+    // criterion
+    for (RouteCriterion criterion : {RouteCriterion::Time, RouteCriterion::Cost}) {
+        if (pairs.empty()) break;
+        const size_t k = 5;
+        std::vector<double> samples;
+        samples.reserve(pairs.size());
+        size_t found = 0;
+        size_t routes = 0;
+        auto total = Clock::now();
+        for (const auto& pair : pairs) {
+            auto queryStart = Clock::now();
+            const size_t count = system.findAlternativeRoutes(stations[pair.first], stations[pair.second], criterion, k).size();
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+            if (count > 0) found++;
+            routes += count;
+        }
+        const double totalMs = elapsedMs(total);
+        auto single = Clock::now();
+        for (const auto& pair : pairs) system.findPath(stations[pair.first], stations[pair.second], criterion);
+        const double singleMs = elapsedMs(single);
+        const Percentiles p = summarize(samples);
+        QJsonObject fields;
+        fields["criterion"] = criterionName(criterion);
+        fields["k"] = static_cast<qint64>(k);
+        fields["queries"] = static_cast<qint64>(pairs.size());
+        fields["found"] = static_cast<qint64>(found);
+        fields["qps"] = totalMs > 0 ? pairs.size() * 1000.0 / totalMs : 0.0;
+        fields["mean_us"] = p.mean;
+        fields["p50_us"] = p.p50;
+        fields["p99_us"] = p.p99;
+        fields["routes_mean"] = found > 0 ? static_cast<double>(routes) / found : 0.0;
+        fields["single_us"] = singleMs * 1000.0 / pairs.size();
+        reporter.emit("alternatives_query", fields);
+    }
+
+    // ---- Route matrices ----
+    const size_t matrixSize = std::min<size_t>(parser.value(matrixOption).toULongLong(), stations.size());
+    if (matrixSize > 0) {
+        std::vector<std::string> endpoints;
+        for (size_t i = 0; i < matrixSize; ++i) endpoints.push_back(stations[pick(rng)]);
+        const unsigned threads = parser.value(threadsOption).toUInt();
+        for (RouteCriterion criterion : criteria) {
+            start = Clock::now();
+            const RouteMatrix matrix = system.computeRouteMatrix(endpoints, endpoints, criterion, false, threads);
+            QJsonObject fields;
+            fields["criterion"] = criterionName(criterion);
+            fields["origins"] = static_cast<qint64>(matrix.origins.size());
+            fields["destinations"] = static_cast<qint64>(matrix.destinations.size());
+            fields["threads"] = static_cast<qint64>(threads);
+            fields["ms"] = elapsedMs(start);
+            reporter.emit("matrix", fields);
+        }
+    }
+
+    // ---- Station search ----
+    // What a user types into a station box: every prefix of a name, and the
+    // name with one character dropped (a misspelling), top 10 each
+    if (!pairs.empty()) {
+        std::vector<std::string> typed;
+        for (const auto& pair : pairs) {
+            const std::string& name = stations[pair.first];
+            for (size_t length = 1; length <= name.size(); ++length) typed.push_back(name.substr(0, length));
+            if (name.size() > 3) typed.push_back(name.substr(0, name.size() / 2) + name.substr(name.size() / 2 + 1));
+        }
+        std::vector<double> samples;
+        samples.reserve(typed.size());
+        size_t matched = 0;
+        for (const std::string& query : typed) {
+            auto queryStart = Clock::now();
+            matched += system.findStations(query, 10).size();
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+        }
+        const Percentiles p = summarize(samples);
+        QJsonObject fields;
+        fields["queries"] = static_cast<qint64>(typed.size());
+        fields["matches_mean"] = static_cast<double>(matched) / typed.size();
+        fields["mean_us"] = p.mean;
+        fields["p50_us"] = p.p50;
+        fields["p99_us"] = p.p99;
+        fields["max_us"] = p.max;
+        reporter.emit("station_search", fields);
+    }
+
+    // ---- Reachability ----
+    // Catchment of the single-query origins within each criterion's budget
+    const long long reachBudget = parser.value(reachBudgetOption).toLongLong();
+    if (reachBudget > 0 && !pairs.empty()) {
+        std::vector<std::string> sources;
+        sources.reserve(pairs.size());
+        for (const auto& pair : pairs) sources.push_back(stations[pair.first]);
+        const unsigned threads = parser.value(threadsOption).toUInt();
+        for (RouteCriterion criterion : {RouteCriterion::LeastStops, RouteCriterion::Time, RouteCriterion::Cost}) {
+            start = Clock::now();
+            const auto reach = system.reachableWithin(sources, criterion, reachBudget, threads);
+            const double ms = elapsedMs(start);
+            size_t reached = 0;
+            for (const auto& list : reach) reached += list.size();
+            QJsonObject fields;
+            fields["criterion"] = criterionName(criterion);
+            fields["sources"] = static_cast<qint64>(sources.size());
+            fields["budget"] = reachBudget;
+            fields["threads"] = static_cast<qint64>(threads);
+            fields["reached_mean"] = static_cast<double>(reached) / sources.size();
+            fields["ms"] = ms;
+            reporter.emit("reach", fields);
+        }
+    }
+
+    // ---- Betweenness ----
+    // From a sample of sources; a network with no more stations than that
+    // gets the exact answer from every station
+    const size_t centralitySources = parser.value(centralityOption).toULongLong();
+    if (centralitySources > 0) {
+        const unsigned threads = parser.value(threadsOption).toUInt();
+        for (RouteCriterion criterion : {RouteCriterion::LeastStops, RouteCriterion::Time, RouteCriterion::Cost}) {
+            start = Clock::now();
+            const NetworkCentrality centrality = system.computeCentrality(criterion, centralitySources, threads);
+            const double ms = elapsedMs(start);
+            QJsonObject fields;
+            fields["criterion"] = criterionName(criterion);
+            fields["sources"] = static_cast<qint64>(centrality.sources);
+            fields["sampled"] = centrality.sampled;
+            fields["threads"] = static_cast<qint64>(threads);
+            fields["ms"] = ms;
+            fields["sources_per_s"] = ms > 0 ? centrality.sources * 1000.0 / ms : 0.0;
+            reporter.emit("centrality", fields);
+        }
+    }
+
+    // ---- Timetable ----
+    // Every line served along its whole length from 05:00 to 24:00; the
+    // queries reuse the single-query pairs with random departure times.
+    const int headway = parser.value(headwayOption).toInt();
+    if (headway > 0) {
+        std::set<std::string> lineNames;
+        for (const MapSegment& segment : system.getMapSegments()) lineNames.insert(segment.line);
+        const std::string timetablePath = csvPath + ".bench.timetable.csv";
+        {
+            std::ofstream timetable(timetablePath);
+            timetable << "Line,From Station,To Station,First Departure,Last Departure,Headway (min)\n";
+            for (const std::string& line : lineNames) timetable << line << ",,,5:00,24:00," << headway << "\n";
+        }
+        start = Clock::now();
+        const bool loaded = system.loadTimetable(timetablePath, errorMsg);
+        const double buildMs = elapsedMs(start);
+        std::remove(timetablePath.c_str());
+        if (!loaded) {
+            qCritical() << "Timetable failed:" << QString::fromStdString(errorMsg);
+            return 1;
+        }
+        QJsonObject buildFields;
+        buildFields["ms"] = buildMs;
+        buildFields["headway"] = headway;
+        buildFields["footprint_bytes"] = static_cast<qint64>(system.memoryFootprint());
+        reporter.emit("timetable_build", buildFields);
+
+        std::uniform_int_distribution<int> departure(6 * 60, 22 * 60);
+        std::vector<double> samples;
+        samples.reserve(pairs.size());
+        size_t found = 0;
+        auto total = Clock::now();
+        for (const auto& pair : pairs) {
+            const int leaveAt = departure(rng);
+            auto queryStart = Clock::now();
+            if (!system.findEarliestArrival(stations[pair.first], stations[pair.second], leaveAt).empty()) found++;
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+        }
+        const double totalMs = elapsedMs(total);
+        const Percentiles p = summarize(samples);
+        QJsonObject fields;
+        fields["queries"] = static_cast<qint64>(pairs.size());
+        fields["found"] = static_cast<qint64>(found);
+        fields["qps"] = totalMs > 0 ? pairs.size() * 1000.0 / totalMs : 0.0;
+        fields["mean_us"] = p.mean;
+        fields["p50_us"] = p.p50;
+        fields["p90_us"] = p.p90;
+        fields["p99_us"] = p.p99;
+        fields["max_us"] = p.max;
+        reporter.emit("timetable_query", fields);
+    }
+
+    if (temporaryCsv) std::remove(csvPath.c_str());
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "metrocsv.h"
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <system_error>
+#include <unordered_map>
+
+namespace {
+
+constexpr std::string_view kWhitespace = " \t\n\r\f\v";
+
+// Mirrors the accepted prefix of std::stoi / std::stod: an optional sign
+// followed by a number, anything after the number is ignored.
+template <typename T>
+CsvIssue parseNumber(std::string_view field, T& value) {
+    const char* first = field.data();
+    const char* last = field.data() + field.size();
+    if (first != last && *first == '+' && (last - first) > 1 && first[1] != '-' && first[1] != '+') {
+        ++first; // from_chars does not accept an explicit '+'
+    }
+    std::from_chars_result result = std::from_chars(first, last, value);
+    if (result.ec == std::errc::result_out_of_range) return CsvIssue::OutOfRange;
+    if (result.ec != std::errc() || result.ptr == first) return CsvIssue::InvalidNumber;
+    return CsvIssue::None;
+}
+
+} // namespace
+
+const char* csvIssueDescription(CsvIssue issue) {
+    switch (issue) {
+    case CsvIssue::None: return "ok";
+    case CsvIssue::MissingFields: return "fewer than 10 columns";
+    case CsvIssue::EmptyField: return "empty field";
+    case CsvIssue::InvalidNumber: return "invalid numeric value";
+    case CsvIssue::OutOfRange: return "numeric value out of range";
+    }
+    return "unknown";
+}
+
+std::string_view trimView(std::string_view str) {
+    size_t first = str.find_first_not_of(kWhitespace);
+    if (first == std::string_view::npos) return {};
+    size_t last = str.find_last_not_of(kWhitespace);
+    return str.substr(first, last - first + 1);
+}
+
+CsvIssue parseMetroCsvRow(std::string_view line, MetroCsvRow& row) {
+    std::string_view fields[10];
+    size_t pos = 0;
+    for (int i = 0; i < 9; ++i) {
+        size_t comma = line.find(',', pos);
+        if (comma == std::string_view::npos) return CsvIssue::MissingFields;
+        fields[i] = trimView(line.substr(pos, comma - pos));
+        pos = comma + 1;
+    }
+    if (pos >= line.size()) return CsvIssue::MissingFields;
+    fields[9] = trimView(line.substr(pos));
+
+    for (const std::string_view& field : fields) {
+        if (field.empty()) return CsvIssue::EmptyField;
+    }
+
+    row.fromStation = fields[0];
+    row.toStation = fields[1];
+    row.line = fields[5];
+
+    CsvIssue issue;
+    if ((issue = parseNumber(fields[2], row.time)) != CsvIssue::None) return issue;
+    if ((issue = parseNumber(fields[3], row.distance)) != CsvIssue::None) return issue;
+    if ((issue = parseNumber(fields[4], row.cost)) != CsvIssue::None) return issue;
+    if ((issue = parseNumber(fields[6], row.latFrom)) != CsvIssue::None) return issue;
+    if ((issue = parseNumber(fields[7], row.lonFrom)) != CsvIssue::None) return issue;
+    if ((issue = parseNumber(fields[8], row.latTo)) != CsvIssue::None) return issue;
+    if ((issue = parseNumber(fields[9], row.lonTo)) != CsvIssue::None) return issue;
+    return CsvIssue::None;
+}
+
+std::vector<std::string_view> splitCsvChunks(std::string_view text, size_t chunkCount) {
+    std::vector<std::string_view> chunks;
+    if (chunkCount == 0) chunkCount = 1;
+    size_t begin = 0;
+    for (size_t i = 1; i <= chunkCount && begin < text.size(); ++i) {
+        // Each chunk ends just after the first newline past its share
+        size_t end = i == chunkCount ? text.size() : std::max(begin, text.size() * i / chunkCount);
+        if (end < text.size()) {
+            end = text.find('\n', end);
+            end = end == std::string_view::npos ? text.size() : end + 1;
+        }
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return chunks;
+}
+
+void parseMetroCsvChunk(std::string_view text, MetroCsvChunk& chunk) {
+    chunk = MetroCsvChunk();
+    std::unordered_map<std::string_view, StationId> stationLookup;
+    std::unordered_map<std::string_view, LineId> lineLookup;
+    const std::hash<std::string_view> hasher;
+    auto internStation = [&](std::string_view name, double lat, double lon) {
+        const size_t hash = hasher(name);
+        auto inserted = stationLookup.emplace(name, static_cast<StationId>(chunk.stations.size()));
+        if (inserted.second) chunk.stations.push_back(CsvStation{name, hash, lat, lon});
+        return inserted.first->second;
+    };
+    auto internLine = [&](std::string_view name) {
+        auto inserted = lineLookup.emplace(name, static_cast<LineId>(chunk.lines.size()));
+        if (inserted.second) chunk.lines.push_back(name);
+        return inserted.first->second;
+    };
+
+    MetroCsvRow row;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t newline = text.find('\n', pos);
+        if (newline == std::string_view::npos) newline = text.size();
+        const std::string_view line = text.substr(pos, newline - pos);
+        pos = newline + 1;
+        chunk.lineCount++;
+        if (trimView(line).empty()) continue;
+        const CsvIssue issue = parseMetroCsvRow(line, row);
+        if (issue != CsvIssue::None) {
+            chunk.issues.push_back(LoadIssue{chunk.lineCount, issue});
+            continue;
+        }
+        const StationId from = internStation(row.fromStation, row.latFrom, row.lonFrom);
+        const StationId to = internStation(row.toStation, row.latTo, row.lonTo);
+        chunk.edges.push_back(Edge{from, to, row.time, row.distance, row.cost, internLine(row.line)});
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef METROCSV_H
+#define METROCSV_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "metrograph.h"
+
+// One validated row of the 10-column network CSV. The string fields are
+// views into the loader's buffer and are only valid while it is alive.
+struct MetroCsvRow {
+    std::string_view fromStation;
+    std::string_view toStation;
+    std::string_view line;
+    int time = 0;
+    double distance = 0.0;
+    int cost = 0;
+    double latFrom = 0.0;
+    double lonFrom = 0.0;
+    double latTo = 0.0;
+    double lonTo = 0.0;
+};
+
+// Why a data row was skipped
+enum class CsvIssue : uint8_t {
+    None,
+    MissingFields,  // fewer than 10 columns
+    EmptyField,     // a column is empty after trimming
+    InvalidNumber,  // a numeric column does not start with a number
+    OutOfRange      // a numeric column does not fit its type
+};
+
+struct LoadIssue {
+    int lineNumber; // 1-based, the header is line 1
+    CsvIssue issue;
+};
+
+const char* csvIssueDescription(CsvIssue issue);
+
+std::string_view trimView(std::string_view str);
+
+// Splits one CSV line in place and converts its numeric columns. Fields are
+// separated by the first nine commas; the tenth column runs to the end of
+// the line. Numbers are read from the start of a field the way std::stoi /
+// std::stod do, so trailing characters after a valid number are ignored.
+CsvIssue parseMetroCsvRow(std::string_view line, MetroCsvRow& row);
+
+// Parallel loading: the data lines are split into chunks of whole lines,
+// each chunk is parsed on its own into a MetroCsvChunk, and the loader
+// merges the chunks in file order (see MetroSystem::loadMetroData).
+std::vector<std::string_view> splitCsvChunks(std::string_view text, size_t chunkCount);
+
+// A station as first seen in a chunk, with the coordinates of that row
+struct CsvStation {
+    std::string_view name;
+    size_t hash; // std::hash of name, kept for the merge
+    double lat;
+    double lon;
+};
+
+// The rows of one chunk with names interned chunk-locally: the edges'
+// station and line IDs index `stations` and `lines`, which are in order
+// of first appearance within the chunk.
+struct MetroCsvChunk {
+    int lineCount = 0;                   // Lines in the chunk, blank and skipped ones included
+    std::vector<CsvStation> stations;
+    std::vector<std::string_view> lines;
+    std::vector<Edge> edges;
+    std::vector<LoadIssue> issues;       // Line numbers counted from 1 at the chunk's first line
+};
+
+void parseMetroCsvChunk(std::string_view text, MetroCsvChunk& chunk);
+
+#endif // METROCSV_H
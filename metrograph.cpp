@@ -0,0 +1,180 @@
+#include "metrograph.h"
+#include "parallel.h"
+#include <algorithm>
+
+void MetroGraph::build(size_t stationCount, const std::vector<Edge>& edges, unsigned threads) {
+    clear();
+    offsets.assign(stationCount + 1, 0);
+
+    // Counting sort by source station; both directions of a row are
+    // emitted in row order so adjacency order matches insertion order.
+    // With several threads the stations are split into ranges that only
+    // touch their own counters and arcs, so they need no synchronisation.
+    // Each chunk of edges first drops its arcs into one bucket per range
+    // of their source, reading every edge once; a range then walks its
+    // buckets in chunk order, which is row order again.
+    if (threads == 0) threads = defaultThreadCount();
+    const size_t ranges = std::max<size_t>(1, std::min<size_t>(threads, stationCount / 1024));
+    const size_t arcCount = edges.size() * 2;
+    std::vector<std::vector<std::vector<EdgeId>>> buckets; // [chunk][range] -> arcs, 2 * row + direction
+    if (ranges > 1) {
+        buckets.assign(ranges, std::vector<std::vector<EdgeId>>(ranges));
+        auto rangeOf = [stationCount, ranges](StationId v) {
+            return static_cast<size_t>((static_cast<uint64_t>(v + 1) * ranges - 1) / stationCount);
+        };
+        parallelFor(ranges, threads, [&](unsigned, size_t c) {
+            const size_t rowEnd = edges.size() * (c + 1) / ranges;
+            for (size_t row = edges.size() * c / ranges; row < rowEnd; ++row) {
+                const Edge& e = edges[row];
+                buckets[c][rangeOf(e.from)].push_back(static_cast<EdgeId>(2 * row));
+                buckets[c][rangeOf(e.to)].push_back(static_cast<EdgeId>(2 * row + 1));
+            }
+        });
+    }
+    // Calls visit(from, to, edge) for every arc leaving range r, in row order
+    auto forEachArc = [&](size_t r, auto&& visit) {
+        if (ranges == 1) {
+            for (const Edge& e : edges) {
+                visit(e.from, e.to, e);
+                visit(e.to, e.from, e);
+            }
+            return;
+        }
+        for (size_t c = 0; c < ranges; ++c) {
+            for (EdgeId arc : buckets[c][r]) {
+                const Edge& e = edges[arc / 2];
+                if (arc % 2 == 0) visit(e.from, e.to, e);
+                else visit(e.to, e.from, e);
+            }
+        }
+    };
+
+    parallelFor(ranges, threads, [&](unsigned, size_t r) {
+        forEachArc(r, [&](StationId from, StationId, const Edge&) { offsets[from + 1]++; });
+    });
+    for (size_t u = 0; u < stationCount; ++u) {
+        offsets[u + 1] += offsets[u];
+    }
+
+    targets.resize(arcCount);
+    times.resize(arcCount);
+    costs.resize(arcCount);
+    distances.resize(arcCount);
+    lines.resize(arcCount);
+
+    std::vector<EdgeId> cursor(offsets.begin(), offsets.end() - 1);
+    parallelFor(ranges, threads, [&](unsigned, size_t r) {
+        forEachArc(r, [&](StationId from, StationId to, const Edge& e) {
+            EdgeId slot = cursor[from]++;
+            targets[slot] = to;
+            times[slot] = e.time;
+            costs[slot] = e.cost;
+            distances[slot] = e.distance;
+            lines[slot] = e.line;
+        });
+    });
+    computeWeightRanges();
+}
+
+void MetroGraph::insertEdges(const std::vector<Edge>& edges) {
+    if (edges.empty()) return;
+    const size_t n = stationCount();
+    std::vector<EdgeId> extra(n + 1, 0); // Arcs added per station, then their prefix sums
+    for (const Edge& e : edges) {
+        extra[e.from + 1]++;
+        extra[e.to + 1]++;
+    }
+    for (size_t u = 0; u < n; ++u) extra[u + 1] += extra[u];
+
+    const size_t arcCount = targets.size() + edges.size() * 2;
+    MetroGraph grown;
+    grown.offsets.resize(n + 1);
+    grown.targets.resize(arcCount);
+    grown.times.resize(arcCount);
+    grown.costs.resize(arcCount);
+    grown.distances.resize(arcCount);
+    grown.lines.resize(arcCount);
+
+    // Old run of u moves up by the arcs added to the stations before it
+    std::vector<EdgeId> cursor(n);
+    for (StationId u = 0; u < n; ++u) {
+        const EdgeId begin = offsets[u] + extra[u];
+        grown.offsets[u] = begin;
+        std::copy(targets.begin() + offsets[u], targets.begin() + offsets[u + 1], grown.targets.begin() + begin);
+        std::copy(times.begin() + offsets[u], times.begin() + offsets[u + 1], grown.times.begin() + begin);
+        std::copy(costs.begin() + offsets[u], costs.begin() + offsets[u + 1], grown.costs.begin() + begin);
+        std::copy(distances.begin() + offsets[u], distances.begin() + offsets[u + 1], grown.distances.begin() + begin);
+        std::copy(lines.begin() + offsets[u], lines.begin() + offsets[u + 1], grown.lines.begin() + begin);
+        cursor[u] = begin + (offsets[u + 1] - offsets[u]);
+    }
+    grown.offsets[n] = static_cast<EdgeId>(arcCount);
+
+    auto place = [&](StationId from, StationId to, const Edge& e) {
+        EdgeId slot = cursor[from]++;
+        grown.targets[slot] = to;
+        grown.times[slot] = e.time;
+        grown.costs[slot] = e.cost;
+        grown.distances[slot] = e.distance;
+        grown.lines[slot] = e.line;
+    };
+    // An empty graph's ranges are 0..0, which must not count as an arc
+    const Edge& seed = edges.front();
+    grown.minTime = targets.empty() ? seed.time : minTime;
+    grown.maxTime = targets.empty() ? seed.time : maxTime;
+    grown.minCost = targets.empty() ? seed.cost : minCost;
+    grown.maxCost = targets.empty() ? seed.cost : maxCost;
+    for (const Edge& e : edges) {
+        place(e.from, e.to, e);
+        place(e.to, e.from, e);
+        grown.widenWeightRanges(e.time, e.cost);
+    }
+    *this = std::move(grown);
+}
+
+void MetroGraph::widenWeightRanges(int time, int cost) {
+    minTime = std::min(minTime, time);
+    maxTime = std::max(maxTime, time);
+    minCost = std::min(minCost, cost);
+    maxCost = std::max(maxCost, cost);
+}
+
+void MetroGraph::computeWeightRanges() {
+    minTime = maxTime = times.empty() ? 0 : times.front();
+    for (int t : times) {
+        minTime = std::min(minTime, t);
+        maxTime = std::max(maxTime, t);
+    }
+    minCost = maxCost = costs.empty() ? 0 : costs.front();
+    for (int c : costs) {
+        minCost = std::min(minCost, c);
+        maxCost = std::max(maxCost, c);
+    }
+}
+
+EdgeId MetroGraph::reverseArc(StationId u, EdgeId e) const {
+    const StationId v = targets[e];
+    EdgeId fallback = kInvalidEdge;
+    for (EdgeId back = edgesBegin(v); back < edgesEnd(v); ++back) {
+        if (targets[back] != u || lines[back] != lines[e]) continue;
+        if (times[back] == times[e] && costs[back] == costs[e] && distances[back] == distances[e]) return back;
+        if (fallback == kInvalidEdge) fallback = back;
+    }
+    return fallback;
+}
+
+size_t MetroGraph::memoryFootprint() const {
+    return offsets.capacity() * sizeof(EdgeId) + targets.capacity() * sizeof(StationId)
+           + times.capacity() * sizeof(int) + costs.capacity() * sizeof(int)
+           + distances.capacity() * sizeof(double) + lines.capacity() * sizeof(LineId);
+}
+
+void MetroGraph::clear() {
+    offsets.clear();
+    targets.clear();
+    times.clear();
+    costs.clear();
+    distances.clear();
+    lines.clear();
+    minTime = maxTime = 0;
+    minCost = maxCost = 0;
+}
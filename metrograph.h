@@ -0,0 +1,72 @@
+#ifndef METROGRAPH_H
+#define METROGRAPH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Dense integer IDs used by the routing engine. Names are only looked up
+// at the MetroSystem API boundary.
+using StationId = uint32_t;
+using LineId = uint32_t;
+using EdgeId = uint32_t;
+
+constexpr StationId kInvalidStation = std::numeric_limits<StationId>::max();
+constexpr EdgeId kInvalidEdge = std::numeric_limits<EdgeId>::max();
+
+// One undirected track segment (one CSV row) after station/line interning
+struct Edge {
+    StationId from;
+    StationId to;
+    int time;
+    double distance;
+    int cost;
+    LineId line;
+};
+
+// Frozen compressed-sparse-row graph. The outgoing arcs of station u are
+// the indices [offsets[u], offsets[u + 1]) into the parallel arc arrays.
+struct MetroGraph {
+    std::vector<EdgeId> offsets;
+    std::vector<StationId> targets;
+    std::vector<int> times;
+    std::vector<int> costs;
+    std::vector<double> distances;
+    std::vector<LineId> lines;
+
+    // Range of times and costs over all arcs (0 when empty)
+    int minTime = 0;
+    int maxTime = 0;
+    int minCost = 0;
+    int maxCost = 0;
+
+    // Every Edge becomes two arcs (from->to and to->from). Arcs keep the
+    // order in which they were inserted for their source station. With
+    // several threads each fills the arcs of its own range of stations;
+    // the result does not depend on the thread count.
+    void build(size_t stationCount, const std::vector<Edge>& edges, unsigned threads = 1);
+    void clear();
+    // Adds both arcs of each edge after the existing arcs of its stations
+    // and widens the weight ranges; existing arcs keep their relative order.
+    void insertEdges(const std::vector<Edge>& edges);
+    // Recomputes the weight ranges; build() calls it, anything that fills
+    // the arrays directly must too.
+    void computeWeightRanges();
+    // Extends the ranges to cover one more time and cost, e.g. after an
+    // arc's weights were changed in place
+    void widenWeightRanges(int time, int cost);
+
+    size_t stationCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t edgeCount() const { return targets.size(); }
+    bool empty() const { return targets.empty(); }
+    size_t memoryFootprint() const; // Bytes held by the arrays
+
+    EdgeId edgesBegin(StationId u) const { return offsets[u]; }
+    EdgeId edgesEnd(StationId u) const { return offsets[u + 1]; }
+    // The arc running back from the target of e (which leaves u) to u on
+    // the same line, preferring the twin with the same weights
+    EdgeId reverseArc(StationId u, EdgeId e) const;
+};
+
+#endif // METROGRAPH_H
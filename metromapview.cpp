@@ -0,0 +1,202 @@
+#include "metromapview.h"
+#include <QBrush>
+#include <QDebug>
+#include <QGraphicsEllipseItem>
+#include <QGraphicsLineItem>
+#include <QGraphicsScene>
+#include <QGraphicsSimpleTextItem>
+#include <QPainter>
+#include <QPen>
+#include <QWheelEvent>
+#include <cmath>
+#include <map>
+
+#include "linecolors.h"
+
+namespace {
+
+// Scene units per degree; keeps a city-sized network in a few hundred units
+constexpr double kSceneUnitsPerDegree = 1000.0;
+constexpr double kStationMarkRadius = 1.2; // Scene units
+
+} // namespace
+
+MetroMapView::MetroMapView(QWidget* parent)
+    : QGraphicsView(parent), scene_(new QGraphicsScene(this)) {
+    setScene(scene_);
+    setCacheMode(QGraphicsView::CacheBackground);
+    setRenderHint(QPainter::Antialiasing);
+    setDragMode(QGraphicsView::ScrollHandDrag);
+    setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+    setMinimumSize(350, 350);
+}
+
+QPointF MetroMapView::project(const QPointF& lonLat) const {
+    // Equirectangular; y grows downwards on screen, latitude upwards
+    return QPointF(lonLat.x() * lonScale_ * kSceneUnitsPerDegree, -lonLat.y() * kSceneUnitsPerDegree);
+}
+
+void MetroMapView::setNetwork(const std::vector<MapSegment>& segments,
+                              const std::unordered_map<std::string, QPointF>& stationCoordinates) {
+    clearRoute();
+    linePaths_.clear();
+    stationMarks_ = QPainterPath();
+    stationPositions_.clear();
+
+    double latitudeSum = 0.0;
+    for (const auto& station : stationCoordinates) latitudeSum += station.second.y();
+    const double meanLatitude = stationCoordinates.empty() ? 0.0 : latitudeSum / stationCoordinates.size();
+    lonScale_ = std::cos(meanLatitude * 3.14159265358979323846 / 180.0);
+
+    // Segments of the same colour go into one path so the background is a
+    // few stroke calls rather than one per segment.
+    std::map<QString, QPainterPath> pathsByColor;
+    for (const MapSegment& segment : segments) {
+        QPainterPath& path = pathsByColor[getLineColor(QString::fromStdString(segment.line))];
+        path.moveTo(project(segment.from));
+        path.lineTo(project(segment.to));
+    }
+    for (auto& entry : pathsByColor) {
+        linePaths_.emplace_back(QColor(entry.first), std::move(entry.second));
+    }
+
+    QRectF bounds;
+    stationPositions_.reserve(stationCoordinates.size());
+    for (const auto& station : stationCoordinates) {
+        const QPointF position = project(station.second);
+        stationPositions_.emplace(station.first, position);
+        stationMarks_.addEllipse(position, kStationMarkRadius, kStationMarkRadius);
+        bounds = bounds.united(QRectF(position, QSizeF(1, 1)));
+    }
+
+    scene_->setSceneRect(bounds.adjusted(-20, -20, 20, 20));
+    resetCachedContent();
+    userZoomed_ = false;
+    fitInView(scene_->sceneRect(), Qt::KeepAspectRatio);
+}
+
+void MetroMapView::drawBackground(QPainter* painter, const QRectF& rect) {
+    painter->fillRect(rect, Qt::white);
+    painter->setRenderHint(QPainter::Antialiasing);
+    for (const auto& line : linePaths_) {
+        QPen pen(line.first, 2.0);
+        pen.setCosmetic(true); // Same width in pixels at every zoom
+        pen.setCapStyle(Qt::RoundCap);
+        painter->strokePath(line.second, pen);
+    }
+    painter->fillPath(stationMarks_, QColor(90, 90, 90));
+}
+
+void MetroMapView::clearRoute() {
+    for (QGraphicsItem* item : routeItems_) {
+        scene_->removeItem(item);
+        delete item;
+    }
+    routeItems_.clear();
+}
+
+// Only the route items change here; the network stays in the cached
+// background, so this is cheap enough to do on every result.
+void MetroMapView::showRoute(const std::vector<PathSegment>& path) {
+    clearRoute();
+    std::vector<QPointF> points;
+    points.reserve(path.size());
+    for (const PathSegment& segment : path) {
+        auto it = stationPositions_.find(segment.stationName);
+        if (it == stationPositions_.end()) {
+            qWarning() << "MetroMapView: no coordinates for station:" << QString::fromStdString(segment.stationName);
+            return;
+        }
+        points.push_back(it->second);
+    }
+    if (points.empty()) return;
+
+    QRectF bounds(points.front(), QSizeF(0, 0));
+    for (size_t i = 1; i < points.size(); ++i) {
+        QPen pen(QColor(getLineColor(QString::fromStdString(path[i].lineTakenToReach))), 6.0);
+        pen.setCosmetic(true);
+        pen.setCapStyle(Qt::RoundCap);
+        QGraphicsLineItem* line = scene_->addLine(QLineF(points[i - 1], points[i]), pen);
+        line->setZValue(1);
+        routeItems_.push_back(line);
+        bounds = bounds.united(QRectF(points[i], QSizeF(0, 0)));
+    }
+
+    for (size_t i = 0; i < points.size(); ++i) {
+        const bool endpoint = i == 0 || i + 1 == points.size();
+        const double radius = endpoint ? 6.0 : 3.5; // Pixels
+        QGraphicsEllipseItem* mark = scene_->addEllipse(-radius, -radius, 2 * radius, 2 * radius,
+                                                        QPen(Qt::black, 1.5), QBrush(endpoint ? Qt::black : Qt::white));
+        mark->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+        mark->setPos(points[i]);
+        mark->setZValue(2);
+        mark->setToolTip(QString::fromStdString(path[i].stationName));
+        routeItems_.push_back(mark);
+    }
+
+    auto addLabel = [&](size_t i) {
+        QGraphicsSimpleTextItem* label = scene_->addSimpleText(QString::fromStdString(path[i].stationName));
+        label->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+        label->setPos(points[i]);
+        label->setZValue(3);
+        routeItems_.push_back(label);
+    };
+    addLabel(0);
+    if (points.size() > 1) addLabel(points.size() - 1);
+
+    ensureVisible(bounds, 30, 30);
+}
+
+void MetroMapView::showIsochrone(const std::string& source, const std::vector<IsochroneBand>& bands) {
+    clearRoute();
+    auto sourceIt = stationPositions_.find(source);
+    if (sourceIt == stationPositions_.end()) return;
+    QRectF bounds(sourceIt->second, QSizeF(0, 0));
+
+    for (size_t b = 0; b < bands.size(); ++b) {
+        // Hue from green (120) down to red (0) over the bands
+        const int hue = bands.size() > 1 ? static_cast<int>(120 - 120 * b / (bands.size() - 1)) : 120;
+        const QColor colour = QColor::fromHsv(hue, 200, 220);
+        for (const std::string& station : bands[b].stations) {
+            auto it = stationPositions_.find(station);
+            if (it == stationPositions_.end() || station == source) continue;
+            const double radius = 5.0; // Pixels
+            QGraphicsEllipseItem* mark = scene_->addEllipse(-radius, -radius, 2 * radius, 2 * radius,
+                                                            QPen(colour.darker(150), 1.0), QBrush(colour));
+            mark->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+            mark->setPos(it->second);
+            mark->setZValue(1);
+            mark->setToolTip(QString("%1 (up to %2)").arg(QString::fromStdString(station)).arg(bands[b].upTo));
+            routeItems_.push_back(mark);
+            bounds = bounds.united(QRectF(it->second, QSizeF(0, 0)));
+        }
+    }
+
+    const double radius = 6.0;
+    QGraphicsEllipseItem* mark = scene_->addEllipse(-radius, -radius, 2 * radius, 2 * radius, QPen(Qt::black, 1.5), QBrush(Qt::black));
+    mark->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+    mark->setPos(sourceIt->second);
+    mark->setZValue(2);
+    routeItems_.push_back(mark);
+    QGraphicsSimpleTextItem* label = scene_->addSimpleText(QString::fromStdString(source));
+    label->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+    label->setPos(sourceIt->second);
+    label->setZValue(3);
+    routeItems_.push_back(label);
+
+    ensureVisible(bounds, 30, 30);
+}
+
+void MetroMapView::wheelEvent(QWheelEvent* event) {
+    const double factor = std::pow(1.15, event->angleDelta().y() / 120.0);
+    scale(factor, factor);
+    userZoomed_ = true;
+    event->accept();
+}
+
+void MetroMapView::resizeEvent(QResizeEvent* event) {
+    QGraphicsView::resizeEvent(event);
+    if (!userZoomed_ && !linePaths_.empty()) {
+        fitInView(scene_->sceneRect(), Qt::KeepAspectRatio);
+    }
+}
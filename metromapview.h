@@ -0,0 +1,54 @@
+#ifndef METROMAPVIEW_H
+#define METROMAPVIEW_H
+
+#include <QColor>
+#include <QGraphicsView>
+#include <QPainterPath>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "metrosystem.h"
+
+QT_BEGIN_NAMESPACE
+class QGraphicsItem;
+class QGraphicsScene;
+QT_END_NAMESPACE
+
+// Native map of the network and the current route. The network is painted
+// as the view background, which QGraphicsView keeps in a cached pixmap, so
+// it is only redrawn when the view is zoomed or resized. A route is a
+// handful of items on top; showing another route replaces just those.
+class MetroMapView : public QGraphicsView {
+    Q_OBJECT
+
+public:
+    explicit MetroMapView(QWidget* parent = nullptr);
+
+    void setNetwork(const std::vector<MapSegment>& segments,
+                    const std::unordered_map<std::string, QPointF>& stationCoordinates);
+    void showRoute(const std::vector<PathSegment>& path);
+    // Marks the stations of each band in its own colour, green for the
+    // nearest band to red for the furthest; replaces the route
+    void showIsochrone(const std::string& source, const std::vector<IsochroneBand>& bands);
+    void clearRoute(); // Also clears an isochrone
+
+protected:
+    void drawBackground(QPainter* painter, const QRectF& rect) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+
+private:
+    QPointF project(const QPointF& lonLat) const; // (longitude, latitude) -> scene
+
+    QGraphicsScene* scene_;
+    std::vector<QGraphicsItem*> routeItems_; // Route or isochrone overlay
+    std::vector<std::pair<QColor, QPainterPath>> linePaths_; // Network, one path per line colour
+    QPainterPath stationMarks_;
+    std::unordered_map<std::string, QPointF> stationPositions_; // Scene position by station name
+    double lonScale_ = 1.0; // cos(mean latitude), keeps the map's aspect right
+    bool userZoomed_ = false; // Until then the view keeps the whole network in sight
+};
+
+#endif // METROMAPVIEW_H
@@ -0,0 +1,590 @@
+// Headless route query daemon.
+//
+// Loads the network once, then answers newline-delimited JSON requests read
+// from stdin with one JSON line each on stdout. Requests are handled by a
+// pool of worker threads, so responses may come back out of order; echo an
+// "id" to match them up. Both the request and the response queues are
+// bounded: when the workers fall behind, the reader stops reading stdin and
+// the backpressure reaches the client through the pipe.
+//
+// Requests:
+//   {"id": 1, "from": "Rajiv Chowk", "to": "Kashmere Gate", "criterion": "time"}
+//       criterion: "time" (default), "cost", "stops" or "distance";
+//       add "path": false to get the totals only, or "departure": "08:15" for
+//       the earliest arrival by timetable (time then includes waiting);
+//       "transferMinutes" / "transferCost" penalise each change of line on
+//       time / cost routes (see findPathWithTransfers)
+//   {"id": 2, "op": "stats"}   route cache counters, search totals and
+//       latency per criterion (percentiles are histogram bucket bounds);
+//       "hierarchyFallbacks" counts ch queries that live updates sent to
+//       Dijkstra
+//   {"id": 3, "op": "update", "updates": [{"kind": "closeSegment", "from": "A", "to": "B"}, ...]}
+//       kind: "closeStation"/"reopenStation" (uses "from" only), "closeSegment",
+//       "reopenSegment", "setWeights" ("time" and/or "cost"), "addSegment"
+//       ("line", "time", "cost", "distance") or "removeSegment"; "line" narrows
+//       a segment to one line. A batch is applied whole or not at all.
+//   {"id": 4, "op": "clearUpdates"}   back to the network as loaded
+//   {"id": 5, "op": "reach", "from": "A", "criterion": "time", "budget": 20}
+//       every station within the budget, nearest first (criterion "stops",
+//       "time" or "cost")
+//   {"id": 6, "op": "stations", "query": "rajv ch", "limit": 10}
+//       station names matching what was typed so far, best first
+//   {"id": 7, "op": "pareto", "from": "A", "to": "B", "maxTransfers": 5}
+//       every trade-off between time, cost and changes of line, fastest
+//       first (see findParetoRoutes); "path": false as for a route.
+//       maxTransfers is at most 10, and the search is cancelled after
+//       --analytics-timeout seconds like a centrality request
+//   {"id": 8, "op": "alternatives", "from": "A", "to": "B", "criterion": "time", "k": 3}
+//       the k best routes that visit no station twice, best first (see
+//       findAlternativeRoutes); "path": false as for a route. k is at
+//       most 20, and the search is cancelled after --analytics-timeout
+//       seconds
+//   {"id": 9, "op": "centrality", "criterion": "time", "samples": 256, "top": 10}
+//       the `top` stations and segments by betweenness, "top": 0 for the
+//       full rankings (see computeCentrality), estimated from "samples"
+//       sources (default and most: --centrality-sources; exact when that
+//       covers every station). It runs on --analytics-threads threads and
+//       is cancelled after --analytics-timeout seconds, so it cannot hold
+//       every core or a worker indefinitely. The daemon writes no files:
+//       clients that want a CSV write it from the response.
+// Responses:
+//   {"id": 1, "ok": true, "time": 12, "cost": 30, "distance": 6.1, "hops": 5, "transfers": 1, "path": [...]}
+//   {"id": 7, "ok": true, "routes": [{"time": 12, "cost": 30, ...}, ...]}   (also op "alternatives")
+//   {"id": 9, "ok": true, "sources": 250, "sampled": false, "stations": [...], "segments": [...]}
+//   {"id": 1, "ok": false, "error": "..."}
+//
+// Logging goes to stderr; stdout carries responses only.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTime>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boundedqueue.h"
+#include "metrosystem.h"
+#include "parallel.h"
+
+namespace {
+
+// Largest k an alternatives request may ask for
+constexpr int kMaxAlternatives = 20;
+// Largest maxTransfers a pareto request may ask for; the state graph
+// search grows with every change of line it has to keep apart
+constexpr int kMaxParetoTransfers = 10;
+
+// Limits on the analytics ops, from the command line
+struct DaemonSettings {
+    unsigned analyticsThreads = 1;    // Threads of one centrality request, its own worker included
+    size_t maxCentralitySources = 256; // Largest "samples"
+    int analyticsTimeoutSeconds = 60; // Of a centrality, pareto or alternatives request
+};
+
+// Sets a cancel flag once the time is up, unless destroyed first
+class Deadline {
+public:
+    Deadline(CancelFlag& cancel, std::chrono::seconds timeout)
+        : watcher_([this, &cancel, timeout]() {
+              std::unique_lock<std::mutex> lock(mutex_);
+              if (!done_.wait_for(lock, timeout, [this]() { return finished_; })) cancel.store(true);
+          }) {}
+    ~Deadline() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = true;
+        }
+        done_.notify_one();
+        watcher_.join();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    bool finished_ = false;
+    std::thread watcher_; // Last, so it starts after the members it uses
+};
+
+// Calls search(cancel) with a flag set once the analytics timeout is up;
+// false if it was
+template <typename Search>
+bool withinAnalyticsTimeout(const DaemonSettings& settings, Search search) {
+    CancelFlag cancel(false);
+    {
+        Deadline deadline(cancel, std::chrono::seconds(settings.analyticsTimeoutSeconds));
+        search(&cancel);
+    }
+    return !cancel.load();
+}
+
+bool parseCriterion(const QString& name, RouteCriterion& criterion) {
+    if (name == "time") criterion = RouteCriterion::Time;
+    else if (name == "cost") criterion = RouteCriterion::Cost;
+    else if (name == "stops") criterion = RouteCriterion::LeastStops;
+    else if (name == "distance") criterion = RouteCriterion::Distance;
+    else return false;
+    return true;
+}
+
+bool parseEngine(const QString& name, SearchEngine& engine) {
+    if (name == "dijkstra") engine = SearchEngine::Dijkstra;
+    else if (name == "ch") engine = SearchEngine::ContractionHierarchy;
+    else if (name == "astar") engine = SearchEngine::AStar;
+    else if (name == "bidirectional") engine = SearchEngine::Bidirectional;
+    else return false;
+    return true;
+}
+
+bool parseUpdateKind(const QString& name, NetworkUpdate::Kind& kind) {
+    if (name == "closeStation") kind = NetworkUpdate::Kind::CloseStation;
+    else if (name == "reopenStation") kind = NetworkUpdate::Kind::ReopenStation;
+    else if (name == "closeSegment") kind = NetworkUpdate::Kind::CloseSegment;
+    else if (name == "reopenSegment") kind = NetworkUpdate::Kind::ReopenSegment;
+    else if (name == "setWeights") kind = NetworkUpdate::Kind::SetSegmentWeights;
+    else if (name == "addSegment") kind = NetworkUpdate::Kind::AddTemporarySegment;
+    else if (name == "removeSegment") kind = NetworkUpdate::Kind::RemoveTemporarySegment;
+    else return false;
+    return true;
+}
+
+QJsonObject updateResponse(MetroSystem& system, const QJsonObject& request) {
+    QJsonObject response;
+    std::vector<NetworkUpdate> updates;
+    for (const QJsonValue& value : request.value("updates").toArray()) {
+        const QJsonObject entry = value.toObject();
+        NetworkUpdate update;
+        if (!parseUpdateKind(entry.value("kind").toString(), update.kind)) {
+            response["ok"] = false;
+            response["error"] = "unknown update kind: " + entry.value("kind").toString();
+            return response;
+        }
+        update.from = entry.value("from").toString().toStdString();
+        update.to = entry.value("to").toString().toStdString();
+        update.line = entry.value("line").toString().toStdString();
+        update.time = entry.value("time").toInt(-1);
+        update.cost = entry.value("cost").toInt(-1);
+        update.distance = entry.value("distance").toDouble(0.0);
+        updates.push_back(std::move(update));
+    }
+
+    std::string errorMsg;
+    if (!system.applyUpdates(updates, errorMsg)) {
+        response["ok"] = false;
+        response["error"] = QString::fromStdString(errorMsg);
+        return response;
+    }
+    response["ok"] = true;
+    response["version"] = static_cast<qint64>(system.networkVersion());
+    return response;
+}
+
+QJsonObject reachResponse(MetroSystem& system, const QJsonObject& request) {
+    QJsonObject response;
+    RouteCriterion criterion = RouteCriterion::Time;
+    if (!parseCriterion(request.value("criterion").toString("time"), criterion) || criterion == RouteCriterion::Distance) {
+        response["ok"] = false;
+        response["error"] = "criterion must be stops, time or cost";
+        return response;
+    }
+    const std::string from = request.value("from").toString().toStdString();
+    if (system.getStationCoordinates().count(from) == 0) {
+        response["ok"] = false;
+        response["error"] = QString("unknown station: %1").arg(QString::fromStdString(from));
+        return response;
+    }
+    QJsonArray stations;
+    for (const ReachableStation& station : system.reachableWithin(from, criterion, request.value("budget").toInteger(0))) {
+        QJsonObject entry;
+        entry["station"] = QString::fromStdString(station.station);
+        entry["value"] = station.value;
+        stations.append(entry);
+    }
+    response["ok"] = true;
+    response["stations"] = stations;
+    return response;
+}
+
+// Totals of a route found, and its steps if asked for
+QJsonObject routeSummary(const std::vector<PathSegment>& path, bool includePath) {
+    long long totalTime = 0;
+    long long totalCost = 0;
+    double totalDistance = 0.0;
+    QJsonArray steps;
+    for (const PathSegment& segment : path) {
+        totalTime += segment.waitForSegment + segment.timeForSegment;
+        totalCost += segment.costForSegment;
+        totalDistance += segment.distanceForSegment;
+        if (includePath) {
+            QJsonObject step;
+            step["station"] = QString::fromStdString(segment.stationName);
+            if (!segment.isFirstSegment) {
+                step["line"] = QString::fromStdString(segment.lineTakenToReach);
+                step["time"] = segment.timeForSegment;
+                if (segment.waitForSegment > 0) step["wait"] = segment.waitForSegment;
+                step["cost"] = segment.costForSegment;
+                step["distance"] = segment.distanceForSegment;
+            }
+            steps.append(step);
+        }
+    }
+    QJsonObject summary;
+    summary["time"] = totalTime;
+    summary["cost"] = totalCost;
+    summary["distance"] = totalDistance;
+    summary["hops"] = static_cast<int>(path.size()) - 1;
+    summary["transfers"] = path.back().transfers;
+    if (includePath) summary["path"] = steps;
+    return summary;
+}
+
+// False, with the error in response, unless both ends are known stations
+bool checkEndpoints(MetroSystem& system, const std::string& from, const std::string& to, QJsonObject& response) {
+    const auto& stations = system.getStationCoordinates();
+    for (const std::string* name : {&from, &to}) {
+        if (stations.find(*name) == stations.end()) {
+            response["ok"] = false;
+            response["error"] = QString("unknown station: %1").arg(QString::fromStdString(*name));
+            return false;
+        }
+    }
+    return true;
+}
+
+QJsonObject paretoResponse(MetroSystem& system, const DaemonSettings& settings, const QJsonObject& request) {
+    QJsonObject response;
+    const std::string from = request.value("from").toString().toStdString();
+    const std::string to = request.value("to").toString().toStdString();
+    const int maxTransfers = request.value("maxTransfers").toInt(MetroSystem::kDefaultParetoTransfers);
+    if (maxTransfers < 0 || maxTransfers > kMaxParetoTransfers) {
+        response["ok"] = false;
+        response["error"] = QString("maxTransfers must be 0 to %1").arg(kMaxParetoTransfers);
+        return response;
+    }
+    if (!checkEndpoints(system, from, to, response)) return response;
+
+    std::vector<ParetoRoute> found;
+    if (!withinAnalyticsTimeout(settings, [&](const CancelFlag* cancel) {
+            found = system.findParetoRoutes(from, to, maxTransfers, cancel);
+        })) {
+        response["ok"] = false;
+        response["error"] = QString("timed out after %1 s; allow fewer transfers").arg(settings.analyticsTimeoutSeconds);
+        return response;
+    }
+    const bool includePath = request.value("path").toBool(true);
+    QJsonArray routes;
+    for (const ParetoRoute& route : found) routes.append(routeSummary(route.path, includePath));
+    if (routes.isEmpty()) {
+        response["ok"] = false;
+        response["error"] = "no route";
+        return response;
+    }
+    response["ok"] = true;
+    response["routes"] = routes;
+    return response;
+}
+
+QJsonObject alternativesResponse(MetroSystem& system, const DaemonSettings& settings, const QJsonObject& request) {
+    QJsonObject response;
+    const std::string from = request.value("from").toString().toStdString();
+    const std::string to = request.value("to").toString().toStdString();
+    RouteCriterion criterion = RouteCriterion::Time;
+    if (!parseCriterion(request.value("criterion").toString("time"), criterion)) {
+        response["ok"] = false;
+        response["error"] = "unknown criterion";
+        return response;
+    }
+    const int k = request.value("k").toInt(3);
+    if (k < 1 || k > kMaxAlternatives) {
+        response["ok"] = false;
+        response["error"] = QString("k must be 1 to %1").arg(kMaxAlternatives);
+        return response;
+    }
+    if (!checkEndpoints(system, from, to, response)) return response;
+
+    std::vector<std::vector<PathSegment>> found;
+    if (!withinAnalyticsTimeout(settings, [&](const CancelFlag* cancel) {
+            found = system.findAlternativeRoutes(from, to, criterion, static_cast<size_t>(k), 1, cancel);
+        })) {
+        response["ok"] = false;
+        response["error"] = QString("timed out after %1 s; ask for fewer routes").arg(settings.analyticsTimeoutSeconds);
+        return response;
+    }
+    const bool includePath = request.value("path").toBool(true);
+    QJsonArray routes;
+    for (const std::vector<PathSegment>& path : found) routes.append(routeSummary(path, includePath));
+    if (routes.isEmpty()) {
+        response["ok"] = false;
+        response["error"] = "no route";
+        return response;
+    }
+    response["ok"] = true;
+    response["routes"] = routes;
+    return response;
+}
+
+QJsonObject centralityResponse(MetroSystem& system, const DaemonSettings& settings, const QJsonObject& request) {
+    QJsonObject response;
+    RouteCriterion criterion = RouteCriterion::Time;
+    if (!parseCriterion(request.value("criterion").toString("time"), criterion) || criterion == RouteCriterion::Distance) {
+        response["ok"] = false;
+        response["error"] = "criterion must be stops, time or cost";
+        return response;
+    }
+    const int maxSamples = static_cast<int>(settings.maxCentralitySources);
+    const int samples = request.value("samples").toInt(maxSamples);
+    if (samples < 1 || samples > maxSamples) {
+        response["ok"] = false;
+        response["error"] = QString("samples must be 1 to %1").arg(maxSamples);
+        return response;
+    }
+    NetworkCentrality centrality;
+    if (!withinAnalyticsTimeout(settings, [&](const CancelFlag* cancel) {
+            centrality = system.computeCentrality(criterion, static_cast<size_t>(samples), settings.analyticsThreads, 1,
+                                                  cancel);
+        })) {
+        response["ok"] = false;
+        response["error"] = QString("timed out after %1 s; ask for fewer samples").arg(settings.analyticsTimeoutSeconds);
+        return response;
+    }
+
+    // 0 (or less) asks for everything
+    const int topRequested = request.value("top").toInt(10);
+    const size_t top = topRequested > 0 ? static_cast<size_t>(topRequested) : centrality.stations.size() + centrality.segments.size();
+    QJsonArray stations;
+    for (size_t i = 0; i < std::min(top, centrality.stations.size()); ++i) {
+        QJsonObject entry;
+        entry["station"] = QString::fromStdString(centrality.stations[i].station);
+        entry["betweenness"] = centrality.stations[i].betweenness;
+        stations.append(entry);
+    }
+    QJsonArray segments;
+    for (size_t i = 0; i < std::min(top, centrality.segments.size()); ++i) {
+        const SegmentCentrality& segment = centrality.segments[i];
+        QJsonObject entry;
+        entry["from"] = QString::fromStdString(segment.from);
+        entry["to"] = QString::fromStdString(segment.to);
+        entry["line"] = QString::fromStdString(segment.line);
+        entry["betweenness"] = segment.betweenness;
+        segments.append(entry);
+    }
+    response["ok"] = true;
+    response["sources"] = static_cast<qint64>(centrality.sources);
+    response["sampled"] = centrality.sampled;
+    response["stations"] = stations;
+    response["segments"] = segments;
+    return response;
+}
+
+QJsonObject routeResponse(MetroSystem& system, const QJsonObject& request) {
+    QJsonObject response;
+    const std::string from = request.value("from").toString().toStdString();
+    const std::string to = request.value("to").toString().toStdString();
+    RouteCriterion criterion = RouteCriterion::Time;
+    if (!parseCriterion(request.value("criterion").toString("time"), criterion)) {
+        response["ok"] = false;
+        response["error"] = "unknown criterion";
+        return response;
+    }
+    if (!checkEndpoints(system, from, to, response)) return response;
+
+    std::vector<PathSegment> path;
+    if (request.contains("departure")) {
+        const QTime departure = QTime::fromString(request.value("departure").toString(), "H:mm");
+        if (!departure.isValid()) {
+            response["ok"] = false;
+            response["error"] = "departure must be H:MM";
+            return response;
+        }
+        if (!system.hasTimetable()) {
+            response["ok"] = false;
+            response["error"] = "no timetable loaded";
+            return response;
+        }
+        path = system.findEarliestArrival(from, to, departure.hour() * 60 + departure.minute());
+    } else if (request.contains("transferMinutes") || request.contains("transferCost")) {
+        TransferPenalties penalties;
+        penalties.minutes = request.value("transferMinutes").toInt(penalties.minutes);
+        penalties.cost = request.value("transferCost").toInt(penalties.cost);
+        path = system.findPathWithTransfers(from, to, criterion, penalties);
+    } else {
+        path = system.findPath(from, to, criterion);
+    }
+    if (path.empty()) {
+        response["ok"] = false;
+        response["error"] = "no route";
+        return response;
+    }
+
+    response = routeSummary(path, request.value("path").toBool(true));
+    response["ok"] = true;
+    return response;
+}
+
+std::string handleRequest(MetroSystem& system, const DaemonSettings& settings, const std::string& line) {
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(QByteArray(line.data(), static_cast<int>(line.size())), &parseError);
+    QJsonObject response;
+    if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+        response["ok"] = false;
+        response["error"] = "invalid request: " + (parseError.error != QJsonParseError::NoError
+                                                      ? parseError.errorString()
+                                                      : QString("expected a JSON object"));
+    } else {
+        const QJsonObject request = document.object();
+        const QString op = request.value("op").toString("route");
+        if (op == "route") {
+            response = routeResponse(system, request);
+        } else if (op == "stats") {
+            const RouteCacheStats stats = system.routeCacheStats();
+            response["ok"] = true;
+            response["cacheHits"] = static_cast<qint64>(stats.hits);
+            response["cacheMisses"] = static_cast<qint64>(stats.misses);
+            response["cacheSize"] = static_cast<qint64>(stats.size);
+            const MetroStats searchStats = system.statistics();
+            response["searches"] = static_cast<qint64>(searchStats.searches);
+            response["settled"] = static_cast<qint64>(searchStats.searchTotals.settled);
+            response["relaxed"] = static_cast<qint64>(searchStats.searchTotals.relaxed);
+            response["hierarchyFallbacks"] = static_cast<qint64>(searchStats.searchTotals.hierarchyFallbacks);
+            QJsonObject latency;
+            const char* const criterionNames[] = {"stops", "time", "cost", "distance"};
+            for (size_t i = 0; i < searchStats.latency.size(); ++i) {
+                const LatencyHistogram::Snapshot& histogram = searchStats.latency[i];
+                QJsonObject entry;
+                entry["count"] = static_cast<qint64>(histogram.count);
+                entry["meanUs"] = histogram.meanMicros();
+                entry["p50Us"] = histogram.percentileMicros(0.5);
+                entry["p99Us"] = histogram.percentileMicros(0.99);
+                latency[criterionNames[i]] = entry;
+            }
+            response["latency"] = latency;
+        } else if (op == "reach") {
+            response = reachResponse(system, request);
+        } else if (op == "pareto") {
+            response = paretoResponse(system, settings, request);
+        } else if (op == "alternatives") {
+            response = alternativesResponse(system, settings, request);
+        } else if (op == "centrality") {
+            response = centralityResponse(system, settings, request);
+        } else if (op == "stations") {
+            QJsonArray stations;
+            const int limit = std::max(0, request.value("limit").toInt(10));
+            for (const std::string& name : system.findStations(request.value("query").toString().toStdString(), limit)) {
+                stations.append(QString::fromStdString(name));
+            }
+            response["ok"] = true;
+            response["stations"] = stations;
+        } else if (op == "update") {
+            response = updateResponse(system, request);
+        } else if (op == "clearUpdates") {
+            system.clearUpdates();
+            response["ok"] = true;
+            response["version"] = static_cast<qint64>(system.networkVersion());
+        } else {
+            response["ok"] = false;
+            response["error"] = "unknown op: " + op;
+        }
+        if (request.contains("id")) response["id"] = request.value("id");
+    }
+    return QJsonDocument(response).toJson(QJsonDocument::Compact).toStdString();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("metroqueryd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Answers metro route requests as newline-delimited JSON on stdin/stdout.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("csv", "Metro network CSV (a newer .mfsnap snapshot next to it is used if present).");
+    QCommandLineOption threadsOption({"j", "threads"}, "Worker threads (default: one per core).", "n", "0");
+    QCommandLineOption queueOption("queue", "Capacity of the request and response queues.", "n", "1024");
+    QCommandLineOption engineOption("engine", "dijkstra, ch, astar or bidirectional.", "name", "dijkstra");
+    QCommandLineOption analyticsThreadsOption("analytics-threads", "Threads of one centrality request.", "n", "1");
+    QCommandLineOption centralitySourcesOption("centrality-sources", "Most sources a centrality request may sample.", "n", "256");
+    QCommandLineOption analyticsTimeoutOption("analytics-timeout", "Seconds before a centrality, pareto or alternatives request is cancelled.", "s", "60");
+    for (const QCommandLineOption* option : {&threadsOption, &queueOption, &engineOption, &analyticsThreadsOption,
+                                             &centralitySourcesOption, &analyticsTimeoutOption}) {
+        parser.addOption(*option);
+    }
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    SearchEngine engine = SearchEngine::Dijkstra;
+    if (!parseEngine(parser.value(engineOption), engine)) {
+        qCritical() << "Unknown engine:" << parser.value(engineOption);
+        return 1;
+    }
+    unsigned threads = parser.value(threadsOption).toUInt();
+    if (threads == 0) threads = defaultThreadCount();
+    const size_t queueCapacity = std::max(1u, parser.value(queueOption).toUInt());
+    DaemonSettings settings;
+    settings.analyticsThreads = std::max(1u, parser.value(analyticsThreadsOption).toUInt());
+    settings.maxCentralitySources = std::max(1u, parser.value(centralitySourcesOption).toUInt());
+    settings.analyticsTimeoutSeconds = std::max(1, parser.value(analyticsTimeoutOption).toInt());
+
+    MetroSystem system;
+    std::string errorMsg;
+    if (!system.loadMetroDataCached(positional.front().toStdString(), errorMsg)) {
+        qCritical() << "Failed to load network:" << QString::fromStdString(errorMsg);
+        return 1;
+    }
+    system.setSearchEngine(engine);
+    if (engine == SearchEngine::ContractionHierarchy) {
+        system.buildContractionHierarchies(); // Before the first request, not during it
+    }
+    qInfo() << "metroqueryd ready:" << threads << "workers, queue capacity" << queueCapacity;
+
+    BoundedQueue<std::string> requests(queueCapacity);
+    BoundedQueue<std::string> responses(queueCapacity);
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&]() {
+            std::string line;
+            while (requests.pop(line)) {
+                responses.push(handleRequest(system, settings, line));
+            }
+        });
+    }
+
+    // Flushes only when it runs out of work, so a burst of pipelined
+    // requests is written out in a few large writes.
+    std::thread writer([&]() {
+        std::string response;
+        while (responses.pop(response)) {
+            response.push_back('\n');
+            std::fwrite(response.data(), 1, response.size(), stdout);
+            if (responses.empty()) std::fflush(stdout);
+        }
+        std::fflush(stdout);
+    });
+
+    std::ios::sync_with_stdio(false);
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (trim(line).empty()) continue;
+        requests.push(std::move(line)); // Blocks while the workers are saturated
+    }
+
+    requests.close();
+    for (std::thread& worker : workers) worker.join();
+    responses.close();
+    writer.join();
+    return 0;
+}
@@ -0,0 +1,353 @@
+#include "metrosystem.h"
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+
+// Binary network snapshot. Layout (native byte order, checked via the
+// magic number):
+//
+//   SnapshotHeader
+//   offsets[stationCount + 1]          uint32
+//   targets[arcCount]                  uint32
+//   times[arcCount]                    int32
+//   costs[arcCount]                    int32
+//   lines[arcCount]                    uint32
+//   distances[arcCount]                double
+//   coordinates[stationCount * 2]      double (lon, lat)
+//   stationNameOffsets[stationCount+1] uint32, then the name bytes
+//   lineNameOffsets[lineCount + 1]     uint32, then the name bytes
+//
+// Every section starts on an 8-byte boundary so the arrays can be copied
+// straight out of the mapped file. The checksum covers everything after
+// the header. The header also records the size and modification time of
+// the CSV the network came from, so that loadMetroDataCached only takes a
+// snapshot for the very file it was built from, whatever the timestamps.
+
+namespace {
+
+constexpr uint32_t kSnapshotMagic = 0x50414E53; // "SNAP"
+constexpr uint32_t kSnapshotVersion = 3;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t checksum;
+    uint64_t payloadSize;
+    uint32_t stationCount;
+    uint32_t arcCount;
+    uint32_t lineCount;
+    uint32_t reserved;
+    uint64_t stationNameBytes;
+    uint64_t lineNameBytes;
+    uint64_t sourceSize;       // Of the CSV; 0 if not known
+    int64_t sourceModifiedMs;  // Of the CSV, since the epoch
+};
+static_assert(sizeof(SnapshotHeader) % 8 == 0, "SnapshotHeader must keep sections 8-byte aligned");
+
+// Checksum over 8-byte words in four independent lanes, so the multiplies
+// of neighbouring words overlap instead of waiting on each other. Each step
+// is a bijection of its lane for a given word, so any single changed word
+// changes the result.
+uint64_t payloadChecksum(const char* data, size_t size) {
+    constexpr uint64_t kMultiplier = 0x9E3779B97F4A7C15ULL;
+    auto mix = [](uint64_t lane, uint64_t word) {
+        lane = (lane ^ word) * kMultiplier;
+        return lane ^ (lane >> 29);
+    };
+    uint64_t lanes[4] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0x100000001b3ULL, size};
+    size_t at = 0;
+    for (; at + 32 <= size; at += 32) {
+        uint64_t words[4];
+        std::memcpy(words, data + at, sizeof(words));
+        for (int lane = 0; lane < 4; ++lane) lanes[lane] = mix(lanes[lane], words[lane]);
+    }
+    for (int lane = 0; at < size; at += 8, lane = (lane + 1) % 4) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + at, std::min<size_t>(8, size - at));
+        lanes[lane] = mix(lanes[lane], word);
+    }
+    uint64_t hash = size;
+    for (const uint64_t lane : lanes) hash = mix(hash, lane);
+    return hash;
+}
+
+size_t padded(size_t bytes) {
+    return (bytes + 7) & ~size_t(7);
+}
+
+class SnapshotWriter {
+public:
+    template <typename T>
+    void section(const T* data, size_t count) {
+        const size_t bytes = count * sizeof(T);
+        const size_t at = buffer_.size();
+        buffer_.resize(at + padded(bytes), '\0');
+        if (bytes) std::memcpy(&buffer_[at], data, bytes);
+    }
+    void strings(const std::vector<std::string>& values) {
+        std::vector<uint32_t> offsets(values.size() + 1, 0);
+        for (size_t i = 0; i < values.size(); ++i) {
+            offsets[i + 1] = offsets[i] + static_cast<uint32_t>(values[i].size());
+        }
+        section(offsets.data(), offsets.size());
+        std::string blob;
+        blob.reserve(offsets.back());
+        for (const std::string& value : values) blob += value;
+        section(blob.data(), blob.size());
+    }
+    const std::string& buffer() const { return buffer_; }
+
+private:
+    std::string buffer_;
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+    template <typename T>
+    bool section(std::vector<T>& out, size_t count) {
+        const size_t bytes = count * sizeof(T);
+        if (pos_ + padded(bytes) > size_) return false;
+        out.resize(count);
+        if (bytes) std::memcpy(out.data(), data_ + pos_, bytes);
+        pos_ += padded(bytes);
+        return true;
+    }
+    bool strings(std::vector<std::string>& out, size_t count, uint64_t blobBytes) {
+        std::vector<uint32_t> offsets;
+        if (!section(offsets, count + 1) || offsets.front() != 0 || offsets.back() != blobBytes) return false;
+        if (pos_ + padded(blobBytes) > size_) return false;
+        const char* blob = data_ + pos_;
+        out.clear();
+        out.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (offsets[i + 1] < offsets[i]) return false;
+            out.emplace_back(blob + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+        pos_ += padded(blobBytes);
+        return true;
+    }
+    bool atEnd() const { return pos_ == size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+std::string MetroSystem::snapshotPathFor(const std::string& csvFile) {
+    return csvFile + ".mfsnap";
+}
+
+bool MetroSystem::saveSnapshot(const std::string& filename, std::string& errorMsg) const {
+    const NetworkState& network = *loadedNetwork_;
+    const MetroGraph& graph = network.graph;
+    if (graph.empty()) {
+        errorMsg = "No network loaded, nothing to snapshot.";
+        return false;
+    }
+
+    std::vector<double> coordinates;
+    coordinates.reserve(stationNames_.size() * 2);
+    for (const QPointF& point : stationPoints_) {
+        coordinates.push_back(point.x());
+        coordinates.push_back(point.y());
+    }
+
+    SnapshotWriter payload;
+    payload.section(graph.offsets.data(), graph.offsets.size());
+    payload.section(graph.targets.data(), graph.targets.size());
+    payload.section(graph.times.data(), graph.times.size());
+    payload.section(graph.costs.data(), graph.costs.size());
+    payload.section(graph.lines.data(), graph.lines.size());
+    payload.section(graph.distances.data(), graph.distances.size());
+    payload.section(coordinates.data(), coordinates.size());
+    payload.strings(stationNames_);
+    payload.strings(network.lineNames);
+
+    SnapshotHeader header{};
+    header.magic = kSnapshotMagic;
+    header.version = kSnapshotVersion;
+    header.payloadSize = payload.buffer().size();
+    header.checksum = payloadChecksum(payload.buffer().data(), payload.buffer().size());
+    header.stationCount = static_cast<uint32_t>(stationNames_.size());
+    header.arcCount = static_cast<uint32_t>(graph.edgeCount());
+    header.lineCount = static_cast<uint32_t>(network.lineNames.size());
+    header.sourceSize = loadedSource_.size;
+    header.sourceModifiedMs = loadedSource_.modifiedMs;
+    for (const std::string& name : stationNames_) header.stationNameBytes += name.size();
+    for (const std::string& name : network.lineNames) header.lineNameBytes += name.size();
+
+    // QSaveFile writes to a temporary file and renames it on commit, so a
+    // reader never sees a half-written snapshot.
+    QSaveFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMsg = "Failed to open snapshot for writing: " + filename;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(payload.buffer().data(), static_cast<qint64>(payload.buffer().size()));
+    if (!file.commit()) {
+        errorMsg = "Failed to write snapshot: " + filename + " (" + file.errorString().toStdString() + ")";
+        return false;
+    }
+    return true;
+}
+
+bool MetroSystem::loadSnapshot(const std::string& filename, std::string& errorMsg) {
+    return loadSnapshot(filename, nullptr, errorMsg);
+}
+
+MetroSystem::SourceStamp MetroSystem::sourceStampOf(const std::string& filename) {
+    const QFileInfo info(QString::fromStdString(filename));
+    if (!info.exists()) return SourceStamp();
+    return SourceStamp{static_cast<uint64_t>(info.size()), info.lastModified().toMSecsSinceEpoch()};
+}
+
+bool MetroSystem::loadSnapshot(const std::string& filename, const SourceStamp* expectedSource, std::string& errorMsg) {
+    const auto loadStart = StatsClock::now();
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorMsg = "Failed to open snapshot: " + filename;
+        return false;
+    }
+    const qint64 fileSize = file.size();
+    if (fileSize < static_cast<qint64>(sizeof(SnapshotHeader))) {
+        errorMsg = "Snapshot is truncated: " + filename;
+        return false;
+    }
+    const char* data = reinterpret_cast<const char*>(file.map(0, fileSize));
+    if (!data) {
+        errorMsg = "Failed to map snapshot: " + filename;
+        return false;
+    }
+
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const char* payload = data + sizeof(header);
+    const size_t payloadSize = static_cast<size_t>(fileSize) - sizeof(header);
+    if (header.magic != kSnapshotMagic) {
+        errorMsg = "Not a network snapshot (bad magic): " + filename;
+        return false;
+    }
+    if (header.version != kSnapshotVersion) {
+        errorMsg = "Unsupported snapshot version " + std::to_string(header.version) + ": " + filename;
+        return false;
+    }
+    const SourceStamp source{header.sourceSize, header.sourceModifiedMs};
+    if (expectedSource && !(source == *expectedSource)) {
+        errorMsg = "Snapshot was built from another version of the CSV: " + filename;
+        return false;
+    }
+    if (header.payloadSize != payloadSize || header.checksum != payloadChecksum(payload, payloadSize)) {
+        errorMsg = "Snapshot checksum mismatch: " + filename;
+        return false;
+    }
+
+    MetroGraph graph;
+    std::vector<double> coordinates;
+    std::vector<std::string> stationNames;
+    std::vector<std::string> lineNames;
+    SnapshotReader reader(payload, payloadSize);
+    bool ok = reader.section(graph.offsets, size_t(header.stationCount) + 1)
+              && reader.section(graph.targets, header.arcCount)
+              && reader.section(graph.times, header.arcCount)
+              && reader.section(graph.costs, header.arcCount)
+              && reader.section(graph.lines, header.arcCount)
+              && reader.section(graph.distances, header.arcCount)
+              && reader.section(coordinates, size_t(header.stationCount) * 2)
+              && reader.strings(stationNames, header.stationCount, header.stationNameBytes)
+              && reader.strings(lineNames, header.lineCount, header.lineNameBytes)
+              && reader.atEnd();
+    ok = ok && graph.offsets.front() == 0 && graph.offsets.back() == header.arcCount;
+    for (size_t u = 0; ok && u < header.stationCount; ++u) {
+        ok = graph.offsets[u] <= graph.offsets[u + 1];
+    }
+    for (size_t i = 0; ok && i < header.arcCount; ++i) {
+        ok = graph.targets[i] < header.stationCount && graph.lines[i] < header.lineCount;
+    }
+    if (!ok) {
+        errorMsg = "Snapshot layout is inconsistent: " + filename;
+        return false;
+    }
+
+    graph.computeWeightRanges();
+    LoadTimings timings;
+    timings.fromSnapshot = true;
+    timings.readMs = millisecondsSince(loadStart);
+    const auto indexStart = StatsClock::now();
+
+    clearNetwork();
+    auto network = std::make_shared<NetworkState>();
+    network->graph = std::move(graph);
+    network->lineNames = std::move(lineNames);
+    stationNames_ = std::move(stationNames);
+    stationIds_.reserve(stationNames_.size());
+    stationCoordinates_.reserve(stationNames_.size());
+    stationPoints_.reserve(stationNames_.size());
+    for (StationId id = 0; id < stationNames_.size(); ++id) {
+        stationIds_.emplace(stationNames_[id], id);
+        stationPoints_.push_back(QPointF(coordinates[2 * id], coordinates[2 * id + 1]));
+        stationCoordinates_.emplace(stationNames_[id], stationPoints_.back());
+    }
+    stationSearch_.build(stationNames_);
+    network->maxSpeedKmPerMinute = computeAStarBound(network->graph);
+    network->transfers.build(network->graph);
+    loadedSource_ = source;
+    const size_t arcCount = network->graph.edgeCount();
+    publishLoadedNetwork(std::move(network));
+    timings.indexMs = millisecondsSince(indexStart);
+    timings.totalMs = millisecondsSince(loadStart);
+    loadTimings_ = timings;
+    qInfo() << "Metro snapshot loaded." << stationNames_.size() << "stations," << arcCount << "arcs.";
+    errorMsg = "";
+    return true;
+}
+
+bool MetroSystem::loadMetroDataCached(const std::string& csvFile, std::string& errorMsg, const LoadProgress& progress) {
+    const std::string snapshotFile = snapshotPathFor(csvFile);
+    QFileInfo csvInfo(QString::fromStdString(csvFile));
+    QFileInfo snapshotInfo(QString::fromStdString(snapshotFile));
+
+    // Without the CSV the snapshot is all there is; with it, the snapshot
+    // must have been built from this CSV, size and modification time alike
+    bool loaded = false;
+    if (snapshotInfo.exists()) {
+        const SourceStamp csvStamp = sourceStampOf(csvFile);
+        std::string snapshotError;
+        loaded = loadSnapshot(snapshotFile, csvInfo.exists() ? &csvStamp : nullptr, snapshotError);
+        if (loaded) {
+            if (progress) progress(100);
+        } else {
+            qWarning() << "Ignoring snapshot, rebuilding from CSV:" << QString::fromStdString(snapshotError);
+        }
+    }
+
+    if (!loaded) {
+        if (!loadMetroData(csvFile, errorMsg, progress)) {
+            return false;
+        }
+        std::string saveError;
+        if (!saveSnapshot(snapshotFile, saveError)) {
+            qWarning() << "Could not write network snapshot:" << QString::fromStdString(saveError);
+        }
+    }
+
+    // The network is usable without its timetable
+    const std::string timetableFile = timetablePathFor(csvFile);
+    if (QFileInfo::exists(QString::fromStdString(timetableFile))) {
+        std::string timetableError;
+        if (!loadTimetable(timetableFile, timetableError)) {
+            qWarning() << "Timetable not loaded:" << QString::fromStdString(timetableError);
+        }
+    }
+    errorMsg = "";
+    return true;
+}
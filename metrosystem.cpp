@@ -1,11 +1,10 @@
 #include "metrosystem.h"
-#include <fstream>
-#include <sstream>
-#include <queue>
-#include <iostream>
-#include <iomanip>
 #include <QDebug>   // For Qt style debugging output
+#include <QFile>    // For memory-mapping the CSV
 #include <algorithm> // For std::sort
+#include <cmath>
+#include "parallel.h"
+#include "searchkernels.h"
 
 // Utility function implementation
 std::string trim(const std::string& str) {
@@ -15,146 +14,338 @@ std::string trim(const std::string& str) {
     return str.substr(first, (last - first + 1));
 }
 
-MetroSystem::MetroSystem() {}
+// A change is a segment on another line than the one before it; the first
+// line boarded is not a change.
+void countTransfers(std::vector<PathSegment>& path) {
+    int transfers = 0;
+    const std::string* previousLine = nullptr;
+    for (PathSegment& segment : path) {
+        if (!segment.lineTakenToReach.empty()) {
+            if (previousLine && *previousLine != segment.lineTakenToReach) transfers++;
+            previousLine = &segment.lineTakenToReach;
+        }
+        segment.transfers = transfers;
+    }
+}
+
+MetroSystem::MetroSystem() : routeCache_(kDefaultRouteCacheCapacity) {
+    clearNetwork();
+}
+
+void MetroSystem::clearNetwork() {
+    publishLoadedNetwork(std::make_shared<NetworkState>());
+    stationNames_.clear();
+    stationIds_.clear();
+    stationSearch_.clear();
+    stationCoordinates_.clear();
+    stationPoints_.clear();
+    loadedSource_ = SourceStamp();
+    loadIssues_.clear();
+    timeHierarchy_.clear();
+    costHierarchy_.clear();
+    timetable_.clear();
+    routeCache_.clear();
+}
+
+// A freshly loaded network replaces both the base for live updates and what
+// queries see.
+void MetroSystem::publishLoadedNetwork(std::shared_ptr<NetworkState> network) {
+    network->version = ++networkVersion_;
+    std::lock_guard<std::mutex> lock(publishMutex_);
+    loadedNetwork_ = network;
+    std::atomic_store(&network_, std::shared_ptr<const NetworkState>(std::move(network)));
+}
+
+namespace {
+
+// Great-circle distance in km between two (longitude, latitude) points
+double haversineKm(const QPointF& a, const QPointF& b) {
+    constexpr double kEarthRadiusKm = 6371.0088;
+    constexpr double kDegToRad = 3.14159265358979323846 / 180.0;
+    const double dLat = (b.y() - a.y()) * kDegToRad;
+    const double dLon = (b.x() - a.x()) * kDegToRad;
+    const double h = std::sin(dLat / 2) * std::sin(dLat / 2)
+                     + std::cos(a.y() * kDegToRad) * std::cos(b.y() * kDegToRad) * std::sin(dLon / 2) * std::sin(dLon / 2);
+    return 2.0 * kEarthRadiusKm * std::asin(std::min(1.0, std::sqrt(h)));
+}
+
+// CSV chunk size bounds: enough chunks for every loader thread to get
+// several, but not so small that per-chunk interning stops paying off
+constexpr size_t kMinChunkBytes = 256 * 1024;
+constexpr size_t kMaxChunkBytes = 16 * 1024 * 1024;
+// Station names are merged in this many independent partitions by hash
+constexpr size_t kStationPartitions = 64;
+
+// Numbers the chunks' stations in order of first appearance across the
+// chunks, as if the rows had been read one by one. stationIds[c][i] is the
+// ID of chunk c's local station i, and firstSeen[id] the entry of the
+// chunk where station id first appears.
+//
+// Each partition of names is deduplicated on its own thread, walking the
+// chunks in order, which finds every name's first appearance. Those first
+// appearances are then counted per chunk, and a prefix sum over the
+// chunks turns them into IDs.
+void internChunkStations(const std::vector<MetroCsvChunk>& chunks, unsigned threads,
+                         std::vector<std::vector<StationId>>& stationIds, std::vector<const CsvStation*>& firstSeen) {
+    const size_t chunkCount = chunks.size();
+    auto pack = [](size_t chunk, size_t index) { return static_cast<uint64_t>(chunk) << 32 | index; };
+
+    // Each chunk's local stations grouped by partition (CSR)
+    std::vector<std::vector<uint32_t>> partitionOffsets(chunkCount);
+    std::vector<std::vector<uint32_t>> partitionOrder(chunkCount);
+    std::vector<std::vector<uint64_t>> firstOf(chunkCount); // Packed (chunk, index) of the first appearance
+    parallelFor(chunkCount, threads, [&](unsigned, size_t c) {
+        const std::vector<CsvStation>& stations = chunks[c].stations;
+        std::vector<uint32_t>& offsets = partitionOffsets[c];
+        offsets.assign(kStationPartitions + 1, 0);
+        for (const CsvStation& station : stations) offsets[station.hash % kStationPartitions + 1]++;
+        for (size_t p = 0; p < kStationPartitions; ++p) offsets[p + 1] += offsets[p];
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        partitionOrder[c].resize(stations.size());
+        for (uint32_t i = 0; i < stations.size(); ++i) partitionOrder[c][cursor[stations[i].hash % kStationPartitions]++] = i;
+        firstOf[c].resize(stations.size());
+    });
+
+    parallelFor(kStationPartitions, threads, [&](unsigned, size_t p) {
+        std::unordered_map<std::string_view, uint64_t> seen;
+        for (size_t c = 0; c < chunkCount; ++c) {
+            for (uint32_t k = partitionOffsets[c][p]; k < partitionOffsets[c][p + 1]; ++k) {
+                const uint32_t i = partitionOrder[c][k];
+                firstOf[c][i] = seen.emplace(chunks[c].stations[i].name, pack(c, i)).first->second;
+            }
+        }
+    });
+
+    std::vector<size_t> idOffsets(chunkCount + 1, 0);
+    parallelFor(chunkCount, threads, [&](unsigned, size_t c) {
+        for (size_t i = 0; i < firstOf[c].size(); ++i) idOffsets[c + 1] += firstOf[c][i] == pack(c, i);
+    });
+    for (size_t c = 0; c < chunkCount; ++c) idOffsets[c + 1] += idOffsets[c];
+
+    stationIds.assign(chunkCount, {});
+    firstSeen.assign(idOffsets.back(), nullptr);
+    parallelFor(chunkCount, threads, [&](unsigned, size_t c) {
+        stationIds[c].resize(firstOf[c].size());
+        StationId next = static_cast<StationId>(idOffsets[c]);
+        for (size_t i = 0; i < firstOf[c].size(); ++i) {
+            if (firstOf[c][i] != pack(c, i)) continue;
+            firstSeen[next] = &chunks[c].stations[i];
+            stationIds[c][i] = next++;
+        }
+    });
+    // Every other appearance takes the ID of the first, which lies in this
+    // or an earlier chunk and was numbered above
+    parallelFor(chunkCount, threads, [&](unsigned, size_t c) {
+        for (size_t i = 0; i < firstOf[c].size(); ++i) {
+            const uint64_t first = firstOf[c][i];
+            if (first != pack(c, i)) stationIds[c][i] = stationIds[first >> 32][first & 0xffffffffu];
+        }
+    });
+}
 
-// DEBUGGING VERSION of loadMetroData for 10-column CSV
-bool MetroSystem::loadMetroData(const std::string& filename, std::string& errorMsg) {
+} // namespace
+
+// The A* bound is straight-line distance / fastest straight-line speed seen
+// on any segment. Since no segment covers ground faster than that, the
+// bound never overestimates the remaining time.
+double MetroSystem::computeAStarBound(const MetroGraph& graph) const {
+    double maxSpeedKmPerMinute = 0.0;
+    for (StationId u = 0; u < graph.stationCount(); ++u) {
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            const double km = haversineKm(stationPoints_[u], stationPoints_[graph.targets[e]]);
+            if (!std::isfinite(km)) {
+                return 0.0;
+            }
+            if (km <= 0.0) continue;
+            if (graph.times[e] <= 0) {
+                // Covers distance in no time: no finite speed bounds it
+                return 0.0;
+            }
+            maxSpeedKmPerMinute = std::max(maxSpeedKmPerMinute, km / graph.times[e]);
+        }
+    }
+    return maxSpeedKmPerMinute;
+}
+
+// Keeps the bound admissible after a segment between a and b got this time
+void MetroSystem::raiseAStarBound(NetworkState& network, StationId a, StationId b, int time) const {
+    if (network.maxSpeedKmPerMinute <= 0.0) return;
+    const double km = haversineKm(stationPoints_[a], stationPoints_[b]);
+    if (km <= 0.0) return;
+    network.maxSpeedKmPerMinute = time > 0 ? std::max(network.maxSpeedKmPerMinute, km / time) : 0.0;
+}
+
+bool MetroSystem::hasAStarHeuristic() const {
+    return network()->maxSpeedKmPerMinute > 0.0;
+}
+
+void MetroSystem::setLoadThreads(unsigned threads) {
+    loadThreads_ = threads;
+}
+
+// Memory-maps the 10-column CSV and parses it in place, in chunks spread
+// over loadThreads_ threads. Rows that fail validation are skipped and
+// recorded in loadIssues_.
+bool MetroSystem::loadMetroData(const std::string& filename, std::string& errorMsg, const LoadProgress& progress) {
     qDebug() << "MetroSystem::loadMetroData called for file:" << QString::fromStdString(filename);
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+    QFile file(QString::fromStdString(filename));
+    const auto loadStart = StatsClock::now();
+    LoadTimings timings;
+    if (!file.open(QIODevice::ReadOnly)) {
         errorMsg = "Failed to open file: " + filename;
         qCritical() << "LOAD_DATA_ERROR:" << QString::fromStdString(errorMsg);
         return false;
     }
 
-    graph_.clear();
-    stationNames_.clear();
-    stationCoordinates_.clear();
-    std::string lineStr;
+    // Fall back to a plain read if the file cannot be mapped (e.g. a pipe).
+    QByteArray fallbackBuffer;
+    std::string_view text;
+    const qint64 fileSize = file.size();
+    if (fileSize > 0) {
+        if (uchar* mapped = file.map(0, fileSize)) {
+            text = std::string_view(reinterpret_cast<const char*>(mapped), static_cast<size_t>(fileSize));
+        } else {
+            fallbackBuffer = file.readAll();
+            text = std::string_view(fallbackBuffer.constData(), static_cast<size_t>(fallbackBuffer.size()));
+        }
+    }
+
+    clearNetwork();
+    loadedSource_ = sourceStampOf(filename);
+    auto network = std::make_shared<NetworkState>();
+    std::vector<std::string>& lineNames = network->lineNames;
+    timings.readMs = millisecondsSince(loadStart);
+    auto phaseStart = StatsClock::now();
+
+    size_t pos = 0;
+    auto nextLine = [&](std::string_view& line) {
+        if (pos >= text.size()) return false;
+        size_t newline = text.find('\n', pos);
+        if (newline == std::string_view::npos) newline = text.size();
+        line = text.substr(pos, newline - pos);
+        pos = newline + 1;
+        return true;
+    };
 
-    std::string headerLine;
-    if (!getline(file, headerLine)) {
+    std::string_view headerLine;
+    if (!nextLine(headerLine)) {
         errorMsg = "File is empty or failed to read header: " + filename;
         qCritical() << "LOAD_DATA_ERROR:" << QString::fromStdString(errorMsg);
-        file.close();
         return false;
     }
-    qDebug() << "CSV Header:" << QString::fromStdString(headerLine);
-
-    int lineNumber = 1;
+    qDebug() << "CSV Header:" << QString::fromStdString(std::string(trimView(headerLine)));
+
+    // The data lines are cut into chunks of whole lines, parsed in parallel
+    // with names interned per chunk, then merged in file order. Stations
+    // and lines get their IDs in order of first appearance in the file and
+    // edges stay in row order, exactly as a row-by-row load would have it.
+    const std::string_view body = text.substr(std::min(pos, text.size()));
+    const unsigned threads = loadThreads_ == 0 ? defaultThreadCount() : loadThreads_;
+    const size_t chunkBytes = std::clamp<size_t>(body.size() / (threads * 4), kMinChunkBytes, kMaxChunkBytes);
+    const std::vector<std::string_view> chunkTexts = splitCsvChunks(body, (body.size() + chunkBytes - 1) / chunkBytes);
+    std::vector<MetroCsvChunk> chunks(chunkTexts.size());
+    std::atomic<size_t> parsedBytes{0};
+    parallelFor(chunks.size(), threads, [&](unsigned worker, size_t i) {
+        parseMetroCsvChunk(chunkTexts[i], chunks[i]);
+        const size_t parsed = parsedBytes.fetch_add(chunkTexts[i].size()) + chunkTexts[i].size();
+        // Worker 0 is the loading thread itself
+        if (progress && worker == 0) progress(static_cast<int>(parsed * 90 / body.size()));
+    });
+
+    int lineNumber = 1; // The header
     int successfullyParsedRows = 0;
-
-    while (getline(file, lineStr)) {
-        lineNumber++;
-        if (trim(lineStr).empty()) {
-            continue;
+    std::vector<size_t> edgeOffsets(chunks.size() + 1, 0);
+    std::unordered_map<std::string_view, LineId> lineLookup;
+    std::vector<std::vector<LineId>> lineIds(chunks.size());
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        const MetroCsvChunk& chunk = chunks[c];
+        for (const LoadIssue& issue : chunk.issues) {
+            loadIssues_.push_back(LoadIssue{lineNumber + issue.lineNumber, issue.issue});
         }
-        qDebug().noquote() << "\n--- Processing CSV Line" << lineNumber << "---";
-        qDebug().noquote() << "Raw Line Content: " << QString::fromStdString(lineStr);
-
-        std::stringstream ss(lineStr);
-        std::string fromStation_csv, toStation_csv, timeStr_csv, distStr_csv, costStr_csv,
-            segmentLine_csv, // This is your 6th column "Line"
-            latFromStr_csv, lonFromStr_csv, latToStr_csv, lonToStr_csv;
-
-        bool readSuccess = true;
-        if (!getline(ss, fromStation_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, toStation_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, timeStr_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, distStr_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, costStr_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, segmentLine_csv, ',')) readSuccess = false; // 6th column
-        if (readSuccess && !getline(ss, latFromStr_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, lonFromStr_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, latToStr_csv, ',')) readSuccess = false;
-        if (readSuccess && !getline(ss, lonToStr_csv)) readSuccess = false;      // 10th column, read till end
-
-        if (!readSuccess) {
-            qWarning().noquote() << "PARSING_WARNING (Line " << lineNumber << "): Failed to read all 10 expected fields. Line might have too few columns or be malformed. Skipping line.";
-            qDebug().noquote() << "  Partial Raw Fields: FS=" << QString::fromStdString(fromStation_csv) << " TS=" << QString::fromStdString(toStation_csv) << "...";
-            continue;
+        lineNumber += chunk.lineCount;
+        successfullyParsedRows += static_cast<int>(chunk.edges.size());
+        edgeOffsets[c + 1] = edgeOffsets[c] + chunk.edges.size();
+        for (std::string_view name : chunk.lines) {
+            auto inserted = lineLookup.emplace(name, static_cast<LineId>(lineNames.size()));
+            if (inserted.second) lineNames.emplace_back(name);
+            lineIds[c].push_back(inserted.first->second);
         }
+    }
 
-        qDebug().noquote() << "  Raw Fields: FS=" << QString::fromStdString(fromStation_csv)
-                           << " TS=" << QString::fromStdString(toStation_csv)
-                           << " Time=" << QString::fromStdString(timeStr_csv)
-                           << " Dist=" << QString::fromStdString(distStr_csv)
-                           << " Cost=" << QString::fromStdString(costStr_csv)
-                           << " SegLine=" << QString::fromStdString(segmentLine_csv) // Changed name for clarity
-                           << " LatF=" << QString::fromStdString(latFromStr_csv)
-                           << " LonF=" << QString::fromStdString(lonFromStr_csv)
-                           << " LatT=" << QString::fromStdString(latToStr_csv)
-                           << " LonT=" << QString::fromStdString(lonToStr_csv);
-
-        std::string fromStation = trim(fromStation_csv);
-        std::string toStation = trim(toStation_csv);
-        std::string timeStr = trim(timeStr_csv);
-        std::string distStr = trim(distStr_csv);
-        std::string costStr = trim(costStr_csv);
-        std::string segmentLine = trim(segmentLine_csv); // This is the crucial line name
-        std::string latFromStr = trim(latFromStr_csv);
-        std::string lonFromStr = trim(lonFromStr_csv);
-        std::string latToStr = trim(latToStr_csv);
-        std::string lonToStr = trim(lonToStr_csv);
-
-        qDebug().noquote() << "  Trimmed Fields: FS=" << QString::fromStdString(fromStation)
-                           << " TS=" << QString::fromStdString(toStation)
-                           << " Time=" << QString::fromStdString(timeStr)
-                           << " SegLine=" << QString::fromStdString(segmentLine)
-                           << " LatF=" << QString::fromStdString(latFromStr)
-                           << " LonF=" << QString::fromStdString(lonFromStr)
-                           << " LatT=" << QString::fromStdString(latToStr)
-                           << " LonT=" << QString::fromStdString(lonToStr);
-
-        if (fromStation.empty() || toStation.empty() || timeStr.empty() || distStr.empty() || costStr.empty() ||
-            segmentLine.empty() || latFromStr.empty() || lonFromStr.empty() || latToStr.empty() || lonToStr.empty()) {
-            qWarning().noquote() << "PARSING_WARNING (Line " << lineNumber << "): Skipping line due to one or more critical fields being empty after trimming.";
-            continue;
+    std::vector<std::vector<StationId>> stationIds;
+    std::vector<const CsvStation*> firstSeen;
+    internChunkStations(chunks, threads, stationIds, firstSeen);
+    stationNames_.resize(firstSeen.size());
+    stationPoints_.resize(firstSeen.size());
+    std::vector<Edge> edges(edgeOffsets.back());
+    parallelFor(chunks.size(), threads, [&](unsigned, size_t c) {
+        const MetroCsvChunk& chunk = chunks[c];
+        for (size_t i = 0; i < chunk.stations.size(); ++i) {
+            const StationId id = stationIds[c][i];
+            if (firstSeen[id] != &chunk.stations[i]) continue;
+            stationNames_[id] = std::string(chunk.stations[i].name);
+            stationPoints_[id] = QPointF(chunk.stations[i].lon, chunk.stations[i].lat);
         }
-
-        try {
-            int timeVal = std::stoi(timeStr);
-            double distanceVal = std::stod(distStr);
-            int costVal = std::stoi(costStr);
-            double latFrom = std::stod(latFromStr);
-            double lonFrom = std::stod(lonFromStr);
-            double latTo = std::stod(latToStr);
-            double lonTo = std::stod(lonToStr);
-
-            qDebug().noquote() << "    Converted Numerics: Time=" << timeVal << " Cost=" << costVal
-                               << " LatF=" << latFrom << " LonF=" << lonFrom << " LatT=" << latTo << " LonT=" << lonTo;
-
-            if (stationCoordinates_.find(fromStation) == stationCoordinates_.end()) {
-                stationCoordinates_[fromStation] = QPointF(lonFrom, latFrom);
+        for (size_t i = 0; i < chunk.edges.size(); ++i) {
+            Edge edge = chunk.edges[i];
+            edge.from = stationIds[c][edge.from];
+            edge.to = stationIds[c][edge.to];
+            edge.line = lineIds[c][edge.line];
+            edges[edgeOffsets[c] + i] = edge;
+        }
+    });
+    chunks.clear();
+
+    timings.parseMs = millisecondsSince(phaseStart);
+    phaseStart = StatsClock::now();
+    network->graph.build(stationNames_.size(), edges, threads);
+    timings.buildMs = millisecondsSince(phaseStart);
+    phaseStart = StatsClock::now();
+    // The name tables, the A* bound and the state graph do not depend on
+    // each other
+    parallelFor(4, threads, [&](unsigned, size_t task) {
+        if (task == 0) {
+            stationIds_.reserve(stationNames_.size());
+            for (StationId id = 0; id < stationNames_.size(); ++id) {
+                stationIds_.emplace(stationNames_[id], id);
             }
-            if (stationCoordinates_.find(toStation) == stationCoordinates_.end()) {
-                stationCoordinates_[toStation] = QPointF(lonTo, latTo);
+        } else if (task == 1) {
+            stationCoordinates_.reserve(stationNames_.size());
+            for (StationId id = 0; id < stationNames_.size(); ++id) {
+                stationCoordinates_.emplace(stationNames_[id], stationPoints_[id]);
             }
-
-            graph_[fromStation].push_back(Edge(toStation, timeVal, distanceVal, costVal, segmentLine));
-            graph_[toStation].push_back(Edge(fromStation, timeVal, distanceVal, costVal, segmentLine));
-
-            stationNames_.insert(fromStation);
-            stationNames_.insert(toStation);
-            successfullyParsedRows++;
-
-        } catch (const std::invalid_argument& e) {
-            qWarning().noquote() << "PARSING_ERROR (Line " << lineNumber << "): Invalid numeric argument for a field: " << e.what() << ". Skipping line.";
-        } catch (const std::out_of_range& e) {
-            qWarning().noquote() << "PARSING_ERROR (Line " << lineNumber << "): Out of range numeric value for a field: " << e.what() << ". Skipping line.";
+        } else if (task == 2) {
+            stationSearch_.build(stationNames_);
+            network->maxSpeedKmPerMinute = computeAStarBound(network->graph);
+        } else {
+            network->transfers.build(network->graph);
         }
-    }
+    });
+    timings.indexMs = millisecondsSince(phaseStart);
     file.close();
+    timings.totalMs = millisecondsSince(loadStart);
+    loadTimings_ = timings;
+    if (progress) progress(100);
+
     qDebug() << "Finished parsing file. Total data lines processed:" << (lineNumber -1);
+    qDebug() << "Load phases (ms): read" << timings.readMs << "parse" << timings.parseMs << "build" << timings.buildMs
+             << "index" << timings.indexMs << "total" << timings.totalMs;
     qDebug() << "Successfully parsed rows into graph:" << successfullyParsedRows;
+    if (!loadIssues_.empty()) {
+        const LoadIssue& first = loadIssues_.front();
+        qWarning().noquote() << "PARSING_WARNING:" << loadIssues_.size() << "line(s) skipped; first at line"
+                             << first.lineNumber << "(" << csvIssueDescription(first.issue) << "). See getLoadIssues().";
+    }
 
-    if (graph_.empty() && (lineNumber-1 > 0 && successfullyParsedRows == 0) ) {
+    const bool empty = network->graph.empty();
+    publishLoadedNetwork(std::move(network));
+    if (empty && (lineNumber-1 > 0 && successfullyParsedRows == 0) ) {
         errorMsg = "No data loaded from file or file format incorrect after parsing: " + filename;
         qCritical() << "LOAD_DATA_FINAL_ERROR:" << QString::fromStdString(errorMsg);
         qCritical() << "All " << (lineNumber-1) << " data lines were skipped or failed parsing. Check warnings above.";
         return false;
     }
-    if (graph_.empty() && (lineNumber-1 == 0)){
+    if (empty && (lineNumber-1 == 0)){
         errorMsg = "No data lines found in file after header: " + filename;
         qCritical() << "LOAD_DATA_FINAL_ERROR:" << QString::fromStdString(errorMsg);
         return false;
@@ -170,152 +361,434 @@ const std::unordered_map<std::string, QPointF>& MetroSystem::getStationCoordinat
     return stationCoordinates_;
 }
 
-std::vector<std::string> MetroSystem::getStationNames() const {
-    std::vector<std::string> names(stationNames_.begin(), stationNames_.end());
-    std::sort(names.begin(), names.end());
-    return names;
+const std::vector<LoadIssue>& MetroSystem::getLoadIssues() const {
+    return loadIssues_;
 }
 
-const Edge* MetroSystem::findEdge(const std::string& from, const std::string& to) const {
-    auto it = graph_.find(from);
-    if (it != graph_.end()) {
-        for (const auto& edge : it->second) {
-            if (edge.to == to) {
-                return &edge;
+namespace {
+
+size_t stringBytes(const std::string& s) {
+    // Short strings live inside the object itself
+    return s.capacity() > sizeof(std::string) - 1 ? s.capacity() + 1 : 0;
+}
+
+// Buckets plus one node (key, value, next pointer, cached hash) per entry
+template <typename Map>
+size_t hashMapBytes(const Map& map) {
+    size_t bytes = map.bucket_count() * sizeof(void*)
+                   + map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+    for (const auto& entry : map) bytes += stringBytes(entry.first);
+    return bytes;
+}
+
+} // namespace
+
+size_t MetroSystem::memoryFootprint() const {
+    // The loaded network, plus the live one when updates are in force
+    const std::shared_ptr<const NetworkState> live = network();
+    size_t bytes = 0;
+    for (const NetworkState* state : {loadedNetwork_.get(), live.get()}) {
+        if (state == live.get() && live == loadedNetwork_) break;
+        bytes += state->graph.memoryFootprint();
+        bytes += state->transfers.memoryFootprint();
+        bytes += state->lineNames.capacity() * sizeof(std::string);
+        for (const std::string& name : state->lineNames) bytes += stringBytes(name);
+    }
+    bytes += stationNames_.capacity() * sizeof(std::string);
+    for (const std::string& name : stationNames_) bytes += stringBytes(name);
+    bytes += hashMapBytes(stationIds_);
+    bytes += stationSearch_.memoryFootprint();
+    bytes += hashMapBytes(stationCoordinates_);
+    bytes += stationPoints_.capacity() * sizeof(QPointF);
+    bytes += loadIssues_.capacity() * sizeof(LoadIssue);
+    bytes += timeHierarchy_.memoryFootprint() + costHierarchy_.memoryFootprint();
+    bytes += timetable_.memoryFootprint();
+    return bytes;
+}
+
+std::vector<MapSegment> MetroSystem::getMapSegments() const {
+    const std::shared_ptr<const NetworkState> network = this->network();
+    const MetroGraph& graph = network->graph;
+    std::vector<MapSegment> segments;
+    segments.reserve(graph.edgeCount() / 2);
+    for (StationId u = 0; u < graph.stationCount(); ++u) {
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            StationId v = graph.targets[e];
+            // Each segment is stored as two arcs; keep one. Closed arcs
+            // point back at their own station and are left out.
+            if (u < v) {
+                segments.push_back(MapSegment{stationPoints_[u], stationPoints_[v], network->lineNames[graph.lines[e]]});
             }
         }
     }
-    return nullptr;
+    return segments;
 }
 
-std::vector<PathSegment> MetroSystem::findPathLeastStops(const std::string& start, const std::string& end) {
-    if (graph_.find(start) == graph_.end() || graph_.find(end) == graph_.end()) return {};
-    if (start == end) return {PathSegment(start, "", 0, 0, true)};
+std::vector<std::string> MetroSystem::getStationNames() const {
+    std::vector<std::string> names;
+    names.reserve(stationNames_.size());
+    for (StationId id : stationSearch_.sortedStations()) names.push_back(stationNames_[id]);
+    return names;
+}
 
-    std::unordered_map<std::string, std::string> parentNode;
-    std::unordered_map<std::string, bool> visited;
-    std::queue<std::string> q;
+std::vector<std::string> MetroSystem::findStations(const std::string& query, size_t limit) const {
+    std::vector<StationId> matches;
+    stationSearch_.search(query, limit, matches);
+    std::vector<std::string> names;
+    names.reserve(matches.size());
+    for (StationId id : matches) names.push_back(stationNames_[id]);
+    return names;
+}
 
-    visited[start] = true;
-    q.push(start);
-    bool found = false;
+bool MetroSystem::hasStation(const std::string& name) const {
+    return stationId(name) != kInvalidStation;
+}
 
-    while (!q.empty()) {
-        std::string curr = q.front(); q.pop();
-        if (curr == end) {
-            found = true;
-            break;
-        }
-        auto it = graph_.find(curr);
-        if (it != graph_.end()) {
-            for (const auto& edge : it->second) {
-                if (visited.find(edge.to) == visited.end()) {
-                    visited[edge.to] = true;
-                    parentNode[edge.to] = curr;
-                    q.push(edge.to);
-                }
-            }
+StationId MetroSystem::stationId(const std::string& name) const {
+    auto it = stationIds_.find(name);
+    return it != stationIds_.end() ? it->second : kInvalidStation;
+}
+
+PathSegment MetroSystem::segmentFor(const NetworkState& network, StationId station, EdgeId e) const {
+    const MetroGraph& graph = network.graph;
+    PathSegment segment(stationNames_[station], network.lineNames[graph.lines[e]], graph.times[e], graph.costs[e]);
+    segment.distanceForSegment = graph.distances[e];
+    return segment;
+}
+
+// Walks the parent arcs left in workspace back from end; each station's
+// segment is the exact arc its label was last set through.
+template <typename Value>
+std::vector<PathSegment> MetroSystem::buildPath(const NetworkState& network, StationId start, StationId end,
+                                                const SearchWorkspace<Value>& workspace) const {
+    METRO_STAT(ReconstructTimer reconstructTimer);
+    size_t hops = 0;
+    for (StationId v = end; v != start; v = workspace.parent(v)) {
+        if (workspace.parentEdge(v) == kInvalidEdge) {
+            qCritical() << "Path reconstruction broken for:" << QString::fromStdString(stationNames_[v]);
+            return {};
         }
+        hops++;
+    }
+    std::vector<PathSegment> path;
+    path.reserve(hops + 1);
+    for (StationId v = end; v != start; v = workspace.parent(v)) {
+        path.push_back(segmentFor(network, v, workspace.parentEdge(v)));
     }
+    path.push_back(PathSegment(stationNames_[start], "", 0, 0, true));
+    std::reverse(path.begin(), path.end());
+    countTransfers(path);
+    return path;
+}
 
+// Same as above, for a path given as (station reached, arc used) steps.
+std::vector<PathSegment> MetroSystem::buildPath(const NetworkState& network, StationId start,
+                                                const std::vector<ContractionHierarchy::PathStep>& steps) const {
+    METRO_STAT(ReconstructTimer reconstructTimer);
     std::vector<PathSegment> path;
-    if (found) {
-        std::string currentStation = end;
-        std::string prevStation;
-        while (currentStation != start) {
-            if (parentNode.find(currentStation) == parentNode.end()) {
-                qCritical() << "BFS Path reconstruction broken for:" << QString::fromStdString(currentStation);
-                return {};
-            }
-            prevStation = parentNode[currentStation];
-            const Edge* e = findEdge(prevStation, currentStation);
-            if (!e) {
-                qCritical() << "Critical error: Edge not found during BFS path reconstruction from" << QString::fromStdString(prevStation) << "to" << QString::fromStdString(currentStation);
-                return {};
-            }
-            path.push_back(PathSegment(currentStation, e->line, e->time, e->cost));
-            currentStation = prevStation;
-        }
-        path.push_back(PathSegment(start, "", 0, 0, true));
-        std::reverse(path.begin(), path.end());
+    path.reserve(steps.size() + 1);
+    path.push_back(PathSegment(stationNames_[start], "", 0, 0, true));
+    for (const auto& step : steps) {
+        path.push_back(segmentFor(network, step.first, step.second));
     }
+    countTransfers(path);
     return path;
 }
 
-std::vector<PathSegment> MetroSystem::dijkstra(const std::string& start, const std::string& end, const std::string& criteria) {
-    if (graph_.find(start) == graph_.end() || graph_.find(end) == graph_.end()) return {};
-    if (start == end) return {PathSegment(start, "", 0, 0, true)};
+// One instantiation per (weight, queue) pair; HopWeight + FifoQueue is the
+// BFS behind findPathLeastStops, the heap and bucket variants are Dijkstra.
+template <typename Weight, typename Queue>
+std::vector<PathSegment> MetroSystem::shortestPath(const NetworkState& network, StationId start, StationId end, Queue& queue,
+                                                   const CancelFlag* cancel) const {
+    SearchWorkspace<typename Weight::Value>& workspace = threadSearchWorkspace<typename Weight::Value>();
+    const bool found = runShortestPathKernel<Weight>(network.graph, start, queue, workspace,
+                                                     [end, cancel](StationId v, typename Weight::Value) {
+                                                         return v == end || isCancelled(cancel);
+                                                     });
+    if (!found || isCancelled(cancel)) return {};
+    return buildPath(network, start, end, workspace);
+}
 
-    std::unordered_map<std::string, long long> accumulatedValue;
-    std::unordered_map<std::string, std::string> parentNode;
+std::vector<PathSegment> MetroSystem::bfs(const NetworkState& network, StationId start, StationId end, const CancelFlag* cancel) const {
+    thread_local FifoQueue<HopWeight::Value> queue;
+    return shortestPath<HopWeight>(network, start, end, queue, cancel);
+}
 
-    auto cmp = [&](const std::pair<long long, std::string>& a, const std::pair<long long, std::string>& b) {
-        return a.first > b.first;
-    };
-    std::priority_queue<std::pair<long long, std::string>, std::vector<std::pair<long long, std::string>>, decltype(cmp)> pq(cmp);
+template <typename Weight>
+std::vector<PathSegment> MetroSystem::dijkstra(const NetworkState& network, StationId start, StationId end,
+                                               const CancelFlag* cancel) const {
+    return withThreadDijkstraQueue<Weight>(network.graph, [&](auto& queue) {
+        return shortestPath<Weight>(network, start, end, queue, cancel);
+    });
+}
 
-    for (const auto& stationName : stationNames_) {
-        accumulatedValue[stationName] = std::numeric_limits<long long>::max();
-    }
-    accumulatedValue[start] = 0;
-    pq.push({0, start});
+std::vector<PathSegment> MetroSystem::astar(const NetworkState& network, StationId startId, StationId endId,
+                                            const CancelFlag* cancel) const {
+    if (network.maxSpeedKmPerMinute <= 0.0) return dijkstra<TimeWeight>(network, startId, endId, cancel);
+    const MetroGraph& graph = network.graph;
+    SearchWorkspace<long long>& workspace = threadSearchWorkspace<long long>();
+    workspace.reset(graph.stationCount());
+
+    // Scaled down slightly so rounding can never make the bound exceed
+    // the true remaining time.
+    const double minutesPerKm = (1.0 - 1e-9) / network.maxSpeedKmPerMinute;
+    const QPointF& goal = stationPoints_[endId];
+    auto estimate = [&](StationId v) { return haversineKm(stationPoints_[v], goal) * minutesPerKm; };
+
+    // Heap ordered on g + h; g travels along so stale entries can be
+    // recognised. The heap's storage is kept for the thread's next search.
+    struct Entry {
+        double key;
+        long long time;
+        StationId node;
+    };
+    auto cmp = [](const Entry& a, const Entry& b) { return a.key > b.key; };
+    thread_local std::vector<Entry> heap;
+    heap.clear();
+
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    workspace.label(startId, 0, kInvalidStation, kInvalidEdge);
+    heap.push_back({estimate(startId), 0, startId});
+    METRO_STAT(counters.pushes++);
     bool found = false;
 
-    while (!pq.empty()) {
-        auto top = pq.top(); pq.pop();
-        long long currentAccVal = top.first;
-        std::string currNode = top.second;
-
-        if (accumulatedValue.count(currNode) && currentAccVal > accumulatedValue[currNode]) {
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        const Entry top = heap.back();
+        heap.pop_back();
+        if (top.time > workspace.distance(top.node)) {
+            METRO_STAT(counters.stalePops++);
             continue;
         }
-        if (currNode == end) {
+        if (isCancelled(cancel)) return {};
+        METRO_STAT(counters.settled++);
+        if (top.node == endId) {
             found = true;
             break;
         }
-
-        auto it = graph_.find(currNode);
-        if (it != graph_.end()) {
-            for (const auto& edge : it->second) {
-                int weight = (criteria == "time") ? edge.time : edge.cost;
-                if (accumulatedValue[currNode] != std::numeric_limits<long long>::max() &&
-                    (!accumulatedValue.count(edge.to) || accumulatedValue[currNode] + weight < accumulatedValue[edge.to])) {
-                    accumulatedValue[edge.to] = accumulatedValue[currNode] + weight;
-                    parentNode[edge.to] = currNode;
-                    pq.push({accumulatedValue[edge.to], edge.to});
-                }
+        METRO_STAT(counters.relaxed += graph.edgesEnd(top.node) - graph.edgesBegin(top.node));
+        for (EdgeId e = graph.edgesBegin(top.node); e < graph.edgesEnd(top.node); ++e) {
+            StationId next = graph.targets[e];
+            long long candidate = top.time + graph.times[e];
+            if (candidate < workspace.distance(next)) {
+                workspace.label(next, candidate, top.node, e);
+                heap.push_back({candidate + estimate(next), candidate, next});
+                std::push_heap(heap.begin(), heap.end(), cmp);
+                METRO_STAT(counters.pushes++);
             }
         }
     }
 
-    std::vector<PathSegment> path;
-    if (found) {
-        std::string currentStation = end;
-        std::string prevStation;
-        while (currentStation != start) {
-            if (parentNode.find(currentStation) == parentNode.end()) {
-                qCritical() << "Dijkstra Path reconstruction broken for:" << QString::fromStdString(currentStation);
-                return {};
-            }
-            prevStation = parentNode[currentStation];
-            const Edge* e = findEdge(prevStation, currentStation);
-            if (!e) {
-                qCritical() << "Critical error: Edge not found during Dijkstra path reconstruction from" << QString::fromStdString(prevStation) << "to" << QString::fromStdString(currentStation);
-                return {};
-            }
-            path.push_back(PathSegment(currentStation, e->line, e->time, e->cost));
-            currentStation = prevStation;
+    if (!found) return {};
+    return buildPath(network, startId, endId, workspace);
+}
+
+// Only time and cost have hierarchies, and only for the loaded network.
+// Hierarchy queries take microseconds, so they are not cancellable.
+//
+// Live updates that only close arcs or make them dearer can make no route
+// better than it was when the hierarchies were built, so a hierarchy route
+// that uses none of the changed arcs is still a best one. Any other route,
+// and every route while an update has made something faster, cheaper or
+// added a temporary segment, comes from Dijkstra instead; the query's
+// counters record it as a hierarchy fallback.
+std::vector<PathSegment> MetroSystem::hierarchyPath(const NetworkState& network, StationId startId, StationId endId,
+                                                    RouteCriterion criterion) {
+    auto fallback = [&]() {
+        METRO_STAT(threadSearchCounters().hierarchyFallbacks++);
+        return criterion == RouteCriterion::Time ? dijkstra<TimeWeight>(network, startId, endId, nullptr)
+                                                 : dijkstra<CostWeight>(network, startId, endId, nullptr);
+    };
+    const bool disrupted = !network.disruptions.empty();
+    const bool lowered = criterion == RouteCriterion::Time ? network.timeLowered : network.costLowered;
+    if (disrupted && (lowered || !network.disruptions.temporarySegments.empty())) return fallback();
+    {
+        std::lock_guard<std::mutex> lock(hierarchyMutex_);
+        if (!hasContractionHierarchies()) {
+            buildHierarchiesLocked();
         }
-        path.push_back(PathSegment(start, "", 0, 0, true));
-        std::reverse(path.begin(), path.end());
+    }
+    const ContractionHierarchy& hierarchy = (criterion == RouteCriterion::Time) ? timeHierarchy_ : costHierarchy_;
+    thread_local std::vector<ContractionHierarchy::PathStep> steps;
+    if (!hierarchy.query(startId, endId, steps)) return {}; // Nor can updates that make nothing better connect it
+    if (disrupted) {
+        // Without temporary segments the loaded EdgeIds are the network's
+        const uint8_t stale = kArcClosed | (criterion == RouteCriterion::Time ? kArcTimeChanged : kArcCostChanged);
+        for (const ContractionHierarchy::PathStep& step : steps) {
+            if (network.loadedArcChanges[step.second] & stale) return fallback();
+        }
+    }
+    return buildPath(network, startId, steps);
+}
+
+void MetroSystem::setSearchEngine(SearchEngine engine) {
+    if (engine != searchEngine_) {
+        routeCache_.clear(); // Engines may break ties between equal routes differently
+    }
+    searchEngine_ = engine;
+}
+
+SearchEngine MetroSystem::searchEngine() const {
+    return searchEngine_;
+}
+
+void MetroSystem::buildContractionHierarchies() {
+    std::lock_guard<std::mutex> lock(hierarchyMutex_);
+    buildHierarchiesLocked();
+}
+
+void MetroSystem::buildHierarchiesLocked() {
+    const MetroGraph& graph = loadedNetwork_->graph;
+    timeHierarchy_.build(graph, graph.times);
+    costHierarchy_.build(graph, graph.costs);
+    qInfo() << "Contraction hierarchies built:" << timeHierarchy_.shortcutCount() << "time shortcuts,"
+            << costHierarchy_.shortcutCount() << "cost shortcuts.";
+}
+
+bool MetroSystem::hasContractionHierarchies() const {
+    return !timeHierarchy_.empty() && !costHierarchy_.empty();
+}
+
+// The criterion is resolved here, once per query; everything below runs a
+// kernel specialised for it. Engines that do not support a criterion fall
+// back to Dijkstra.
+std::vector<PathSegment> MetroSystem::computePath(const NetworkState& network, StationId start, StationId end,
+                                                  RouteCriterion criterion, const CancelFlag* cancel) {
+    switch (criterion) {
+    case RouteCriterion::LeastStops:
+        if (searchEngine_ == SearchEngine::Bidirectional) return bidirectionalBfs(network, start, end, cancel);
+        return bfs(network, start, end, cancel);
+    case RouteCriterion::Time:
+        if (searchEngine_ == SearchEngine::ContractionHierarchy) return hierarchyPath(network, start, end, criterion);
+        if (searchEngine_ == SearchEngine::AStar) return astar(network, start, end, cancel);
+        if (searchEngine_ == SearchEngine::Bidirectional) return bidirectionalDijkstra(network, start, end, criterion, cancel);
+        return dijkstra<TimeWeight>(network, start, end, cancel);
+    case RouteCriterion::Cost:
+        if (searchEngine_ == SearchEngine::ContractionHierarchy) return hierarchyPath(network, start, end, criterion);
+        if (searchEngine_ == SearchEngine::Bidirectional) return bidirectionalDijkstra(network, start, end, criterion, cancel);
+        return dijkstra<CostWeight>(network, start, end, cancel);
+    case RouteCriterion::Distance:
+        if (searchEngine_ == SearchEngine::Bidirectional) return bidirectionalDijkstra(network, start, end, criterion, cancel);
+        return dijkstra<DistanceWeight>(network, start, end, cancel);
+    }
+    return {};
+}
+
+namespace {
+
+// The network is undirected, so a route read backwards is a route in the
+// other direction: each station keeps the segment that led to it.
+std::vector<PathSegment> reversePath(const std::vector<PathSegment>& path) {
+    std::vector<PathSegment> reversed;
+    if (path.empty()) return reversed;
+    reversed.reserve(path.size());
+    reversed.push_back(PathSegment(path.back().stationName, "", 0, 0, true));
+    for (size_t i = path.size() - 1; i > 0; --i) {
+        const PathSegment& via = path[i];
+        PathSegment segment(path[i - 1].stationName, via.lineTakenToReach, via.timeForSegment, via.costForSegment);
+        segment.distanceForSegment = via.distanceForSegment;
+        reversed.push_back(std::move(segment));
+    }
+    countTransfers(reversed);
+    return reversed;
+}
+
+} // namespace
+
+// Names are resolved to IDs here, once. Routes are cached under (lower ID,
+// higher ID, criterion), stored in the lower -> higher direction, and
+// reversed when the query runs the other way.
+std::vector<PathSegment> MetroSystem::cachedPath(const std::string& start, const std::string& end, RouteCriterion criterion,
+                                                 const CancelFlag* cancel, bool& cacheHit) {
+    StationId startId = stationId(start);
+    StationId endId = stationId(end);
+    if (startId == kInvalidStation || endId == kInvalidStation) return {};
+    if (startId == endId) return {PathSegment(start, "", 0, 0, true)};
+
+    const RouteKey key{std::min(startId, endId), std::max(startId, endId), criterion};
+    const bool forward = startId == key.first;
+    std::vector<PathSegment> path;
+    if (routeCache_.lookup(key, path)) {
+        cacheHit = true;
+        return forward ? path : reversePath(path);
+    }
+    const std::shared_ptr<const NetworkState> network = this->network();
+    path = computePath(*network, startId, endId, criterion, cancel);
+    if (isCancelled(cancel)) return {};
+    // Only cache what is still true: if an update was published during the
+    // search, its cache invalidation may already have run.
+    std::lock_guard<std::mutex> lock(publishMutex_);
+    if (network_ == network) {
+        routeCache_.insert(key, forward ? path : reversePath(path));
     }
     return path;
 }
 
+RouteCacheStats MetroSystem::routeCacheStats() const {
+    return RouteCacheStats{routeCache_.hits(), routeCache_.misses(), routeCache_.size(), routeCache_.capacity()};
+}
+
+void MetroSystem::setRouteCacheCapacity(size_t capacity) {
+    routeCache_.setCapacity(capacity);
+}
+
+void MetroSystem::clearRouteCache() {
+    routeCache_.clear();
+}
+
+MetroStats MetroSystem::statistics() const {
+    MetroStats stats;
+    for (size_t i = 0; i < latency_.size(); ++i) stats.latency[i] = latency_[i].snapshot();
+    stats.searchTotals = searchTotals_.sum();
+    stats.searches = searchTotals_.searches();
+    stats.load = loadTimings_;
+    stats.cache = routeCacheStats();
+    return stats;
+}
+
+void MetroSystem::resetStatistics() {
+    for (LatencyHistogram& histogram : latency_) histogram.reset();
+    searchTotals_.reset();
+}
+
+std::vector<PathSegment> MetroSystem::findPathLeastStops(const std::string& start, const std::string& end) {
+    return findPath(start, end, RouteCriterion::LeastStops);
+}
+
 std::vector<PathSegment> MetroSystem::findPathByTime(const std::string& start, const std::string& end) {
-    return dijkstra(start, end, "time");
+    return findPath(start, end, RouteCriterion::Time);
 }
 
 std::vector<PathSegment> MetroSystem::findPathByCost(const std::string& start, const std::string& end) {
-    return dijkstra(start, end, "cost");
+    return findPath(start, end, RouteCriterion::Cost);
+}
+
+std::vector<PathSegment> MetroSystem::findPathByDistance(const std::string& start, const std::string& end) {
+    return findPath(start, end, RouteCriterion::Distance);
+}
+
+// Kernels add to this thread's counters while the query runs (searchstats.h);
+// they are cleared first and folded into the totals afterwards.
+std::vector<PathSegment> MetroSystem::findPath(const std::string& start, const std::string& end, RouteCriterion criterion,
+                                               const CancelFlag* cancel, SearchStats* stats) {
+    bool cacheHit = false;
+#if METRO_ENABLE_STATS
+    const auto queryStart = StatsClock::now();
+    SearchCounters& counters = threadSearchCounters();
+    counters = SearchCounters();
+    std::vector<PathSegment> path = cachedPath(start, end, criterion, cancel, cacheHit);
+    const double totalMs = millisecondsSince(queryStart);
+    latency_[static_cast<size_t>(criterion)].record(totalMs * 1000.0);
+    if (!cacheHit) searchTotals_.add(counters);
+    if (stats) {
+        stats->counters = counters;
+        stats->totalMs = totalMs;
+        stats->reconstructMs = counters.reconstructNanos / 1e6;
+        stats->cacheHit = cacheHit;
+    }
+    return path;
+#else
+    if (stats) *stats = SearchStats();
+    return cachedPath(start, end, criterion, cancel, cacheHit);
+#endif
 }
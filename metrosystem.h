@@ -4,14 +4,31 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <set>
 #include <limits>
 #include <algorithm>
 #include <utility> // For std::move
-// #include <tuple>   // Not needed if getAllUniqueEdges is removed
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <mutex>
+#include <array>
+#include <tuple>
 
 #include <QPointF> // For storing geographic coordinates
 
+#include "metrograph.h"
+#include "metrocsv.h"
+#include "networkanalytics.h"
+#include "contractionhierarchy.h"
+#include "lrucache.h"
+#include "searchstats.h"
+#include "searchworkspace.h"
+#include "timetable.h"
+#include "transfergraph.h"
+#include "stationsearchindex.h"
+
 // PathSegment Struct Definition
 struct PathSegment {
     std::string stationName;
@@ -19,47 +36,456 @@ struct PathSegment {
     int timeForSegment;
     int costForSegment;
     bool isFirstSegment = false;
+    double distanceForSegment = 0.0;
+    int waitForSegment = 0; // Timetable routes: minutes waited for the vehicle before this segment
+    int transfers = 0;      // Changes of line from the start up to and including this segment
 
     PathSegment(std::string name, std::string line = "", int time = 0, int cost = 0, bool first = false)
         : stationName(std::move(name)), lineTakenToReach(std::move(line)),
         timeForSegment(time), costForSegment(cost), isFirstSegment(first) {}
 };
 
-// Edge Struct Definition
-struct Edge {
-    std::string to;
-    int time;
-    double distance; // Still present from CSV, though not primary for pathfinding types here
-    int cost;
-    std::string line; // This should be the line of the track segment
+// Utility function
+std::string trim(const std::string& str);
+// Fills in PathSegment::transfers along a path from its line names
+void countTransfers(std::vector<PathSegment>& path);
 
-    Edge(const std::string& t, int ti, double d, int c, const std::string& l)
-        : to(t), time(ti), distance(d), cost(c), line(l) {}
+// One track segment as drawn on a map
+struct MapSegment {
+    QPointF from; // (longitude, latitude)
+    QPointF to;
+    std::string line;
 };
 
-// Utility function
-std::string trim(const std::string& str);
+// What a route is optimised for
+enum class RouteCriterion {
+    LeastStops,
+    Time,
+    Cost,
+    Distance
+};
+
+// Result of computeRouteMatrix. All tables are row-major, origins x
+// destinations; entries are -1 where no route exists or a name is unknown.
+struct RouteMatrix {
+    std::vector<std::string> origins;
+    std::vector<std::string> destinations;
+    RouteCriterion criterion = RouteCriterion::Time;
+    std::vector<long long> time;
+    std::vector<long long> cost;
+    std::vector<double> distance;
+    std::vector<int> hops;
+    std::vector<std::vector<PathSegment>> paths; // Filled only when requested
+
+    size_t index(size_t origin, size_t destination) const { return origin * destinations.size() + destination; }
+};
+
+// A station found by reachableWithin and what it takes to get there
+struct ReachableStation {
+    std::string station;
+    long long value; // Stops, minutes or cost, as the criterion says
+};
+
+// Stations of one isochrone band: reachable within upTo, but not within
+// the bound of the band before it
+struct IsochroneBand {
+    long long upTo;
+    std::vector<std::string> stations;
+};
+
+struct RouteCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t size;
+    size_t capacity;
+};
+
+// Aggregates since construction or resetStatistics(). Search counters and
+// latencies are collected only when built with METRO_ENABLE_STATS (see
+// searchstats.h) and stay zero otherwise; load timings are always kept.
+struct MetroStats {
+    std::array<LatencyHistogram::Snapshot, 4> latency; // findPath calls per RouteCriterion, cache hits included
+    SearchCounters searchTotals; // Summed over the searches that ran, i.e. not cache hits
+    uint64_t searches = 0;
+    LoadTimings load;             // Last load only
+    RouteCacheStats cache{};
+};
+
+// What findPathWithTransfers adds to a route per change of line
+struct TransferPenalties {
+    int minutes = 5; // Time routes
+    int cost = 0;    // Cost routes
+};
+
+// One route of a Pareto set: no other route of the set is at least as
+// good on time, cost and changes of line together
+struct ParetoRoute {
+    std::vector<PathSegment> path;
+    long long time = 0;
+    long long cost = 0;
+    int transfers = 0;
+};
+
+// Which search answers the findPath* methods
+enum class SearchEngine {
+    Dijkstra,             // Plain BFS / Dijkstra on the CSR graph (default)
+    ContractionHierarchy, // Bidirectional upward search on a preprocessed hierarchy
+    AStar,                // Time queries guided by a straight-line bound; cost queries use Dijkstra
+    Bidirectional         // BFS and Dijkstra grown from both ends until they meet
+};
+
+// Set from another thread to abandon a running query; the query then
+// returns an empty route, which is not cached.
+using CancelFlag = std::atomic<bool>;
+
+inline bool isCancelled(const CancelFlag* cancel) {
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
 
+// Called during loading with the share of the input processed so far (0-100)
+using LoadProgress = std::function<void(int percent)>;
+
+// One change to the live network, applied with MetroSystem::applyUpdates.
+// A segment is named by its two stations, in either order, and a line;
+// with the line left empty the change covers every line between the two.
+struct NetworkUpdate {
+    enum class Kind {
+        CloseStation,          // from: routes may neither pass through nor end at it
+        ReopenStation,         // from
+        CloseSegment,          // from, to, line
+        ReopenSegment,         // from, to, line
+        SetSegmentWeights,     // from, to, line; time and/or cost (-1 keeps the current value)
+        AddTemporarySegment,   // from, to, line (may be a new line), time, cost, distance
+        RemoveTemporarySegment // from, to, line
+    };
+    Kind kind = Kind::CloseSegment;
+    std::string from;
+    std::string to;
+    std::string line;
+    int time = -1;
+    int cost = -1;
+    double distance = 0.0; // km, temporary segments only
+};
+
+// Route queries may run concurrently from several threads, and so may
+// applyUpdates(). Loading, and switching the search engine, must not
+// overlap with queries.
 class MetroSystem {
 public:
     MetroSystem();
 
-    bool loadMetroData(const std::string& filename, std::string& errorMsg);
-    std::vector<std::string> getStationNames() const;
+    bool loadMetroData(const std::string& filename, std::string& errorMsg, const LoadProgress& progress = nullptr);
+    // Threads that parse the CSV and build the graph (0 = one per core).
+    // The loaded network is the same whatever the count.
+    void setLoadThreads(unsigned threads);
+
+    // Binary snapshot of the fully built network (see metrosnapshot.cpp).
+    // loadMetroDataCached uses the snapshot next to the CSV when it was
+    // built from that CSV as it is now (same size and modification time),
+    // otherwise parses the CSV and rewrites the snapshot. It
+    // also loads the timetable next to the CSV (timetablePathFor) if there
+    // is one.
+    bool saveSnapshot(const std::string& filename, std::string& errorMsg) const;
+    bool loadSnapshot(const std::string& filename, std::string& errorMsg);
+    bool loadMetroDataCached(const std::string& csvFile, std::string& errorMsg, const LoadProgress& progress = nullptr);
+    static std::string snapshotPathFor(const std::string& csvFile);
+
+    // Timetable routing (timetablerouting.cpp). The timetable file lists
+    // service patterns per line (see README) and is compiled against the
+    // loaded network, so it has to be loaded after it; loading the network
+    // again drops it. findEarliestArrival answers "leaving at
+    // departureMinute (minutes after midnight), when can I be there at the
+    // earliest" with the Connection Scan Algorithm: segment times are the
+    // scheduled ones, waitForSegment holds the time spent waiting on the
+    // platform, and changing vehicles takes at least transferMinutes.
+    // Closures from live updates are honoured; changed weights and
+    // temporary segments are not, as they have no schedule. Results are
+    // not cached.
+    bool loadTimetable(const std::string& filename, std::string& errorMsg,
+                       int transferMinutes = Timetable::kDefaultTransferMinutes);
+    bool hasTimetable() const;
+    static std::string timetablePathFor(const std::string& csvFile);
+    std::vector<PathSegment> findEarliestArrival(const std::string& start, const std::string& end, int departureMinute,
+                                                 const CancelFlag* cancel = nullptr) const;
+
+    // Transfer-aware routing (transferrouting.cpp). Every network carries
+    // its (station, line) state graph (transfergraph.h), in which changing
+    // lines is a step of its own. Time and cost routes are searched there
+    // with the penalty added per change, so a route changes lines only
+    // where that saves more than the penalty; boarding at the start is
+    // free. Reported segment times and costs are the real ones. Stops and
+    // distance have no penalty and are answered as by findPath. Live
+    // updates are honoured. Results are not cached.
+    std::vector<PathSegment> findPathWithTransfers(const std::string& start, const std::string& end,
+                                                   RouteCriterion criterion, const TransferPenalties& penalties,
+                                                   const CancelFlag* cancel = nullptr);
+
+    // Multi-criteria routing (paretorouting.cpp). findParetoRoutes returns,
+    // fastest first, every route that no other beats on time, cost and
+    // changes of line at once, from one search over the state graph; the
+    // fastest, the cheapest and the one with fewest changes are among them.
+    // Routes with more than maxTransfers changes are left out. Live updates
+    // are honoured. Results are not cached.
+    static constexpr int kDefaultParetoTransfers = 5;
+    std::vector<ParetoRoute> findParetoRoutes(const std::string& start, const std::string& end,
+                                              int maxTransfers = kDefaultParetoTransfers,
+                                              const CancelFlag* cancel = nullptr) const;
+
+    // Alternative routes (alternativeroutes.cpp). findAlternativeRoutes
+    // returns up to k routes that visit no station twice, best first by
+    // criterion: the best route, then the best one not listed yet, and so
+    // on. The same stations on another line make another route. The spur
+    // searches of each step may be spread over `threads` workers (0 = one
+    // per core); they are short, so one thread is usually fastest. Live
+    // updates are honoured.
+    // Results are not cached.
+    std::vector<std::vector<PathSegment>> findAlternativeRoutes(const std::string& start, const std::string& end,
+                                                                RouteCriterion criterion, size_t k,
+                                                                unsigned threads = 1,
+                                                                const CancelFlag* cancel = nullptr) const;
+
+    std::vector<std::string> getStationNames() const; // Alphabetical, ignoring case
+    // Type-ahead lookup: the best `limit` stations for what was typed so
+    // far, best first (see stationsearchindex.h for the ranking)
+    std::vector<std::string> findStations(const std::string& query, size_t limit) const;
+    bool hasStation(const std::string& name) const;
     const std::unordered_map<std::string, QPointF>& getStationCoordinates() const;
+    const std::vector<LoadIssue>& getLoadIssues() const; // Rows skipped by the last load
+    std::vector<MapSegment> getMapSegments() const;       // Each track segment once
+    // Approximate bytes held by the network, lookup tables and hierarchies
+    // (the route cache is not included)
+    size_t memoryFootprint() const;
+
+    // Selecting ContractionHierarchy builds the hierarchies on first use if
+    // buildContractionHierarchies() has not been called after the last load.
+    void setSearchEngine(SearchEngine engine);
+    SearchEngine searchEngine() const;
+    void buildContractionHierarchies();
+    bool hasContractionHierarchies() const;
+    // False when the coordinates give no usable bound; A* then falls back to Dijkstra
+    bool hasAStarHeuristic() const;
 
-    // Pathfinding methods remain the same
+    // Live updates (networkupdates.cpp). A batch is checked as a whole and
+    // then published at once: queries already running finish on the
+    // network they started with, later ones see every change of the batch.
+    // The updates are kept on top of the loaded network until
+    // clearUpdates() or the next load. The contraction hierarchies describe
+    // the loaded network: while updates are in force they still answer a
+    // route that none of the changed segments lies on, as long as no update
+    // has made anything faster or cheaper or added a segment; otherwise
+    // ContractionHierarchy queries run Dijkstra (SearchCounters::hierarchyFallbacks).
+    bool applyUpdates(const std::vector<NetworkUpdate>& updates, std::string& errorMsg);
+    void clearUpdates();
+    bool hasUpdates() const;
+    uint64_t networkVersion() const; // Changes with every load and every applied batch
+
+    // Pathfinding methods remain the same. Results are served from a bounded
+    // LRU cache when the same pair (in either direction) was asked before;
+    // loading data or switching engines empties it.
     std::vector<PathSegment> findPathLeastStops(const std::string& start, const std::string& end);
     std::vector<PathSegment> findPathByTime(const std::string& start, const std::string& end);
     std::vector<PathSegment> findPathByCost(const std::string& start, const std::string& end);
+    std::vector<PathSegment> findPathByDistance(const std::string& start, const std::string& end);
+    // stats, if given, receives the counters and timings of this call
+    std::vector<PathSegment> findPath(const std::string& start, const std::string& end, RouteCriterion criterion,
+                                      const CancelFlag* cancel = nullptr, SearchStats* stats = nullptr);
+
+    RouteCacheStats routeCacheStats() const;
+    void setRouteCacheCapacity(size_t capacity);
+    void clearRouteCache();
+
+    MetroStats statistics() const;
+    void resetStatistics();
+
+    // Many-to-many routing. Each origin is settled once by a one-to-many
+    // search that stops when every destination is reached; origins are
+    // spread over `threads` worker threads (0 = one per core).
+    RouteMatrix computeRouteMatrix(const std::vector<std::string>& origins,
+                                   const std::vector<std::string>& destinations,
+                                   RouteCriterion criterion,
+                                   bool includePaths = false,
+                                   unsigned threads = 0) const;
+
+    // One-to-all queries (reachability.cpp). reachableWithin lists every
+    // station reachable from source within budget, nearest first and
+    // source included, by LeastStops, Time or Cost; Distance is not
+    // supported and gives an empty list. The search stops at the budget and
+    // uses a workspace kept by the calling thread, so repeated calls do not
+    // allocate. The many-source form spreads the sources over `threads`
+    // workers (0 = one per core); entry i belongs to sources[i].
+    std::vector<ReachableStation> reachableWithin(const std::string& source, RouteCriterion criterion,
+                                                  long long budget) const;
+    std::vector<std::vector<ReachableStation>> reachableWithin(const std::vector<std::string>& sources,
+                                                               RouteCriterion criterion, long long budget,
+                                                               unsigned threads = 0) const;
+    // One search up to the last bound, split into bands; bounds must be ascending
+    std::vector<IsochroneBand> isochroneBands(const std::string& source, RouteCriterion criterion,
+                                              const std::vector<long long>& bounds) const;
+
+    // Network analytics (networkanalytics.cpp). computeCentrality ranks
+    // stations and segments by betweenness (networkanalytics.h) for
+    // LeastStops, Time or Cost; Distance is not supported and gives an
+    // empty result. With sampleSources 0 it is exact, one search from every
+    // station; otherwise that many sources are drawn at random from seed
+    // and the sums scaled up, for networks too large for the exact answer.
+    // Sources are spread over `threads` workers (0 = one per core). Live
+    // updates are honoured.
+    NetworkCentrality computeCentrality(RouteCriterion criterion, size_t sampleSources = 0, unsigned threads = 0,
+                                        uint64_t seed = 1, const CancelFlag* cancel = nullptr) const;
 
 private:
-    std::unordered_map<std::string, std::vector<Edge>> graph_;
-    std::set<std::string> stationNames_;
+    static constexpr size_t kDefaultRouteCacheCapacity = 4096;
+
+    // Cache key: the two endpoints ordered by ID, plus the criterion
+    struct RouteKey {
+        StationId first;
+        StationId second;
+        RouteCriterion criterion;
+        bool operator==(const RouteKey& other) const {
+            return first == other.first && second == other.second && criterion == other.criterion;
+        }
+    };
+    struct RouteKeyHash {
+        size_t operator()(const RouteKey& key) const {
+            uint64_t packed = (uint64_t(key.first) << 32) | key.second;
+            return std::hash<uint64_t>()(packed * 31 + static_cast<uint64_t>(key.criterion));
+        }
+    };
+
+    // A segment in the update bookkeeping; a <= b, line kAnyLine for all lines
+    static constexpr LineId kAnyLine = std::numeric_limits<LineId>::max();
+    struct SegmentKey {
+        StationId a;
+        StationId b;
+        LineId line;
+        bool operator<(const SegmentKey& other) const {
+            return std::tie(a, b, line) < std::tie(other.a, other.b, other.line);
+        }
+        bool covers(StationId u, StationId v, LineId arcLine) const {
+            return ((u == a && v == b) || (u == b && v == a)) && (line == kAnyLine || line == arcLine);
+        }
+    };
+    // Live updates in force, applied on top of the loaded network
+    struct Disruptions {
+        std::set<StationId> closedStations;
+        std::set<SegmentKey> closedSegments;
+        std::map<SegmentKey, std::pair<int, int>> weights; // (time, cost), -1 = unchanged
+        std::map<SegmentKey, Edge> temporarySegments;       // Keyed by their own line
+        std::vector<std::string> extraLines; // Lines first named by a temporary segment; IDs follow the loaded ones
+        bool empty() const {
+            return closedStations.empty() && closedSegments.empty() && weights.empty() && temporarySegments.empty();
+        }
+    };
+    // Everything a query reads that live updates can change. A published
+    // state is never modified: applyUpdates derives a new one and swaps the
+    // pointer, so a query that took a state keeps a consistent network
+    // until it finishes, and an update never waits for queries.
+    struct NetworkState {
+        MetroGraph graph;                   // Frozen CSR graph over station IDs
+        std::vector<std::string> lineNames; // LineId -> line name
+        // Fastest straight-line speed over any segment (km per minute), or 0
+        // if the coordinates cannot give an admissible A* bound
+        double maxSpeedKmPerMinute = 0.0;
+        TransferGraph transfers; // (station, line) states over graph
+        Disruptions disruptions; // How graph differs from the loaded network
+        // Per arc of the loaded graph, by its EdgeId there, how the
+        // disruptions changed it (ArcChange bits); empty while there are
+        // none. The hierarchies and the timetable only know the loaded
+        // graph, so they read this rather than graph.
+        std::vector<uint8_t> loadedArcChanges;
+        bool timeLowered = false; // Some loaded arc got faster
+        bool costLowered = false; // Some loaded arc got cheaper
+        uint64_t version = 0;
+    };
+    enum ArcChange : uint8_t { kArcClosed = 1, kArcTimeChanged = 2, kArcCostChanged = 4 };
+
+    // Size and modification time of the CSV the loaded network came from;
+    // snapshots record it (see loadMetroDataCached). Zero when not known.
+    struct SourceStamp {
+        uint64_t size = 0;
+        int64_t modifiedMs = 0;
+        bool operator==(const SourceStamp& other) const { return size == other.size && modifiedMs == other.modifiedMs; }
+    };
+    static SourceStamp sourceStampOf(const std::string& filename);
+    SourceStamp loadedSource_;
+
+    std::shared_ptr<const NetworkState> loadedNetwork_; // As loaded; hierarchies and snapshots use this
+    std::shared_ptr<const NetworkState> network_;       // What queries see; read with network()
+    uint64_t networkVersion_ = 0;
+    std::mutex updateMutex_;  // One applyUpdates at a time
+    std::mutex publishMutex_; // Swapping network_ and invalidating the cache vs. inserting into it
+    std::vector<std::string> stationNames_;                 // StationId -> name
+    std::unordered_map<std::string, StationId> stationIds_; // name -> StationId
+    StationSearchIndex stationSearch_;
     std::unordered_map<std::string, QPointF> stationCoordinates_; // To store station coordinates
+    std::vector<QPointF> stationPoints_;                    // StationId -> (longitude, latitude)
+    std::vector<LoadIssue> loadIssues_;
+
+    SearchEngine searchEngine_ = SearchEngine::Dijkstra;
+    ContractionHierarchy timeHierarchy_;
+    ContractionHierarchy costHierarchy_;
+    std::mutex hierarchyMutex_; // Guards building the hierarchies on first use
+    Timetable timetable_;       // Over the loaded graph's arcs
+
+    LruCache<RouteKey, std::vector<PathSegment>, RouteKeyHash> routeCache_;
+
+    std::array<LatencyHistogram, 4> latency_; // By RouteCriterion
+    SearchCounterTotals searchTotals_;
+    LoadTimings loadTimings_;
+    unsigned loadThreads_ = 0;
+
+    void clearNetwork();
+    void publishLoadedNetwork(std::shared_ptr<NetworkState> network);
+    std::shared_ptr<const NetworkState> network() const { return std::atomic_load(&network_); }
+    double computeAStarBound(const MetroGraph& graph) const;
+    void raiseAStarBound(NetworkState& network, StationId a, StationId b, int time) const;
+    std::shared_ptr<NetworkState> deriveNetwork(const Disruptions& disruptions) const;
+    // expectedSource, if given, must match the snapshot's or it is refused
+    bool loadSnapshot(const std::string& filename, const SourceStamp* expectedSource, std::string& errorMsg);
+    StationId stationId(const std::string& name) const;
+    PathSegment segmentFor(const NetworkState& network, StationId station, EdgeId e) const;
+    template <typename Value>
+    std::vector<PathSegment> buildPath(const NetworkState& network, StationId start, StationId end,
+                                       const SearchWorkspace<Value>& workspace) const;
+    std::vector<PathSegment> buildPath(const NetworkState& network, StationId start,
+                                       const std::vector<ContractionHierarchy::PathStep>& steps) const;
+    std::vector<PathSegment> cachedPath(const std::string& start, const std::string& end, RouteCriterion criterion,
+                                        const CancelFlag* cancel, bool& cacheHit);
+    std::vector<PathSegment> computePath(const NetworkState& network, StationId start, StationId end,
+                                         RouteCriterion criterion, const CancelFlag* cancel);
+    void buildHierarchiesLocked();
+
+    // Search kernels specialised per weight and queue policy (searchkernels.h)
+    template <typename Weight, typename Queue>
+    std::vector<PathSegment> shortestPath(const NetworkState& network, StationId start, StationId end, Queue& queue,
+                                          const CancelFlag* cancel) const;
+    template <typename Weight>
+    std::vector<PathSegment> dijkstra(const NetworkState& network, StationId start, StationId end, const CancelFlag* cancel) const;
+    std::vector<PathSegment> bfs(const NetworkState& network, StationId start, StationId end, const CancelFlag* cancel) const;
+    template <typename Weight>
+    std::vector<PathSegment> transferPath(const NetworkState& network, StationId start, StationId end,
+                                          typename Weight::Value penalty, const CancelFlag* cancel) const;
+    std::vector<ParetoRoute> paretoRoutes(const NetworkState& network, StationId start, StationId end, int maxTransfers,
+                                          const CancelFlag* cancel) const;
+    template <typename Weight>
+    std::vector<std::vector<PathSegment>> alternativeRoutes(const NetworkState& network, StationId start, StationId end,
+                                                            size_t k, unsigned threads, const CancelFlag* cancel) const;
+    template <typename Weight, typename Queue>
+    void fillRouteMatrix(const NetworkState& network, RouteMatrix& matrix, bool includePaths, unsigned threads,
+                         const Queue& queue) const;
+
+    template <typename Weight>
+    void collectReachable(const NetworkState& network, StationId source, long long budget,
+                          std::vector<ReachableStation>& stations) const;
+    void reachable(const NetworkState& network, StationId source, RouteCriterion criterion, long long budget,
+                   std::vector<ReachableStation>& stations) const;
 
-    const Edge* findEdge(const std::string& from, const std::string& to) const;
-    std::vector<PathSegment> dijkstra(const std::string& start, const std::string& end, const std::string& criteria);
+    std::vector<PathSegment> hierarchyPath(const NetworkState& network, StationId start, StationId end, RouteCriterion criterion);
+    std::vector<PathSegment> bidirectionalBfs(const NetworkState& network, StationId start, StationId end,
+                                              const CancelFlag* cancel) const;
+    std::vector<PathSegment> bidirectionalDijkstra(const NetworkState& network, StationId start, StationId end,
+                                                   RouteCriterion criterion, const CancelFlag* cancel) const;
+    std::vector<PathSegment> astar(const NetworkState& network, StationId start, StationId end, const CancelFlag* cancel) const;
 };
 
 #endif // METROSYSTEM_H
@@ -0,0 +1,1092 @@
+// Behaviour tests, run by ctest next to engineequivalence.
+//
+// Each test loads a small hand-built network whose answers are known and
+// checks MetroSystem against them through its public interface. A failed
+// check prints its file, line and expression and the run carries on, so
+// one run reports every failure.
+//
+//   ./metrotests [name ...]   (all tests without arguments)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "metrosystem.h"
+#include "parallel.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* expression, const char* file, int line) {
+    if (ok) return;
+    failures++;
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+}
+
+#define CHECK(expression) check((expression), #expression, __FILE__, __LINE__)
+
+// For a test that cannot go on
+void fail(const char* what) {
+    failures++;
+    std::fprintf(stderr, "failed: %s\n", what);
+}
+
+// One segment of a hand-built network
+struct Row {
+    std::string from;
+    std::string to;
+    std::string line;
+    int time;
+    int cost;
+    double distance = 1.0;
+};
+
+// A network CSV in a temporary file, removed again with the object.
+// Stations get made-up coordinates in order of first appearance.
+class TestNetwork {
+public:
+    explicit TestNetwork(const std::vector<Row>& rows) {
+        static int count = 0;
+        path_ = (std::filesystem::temp_directory_path() /
+                 ("metrotests-" + std::to_string(getpid()) + "-" + std::to_string(++count) + ".csv"))
+                    .string();
+        write(rows);
+    }
+    ~TestNetwork() {
+        std::filesystem::remove(path_);
+        std::filesystem::remove(MetroSystem::snapshotPathFor(path_));
+        std::filesystem::remove(MetroSystem::timetablePathFor(path_));
+    }
+    TestNetwork(const TestNetwork&) = delete;
+    TestNetwork& operator=(const TestNetwork&) = delete;
+
+    // Replaces the CSV's contents with text as it is
+    void writeText(const std::string& text) const {
+        std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+
+    // Replaces the CSV's contents
+    void write(const std::vector<Row>& rows) const {
+        std::unordered_map<std::string, int> index;
+        auto position = [&index](const std::string& station) {
+            const int i = index.emplace(station, static_cast<int>(index.size())).first->second;
+            return std::to_string(28.5 + 0.01 * i) + "," + std::to_string(77.2 + 0.01 * (i % 7));
+        };
+        std::ofstream file(path_, std::ios::trunc);
+        file << "From Station,To Station,Time (min),Distance (km),Cost (INR),Line,From Lat,From Lon,To Lat,To Lon\n";
+        for (const Row& row : rows) {
+            const std::string from = position(row.from);
+            file << row.from << "," << row.to << "," << row.time << "," << row.distance << "," << row.cost << ","
+                 << row.line << "," << from << "," << position(row.to) << "\n";
+        }
+    }
+
+    const std::string& path() const { return path_; }
+
+    bool load(MetroSystem& system) const {
+        std::string errorMsg;
+        const bool ok = system.loadMetroData(path_, errorMsg);
+        if (!ok) std::fprintf(stderr, "Could not load %s: %s\n", path_.c_str(), errorMsg.c_str());
+        return ok;
+    }
+
+private:
+    std::string path_;
+};
+
+int totalTime(const std::vector<PathSegment>& path) {
+    int time = 0;
+    for (const PathSegment& segment : path) time += segment.timeForSegment;
+    return time;
+}
+
+int totalCost(const std::vector<PathSegment>& path) {
+    int cost = 0;
+    for (const PathSegment& segment : path) cost += segment.costForSegment;
+    return cost;
+}
+
+std::vector<std::string> linesOf(const std::vector<PathSegment>& path) {
+    std::vector<std::string> lines;
+    for (const PathSegment& segment : path) lines.push_back(segment.lineTakenToReach);
+    return lines;
+}
+
+// Same stations, lines, weights and changes, segment by segment
+bool sameRoute(const std::vector<PathSegment>& a, const std::vector<PathSegment>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].stationName != b[i].stationName || a[i].lineTakenToReach != b[i].lineTakenToReach
+            || a[i].timeForSegment != b[i].timeForSegment || a[i].costForSegment != b[i].costForSegment
+            || a[i].transfers != b[i].transfers) {
+            return false;
+        }
+    }
+    return true;
+}
+
+NetworkUpdate setWeights(const std::string& from, const std::string& to, const std::string& line, int time, int cost = -1) {
+    NetworkUpdate update;
+    update.kind = NetworkUpdate::Kind::SetSegmentWeights;
+    update.from = from;
+    update.to = to;
+    update.line = line;
+    update.time = time;
+    update.cost = cost;
+    return update;
+}
+
+NetworkUpdate update(NetworkUpdate::Kind kind, const std::string& from, const std::string& to = "",
+                     const std::string& line = "") {
+    NetworkUpdate update;
+    update.kind = kind;
+    update.from = from;
+    update.to = to;
+    update.line = line;
+    return update;
+}
+
+bool apply(MetroSystem& system, const std::vector<NetworkUpdate>& updates) {
+    std::string errorMsg;
+    const bool ok = system.applyUpdates(updates, errorMsg);
+    if (!ok) std::fprintf(stderr, "Update failed: %s\n", errorMsg.c_str());
+    return ok;
+}
+
+// ---- Loading ----
+
+// Rows that cannot be read are skipped and reported by line number, the
+// same with one loader thread or several; the rest load as written
+void testCsvLoadIssues() {
+    const TestNetwork network({});
+    network.writeText("From Station,To Station,Time (min),Distance (km),Cost (INR),Line,From Lat,From Lon,To Lat,To Lon\n"
+                      "A,B,5,1.0,20,Red,28.50,77.20,28.51,77.21\n"
+                      "A,B,5,1.0,20\n"
+                      "B,  ,5,1.0,20,Red,28.51,77.21,28.52,77.22\n"
+                      "B,C,soon,1.0,20,Red,28.51,77.21,28.52,77.22\n"
+                      "B,C,99999999999,1.0,20,Red,28.51,77.21,28.52,77.22\n"
+                      "\n"
+                      " B , C ,7min,1.5,30,Red,28.51,77.21,28.52,77.22\r\n"
+                      "C,D,3,1.0,10,Blue,28.52,77.22,28.53,77.23");
+    const std::vector<std::pair<int, CsvIssue>> expected = {
+        {3, CsvIssue::MissingFields}, {4, CsvIssue::EmptyField}, {5, CsvIssue::InvalidNumber}, {6, CsvIssue::OutOfRange}};
+
+    for (const unsigned threads : {1u, 4u}) {
+        MetroSystem system;
+        system.setLoadThreads(threads);
+        if (!network.load(system)) return fail("load");
+        std::vector<std::pair<int, CsvIssue>> issues;
+        for (const LoadIssue& issue : system.getLoadIssues()) issues.emplace_back(issue.lineNumber, issue.issue);
+        CHECK(issues == expected);
+        CHECK(system.getStationNames() == std::vector<std::string>({"A", "B", "C", "D"}));
+        const std::vector<PathSegment> path = system.findPathByTime("A", "D");
+        CHECK(totalTime(path) == 15); // "7min" reads as 7, like std::stoi
+        CHECK(totalCost(path) == 60);
+        CHECK(linesOf(path) == std::vector<std::string>({"", "Red", "Red", "Blue"}));
+    }
+
+    MetroSystem missing;
+    std::string errorMsg;
+    CHECK(!missing.loadMetroData(network.path() + ".missing", errorMsg));
+    CHECK(!errorMsg.empty());
+}
+
+// ---- Route cache ----
+
+// A route asked for the other way round is the cached one reversed; a
+// load empties the cache, and an update drops the routes it changes and
+// keeps the others
+void testRouteCache() {
+    const std::vector<Row> rows = {{"A", "B", "Red", 2, 10}, {"B", "C", "Red", 3, 10}, {"C", "D", "Blue", 4, 15}};
+    const TestNetwork network(rows);
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    MetroSystem uncached;
+    if (!network.load(uncached)) return fail("load");
+    uncached.setRouteCacheCapacity(0);
+
+    const std::vector<PathSegment> forward = system.findPathByTime("A", "D");
+    CHECK(system.routeCacheStats().misses == 1 && system.routeCacheStats().hits == 0);
+    const std::vector<PathSegment> backward = system.findPathByTime("D", "A");
+    CHECK(system.routeCacheStats().hits == 1 && system.routeCacheStats().size == 1);
+    CHECK(sameRoute(backward, uncached.findPathByTime("D", "A")));
+    CHECK(linesOf(backward) == std::vector<std::string>({"", "Blue", "Red", "Red"}));
+    CHECK(backward.back().transfers == 1);
+    CHECK(uncached.routeCacheStats().hits == 0);
+    system.findPathByCost("A", "D"); // Another criterion is another entry
+    CHECK(system.routeCacheStats().misses == 2 && system.routeCacheStats().size == 2);
+
+    // Loading again starts from an empty cache
+    network.write({{"A", "B", "Red", 2, 10}, {"B", "C", "Red", 9, 10}, {"C", "D", "Blue", 4, 15}});
+    if (!network.load(system)) return fail("load");
+    CHECK(system.routeCacheStats().size == 0);
+    CHECK(totalTime(system.findPathByTime("D", "A")) == 15);
+    network.write(rows);
+    if (!network.load(system)) return fail("load");
+
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 9);
+    CHECK(totalTime(system.findPathByTime("A", "B")) == 2);
+    CHECK(apply(system, {setWeights("C", "D", "", 10)}));
+    const uint64_t hits = system.routeCacheStats().hits;
+    CHECK(totalTime(system.findPathByTime("B", "A")) == 2); // Untouched, still cached
+    CHECK(system.routeCacheStats().hits == hits + 1);
+    CHECK(totalTime(system.findPathByTime("D", "A")) == 15);
+    CHECK(system.routeCacheStats().hits == hits + 1);
+
+    NetworkUpdate close;
+    close.kind = NetworkUpdate::Kind::CloseStation;
+    close.from = "C";
+    CHECK(apply(system, {close}));
+    CHECK(system.findPathByTime("A", "D").empty());
+    system.clearUpdates();
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 9);
+}
+
+// ---- Live updates ----
+
+// A and B are joined by two lines; a later weight update wins over an
+// earlier one whether it names one line or all of them, in one batch or
+// in two, and cached routes follow
+void testUpdateWeightOrder() {
+    const TestNetwork network({{"A", "B", "Red", 5, 20}, {"A", "B", "Blue", 6, 20}, {"B", "C", "Red", 2, 10}});
+
+    MetroSystem allThenOne;
+    if (!network.load(allThenOne)) return fail("load");
+    CHECK(totalTime(allThenOne.findPathByTime("A", "B")) == 5);
+    CHECK(apply(allThenOne, {setWeights("A", "B", "", 10, 50)}));
+    CHECK(totalTime(allThenOne.findPathByTime("A", "B")) == 10);
+    CHECK(apply(allThenOne, {setWeights("A", "B", "Red", 3)}));
+    const std::vector<PathSegment> red = allThenOne.findPathByTime("A", "B");
+    CHECK(totalTime(red) == 3);
+    CHECK(red.size() == 2 && red.back().lineTakenToReach == "Red");
+    CHECK(totalCost(red) == 50); // The all-lines cost still holds on Red
+    CHECK(totalTime(allThenOne.findPathByTime("C", "A")) == 5);
+
+    MetroSystem oneThenAll;
+    if (!network.load(oneThenAll)) return fail("load");
+    CHECK(apply(oneThenAll, {setWeights("A", "B", "Red", 3)}));
+    CHECK(totalTime(oneThenAll.findPathByTime("A", "B")) == 3);
+    CHECK(apply(oneThenAll, {setWeights("B", "A", "", 10)}));
+    CHECK(totalTime(oneThenAll.findPathByTime("A", "B")) == 10);
+    CHECK(totalTime(oneThenAll.findPathByTime("C", "A")) == 12);
+
+    MetroSystem oneBatch;
+    if (!network.load(oneBatch)) return fail("load");
+    CHECK(apply(oneBatch, {setWeights("A", "B", "", 10), setWeights("A", "B", "Red", 3)}));
+    CHECK(totalTime(oneBatch.findPathByTime("A", "B")) == 3);
+    CHECK(apply(oneBatch, {setWeights("A", "B", "Red", 4), setWeights("A", "B", "", 9)}));
+    CHECK(totalTime(oneBatch.findPathByTime("A", "B")) == 9);
+}
+
+// Closing and reopening stations and segments, per line or on every line;
+// a batch with a bad update changes nothing
+void testUpdateCloseReopen() {
+    using Kind = NetworkUpdate::Kind;
+    const TestNetwork network({{"A", "B", "Red", 2, 10},
+                               {"B", "C", "Red", 2, 10},
+                               {"B", "C", "Blue", 5, 10},
+                               {"A", "D", "Green", 3, 10},
+                               {"D", "C", "Green", 3, 10}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 4);
+
+    CHECK(apply(system, {update(Kind::CloseSegment, "C", "B", "Red")}));
+    CHECK(system.hasUpdates());
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 6);
+    CHECK(apply(system, {update(Kind::CloseSegment, "B", "C")}));
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 6);
+    CHECK(linesOf(system.findPathByTime("A", "C")) == std::vector<std::string>({"", "Green", "Green"}));
+    CHECK(apply(system, {update(Kind::CloseStation, "D")}));
+    CHECK(system.findPathByTime("A", "C").empty());
+    CHECK(system.findPathByTime("A", "D").empty());
+    CHECK(totalTime(system.findPathByTime("A", "B")) == 2);
+
+    // Each closure is reopened on its own: Red stays closed
+    CHECK(apply(system, {update(Kind::ReopenSegment, "B", "C")}));
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 7);
+    CHECK(apply(system, {update(Kind::ReopenStation, "D")}));
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 6);
+
+    const uint64_t version = system.networkVersion();
+    std::string errorMsg;
+    CHECK(!system.applyUpdates({update(Kind::ReopenSegment, "B", "C"), update(Kind::CloseStation, "Nowhere")}, errorMsg));
+    CHECK(errorMsg.find("Nowhere") != std::string::npos);
+    CHECK(!system.applyUpdates({update(Kind::CloseSegment, "A", "C")}, errorMsg)); // No such segment
+    CHECK(system.networkVersion() == version);
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 6);
+
+    system.clearUpdates();
+    CHECK(!system.hasUpdates());
+    CHECK(totalTime(system.findPathByTime("A", "C")) == 4);
+}
+
+// A temporary segment may run on a new line, is closed and reweighted like
+// any other, and leaves no trace once removed
+void testUpdateTemporarySegments() {
+    using Kind = NetworkUpdate::Kind;
+    const TestNetwork network({{"A", "B", "Red", 4, 10}, {"B", "C", "Red", 4, 10}, {"C", "D", "Red", 4, 10}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 12);
+
+    NetworkUpdate shuttle = update(Kind::AddTemporarySegment, "A", "C", "Shuttle");
+    shuttle.time = 3;
+    shuttle.cost = 5;
+    shuttle.distance = 2.0;
+    CHECK(apply(system, {shuttle}));
+    std::vector<PathSegment> path = system.findPathByTime("D", "A");
+    CHECK(totalTime(path) == 7);
+    CHECK(linesOf(path) == std::vector<std::string>({"", "Red", "Shuttle"}));
+    CHECK(totalCost(system.findPathByCost("A", "D")) == 15);
+
+    CHECK(apply(system, {setWeights("C", "A", "Shuttle", 9)}));
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 12);
+    CHECK(apply(system, {setWeights("A", "C", "Shuttle", 1)}));
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 5);
+    CHECK(apply(system, {update(Kind::CloseSegment, "A", "C", "Shuttle")}));
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 12);
+    CHECK(apply(system, {update(Kind::ReopenSegment, "A", "C", "Shuttle")}));
+    CHECK(totalTime(system.findPathByTime("A", "D")) == 5);
+
+    CHECK(apply(system, {update(Kind::RemoveTemporarySegment, "C", "A", "Shuttle")}));
+    path = system.findPathByTime("A", "D");
+    CHECK(totalTime(path) == 12);
+    CHECK(linesOf(path) == std::vector<std::string>({"", "Red", "Red", "Red"}));
+
+    std::string errorMsg;
+    NetworkUpdate unpriced = update(Kind::AddTemporarySegment, "A", "D", "Shuttle");
+    CHECK(!system.applyUpdates({unpriced}, errorMsg));
+}
+
+// Queries running while batches are published each see one whole network:
+// either every change of a batch or none, never a mix
+void testUpdateSnapshots() {
+    const TestNetwork network({{"A", "B", "Red", 2, 10}, {"B", "C", "Red", 3, 10}, {"C", "D", "Red", 4, 10}});
+    for (const size_t capacity : {0, 64}) {
+        MetroSystem system;
+        if (!network.load(system)) return fail("load");
+        system.setRouteCacheCapacity(capacity);
+
+        std::atomic<bool> done{false};
+        std::atomic<int> torn{0};
+        std::atomic<int> answers{0};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&, r] {
+                const char* const ends[] = {"A", "D"};
+                for (int i = r; !done; ++i) {
+                    const int time = totalTime(system.findPathByTime(ends[i % 2], ends[1 - i % 2]));
+                    if (time != 9 && time != 23) torn++;
+                    answers++;
+                }
+            });
+        }
+        for (int round = 0; round < 200 || answers < 1000; ++round) {
+            CHECK(apply(system, {setWeights("A", "B", "", 10), setWeights("C", "D", "", 10)}));
+            system.clearUpdates();
+            std::this_thread::yield();
+        }
+        done = true;
+        for (std::thread& reader : readers) reader.join();
+        CHECK(torn == 0);
+        CHECK(totalTime(system.findPathByTime("A", "D")) == 9);
+    }
+}
+
+// Closures and dearer segments leave the hierarchies answering the routes
+// they do not touch; the rest, and everything once a segment got faster,
+// goes to Dijkstra
+void testHierarchiesUnderUpdates() {
+    const TestNetwork network({{"A", "B", "Red", 2, 10},
+                               {"B", "C", "Red", 2, 10},
+                               {"C", "D", "Red", 2, 10},
+                               {"A", "E", "Blue", 4, 10},
+                               {"E", "D", "Blue", 4, 10}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    system.setSearchEngine(SearchEngine::ContractionHierarchy);
+    NetworkUpdate close;
+    close.kind = NetworkUpdate::Kind::CloseSegment;
+    close.from = "B";
+    close.to = "C";
+    CHECK(apply(system, {close}));
+
+    SearchStats stats;
+    CHECK(totalTime(system.findPath("A", "D", RouteCriterion::Time, nullptr, &stats)) == 8);
+    CHECK(!METRO_ENABLE_STATS || stats.counters.hierarchyFallbacks == 1);
+    CHECK(totalTime(system.findPath("A", "B", RouteCriterion::Time, nullptr, &stats)) == 2);
+    CHECK(stats.counters.hierarchyFallbacks == 0);
+    CHECK(totalTime(system.findPath("C", "D", RouteCriterion::Time, nullptr, &stats)) == 2);
+    CHECK(stats.counters.hierarchyFallbacks == 0);
+
+    CHECK(apply(system, {setWeights("E", "D", "Blue", 1)}));
+    CHECK(totalTime(system.findPath("A", "D", RouteCriterion::Time, nullptr, &stats)) == 5);
+    CHECK(totalTime(system.findPath("C", "D", RouteCriterion::Time, nullptr, &stats)) == 2);
+    CHECK(!METRO_ENABLE_STATS || stats.counters.hierarchyFallbacks == 1);
+    // Costs did not change, so cost routes still use the hierarchy
+    CHECK(totalCost(system.findPath("C", "D", RouteCriterion::Cost, nullptr, &stats)) == 10);
+    CHECK(stats.counters.hierarchyFallbacks == 0);
+}
+
+// ---- Snapshots ----
+
+bool loadCached(MetroSystem& system, const TestNetwork& network) {
+    std::string errorMsg;
+    const bool ok = system.loadMetroDataCached(network.path(), errorMsg);
+    if (!ok) std::fprintf(stderr, "Could not load %s: %s\n", network.path().c_str(), errorMsg.c_str());
+    return ok;
+}
+
+// A snapshot only stands in for the CSV it was built from: a CSV replaced
+// by another with an older timestamp must be parsed again
+void testSnapshotFreshness() {
+    const TestNetwork network({{"A", "B", "Red", 5, 20}, {"B", "C", "Red", 5, 20}});
+    const std::string snapshot = MetroSystem::snapshotPathFor(network.path());
+    const auto csvTime = std::filesystem::last_write_time(network.path());
+
+    MetroSystem first;
+    if (!loadCached(first, network)) return fail("load");
+    CHECK(!first.statistics().load.fromSnapshot);
+    CHECK(std::filesystem::exists(snapshot));
+    MetroSystem second;
+    if (!loadCached(second, network)) return fail("load");
+    CHECK(second.statistics().load.fromSnapshot);
+    CHECK(totalTime(second.findPathByTime("A", "C")) == 10);
+
+    // Back-dated, so the snapshot is still the newer file
+    network.write({{"A", "B", "Red", 7, 20}, {"B", "C", "Red", 5, 20}, {"C", "D", "Red", 1, 20}});
+    std::filesystem::last_write_time(network.path(), csvTime - std::chrono::hours(1));
+    MetroSystem restored;
+    if (!loadCached(restored, network)) return fail("load");
+    CHECK(!restored.statistics().load.fromSnapshot);
+    CHECK(totalTime(restored.findPathByTime("A", "C")) == 12);
+    CHECK(restored.hasStation("D"));
+
+    // The rewritten snapshot matches the restored CSV
+    MetroSystem again;
+    if (!loadCached(again, network)) return fail("load");
+    CHECK(again.statistics().load.fromSnapshot);
+    CHECK(totalTime(again.findPathByTime("A", "C")) == 12);
+}
+
+// A saved snapshot loads back into the same network
+void testSnapshotRoundTrip() {
+    const TestNetwork network({{"A", "B", "Red", 5, 20},
+                               {"B", "C", "Red", 5, 20},
+                               {"B", "D", "Blue", 3, 30},
+                               {"D", "C", "Blue", 4, 10}});
+    const std::string snapshot = MetroSystem::snapshotPathFor(network.path());
+    MetroSystem original;
+    if (!network.load(original)) return fail("load");
+    std::string errorMsg;
+    CHECK(original.saveSnapshot(snapshot, errorMsg));
+
+    MetroSystem restored;
+    CHECK(restored.loadSnapshot(snapshot, errorMsg));
+    CHECK(restored.getStationNames() == original.getStationNames());
+    for (const char* from : {"A", "B", "C", "D"}) {
+        for (const char* to : {"A", "B", "C", "D"}) {
+            CHECK(totalTime(restored.findPathByTime(from, to)) == totalTime(original.findPathByTime(from, to)));
+            CHECK(totalCost(restored.findPathByCost(from, to)) == totalCost(original.findPathByCost(from, to)));
+            CHECK(linesOf(restored.findPathByCost(from, to)) == linesOf(original.findPathByCost(from, to)));
+        }
+    }
+}
+
+// Any changed byte past the header, or a cut-off file, is caught, and
+// loadMetroDataCached goes back to the CSV
+void testSnapshotCorruption() {
+    const TestNetwork network({{"A", "B", "Red", 5, 20}, {"B", "C", "Red", 5, 20}, {"C", "D", "Blue", 2, 10}});
+    const std::string snapshot = MetroSystem::snapshotPathFor(network.path());
+    MetroSystem original;
+    if (!network.load(original)) return fail("load");
+    std::string errorMsg;
+    if (!original.saveSnapshot(snapshot, errorMsg)) return fail("save");
+
+    std::string bytes;
+    {
+        std::ifstream file(snapshot, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    auto writeSnapshot = [&snapshot](const std::string& contents) {
+        std::ofstream file(snapshot, std::ios::binary | std::ios::trunc);
+        file << contents;
+    };
+
+    int accepted = 0;
+    for (size_t at = bytes.size() / 2; at < bytes.size(); ++at) {
+        std::string corrupt = bytes;
+        corrupt[at] = static_cast<char>(corrupt[at] ^ 0x10);
+        writeSnapshot(corrupt);
+        MetroSystem system;
+        if (system.loadSnapshot(snapshot, errorMsg)) accepted++;
+    }
+    CHECK(accepted == 0);
+    writeSnapshot(bytes.substr(0, bytes.size() - 8));
+    MetroSystem truncated;
+    CHECK(!truncated.loadSnapshot(snapshot, errorMsg));
+
+    bytes[bytes.size() - 1] ^= 0x10;
+    writeSnapshot(bytes);
+    MetroSystem cached;
+    if (!loadCached(cached, network)) return fail("load");
+    CHECK(!cached.statistics().load.fromSnapshot);
+    CHECK(totalTime(cached.findPathByTime("A", "D")) == 12);
+}
+
+// ---- Timetables ----
+
+// Minute the route reaches its last station, leaving at departure
+int arrivalMinute(const std::vector<PathSegment>& path, int departure) {
+    for (const PathSegment& segment : path) departure += segment.waitForSegment + segment.timeForSegment;
+    return departure;
+}
+
+// Red runs A-B-C every ten minutes, Blue A-D-C once each way at 8:30;
+// the earliest arrival rides on, waits, changes and avoids closures as
+// the timetable allows
+void testEarliestArrival() {
+    const TestNetwork network({{"A", "B", "Red", 10, 20},
+                               {"B", "C", "Red", 10, 20},
+                               {"A", "D", "Blue", 5, 20},
+                               {"D", "C", "Blue", 5, 20}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    const std::string timetable = MetroSystem::timetablePathFor(network.path());
+    {
+        std::ofstream file(timetable, std::ios::trunc);
+        file << "Line,From Station,To Station,First Departure,Last Departure,Headway (min)\n"
+             << "Red,,,8:00,9:00,10\n"
+             << "Blue,,,8:30,8:30,0\n";
+    }
+    std::string errorMsg;
+    if (!system.loadTimetable(timetable, errorMsg)) return fail(errorMsg.c_str());
+
+    const int eight = 8 * 60;
+    std::vector<PathSegment> path = system.findEarliestArrival("A", "C", eight);
+    CHECK(arrivalMinute(path, eight) == eight + 20);
+    CHECK(linesOf(path) == std::vector<std::string>({"", "Red", "Red"}));
+    CHECK(path.size() == 3 && path[1].waitForSegment == 0 && path[2].waitForSegment == 0);
+
+    path = system.findEarliestArrival("A", "C", eight + 25);
+    CHECK(arrivalMinute(path, eight + 25) == eight + 40);
+    CHECK(linesOf(path) == std::vector<std::string>({"", "Blue", "Blue"}));
+    CHECK(path.size() == 3 && path[1].waitForSegment == 5);
+
+    // Blue to C at 8:40, two minutes to change, Red from C at 8:50; or Blue
+    // to A and Red from there, also at 9:00
+    CHECK(arrivalMinute(system.findEarliestArrival("D", "B", eight), eight) == eight + 60);
+    CHECK(system.findEarliestArrival("A", "C", eight + 61).empty());
+
+    NetworkUpdate close;
+    close.kind = NetworkUpdate::Kind::CloseSegment;
+    close.from = "A";
+    close.to = "B";
+    CHECK(apply(system, {close}));
+    CHECK(arrivalMinute(system.findEarliestArrival("A", "C", eight), eight) == eight + 40);
+    CHECK(arrivalMinute(system.findEarliestArrival("A", "B", eight), eight) == eight + 60); // Round by C
+    system.clearUpdates();
+    CHECK(arrivalMinute(system.findEarliestArrival("A", "C", eight), eight) == eight + 20);
+
+    // With eleven minutes to change, the Red train from C at 8:50 is gone
+    if (!system.loadTimetable(timetable, errorMsg, 11)) return fail(errorMsg.c_str());
+    CHECK(arrivalMinute(system.findEarliestArrival("D", "B", eight), eight) == eight + 70);
+}
+
+// ---- Network queries ----
+
+using Reached = std::vector<std::pair<std::string, long long>>;
+
+// Stations and values in the order the search gave them
+Reached reachedOf(const std::vector<ReachableStation>& stations) {
+    Reached reached;
+    for (const ReachableStation& station : stations) reached.emplace_back(station.station, station.value);
+    return reached;
+}
+
+// Nearest first; stations at the same value may come in any order, so
+// those are sorted by name before comparing
+bool sameReached(const std::vector<ReachableStation>& stations, Reached expected) {
+    Reached reached = reachedOf(stations);
+    if (!std::is_sorted(reached.begin(), reached.end(),
+                        [](const auto& a, const auto& b) { return a.second < b.second; })) {
+        return false;
+    }
+    auto byValue = [](const auto& a, const auto& b) {
+        return std::make_pair(a.second, a.first) < std::make_pair(b.second, b.first);
+    };
+    std::sort(reached.begin(), reached.end(), byValue);
+    std::sort(expected.begin(), expected.end(), byValue);
+    return reached == expected;
+}
+
+// A Red line A-B-C-D with a dear Blue branch B-E: a budget takes in the
+// stations at exactly its value and none beyond, by every criterion, and
+// a closed station drops out with whatever lies only behind it
+void testReachability() {
+    const TestNetwork network(
+        {{"A", "B", "Red", 2, 10}, {"B", "C", "Red", 3, 10}, {"C", "D", "Red", 4, 10}, {"B", "E", "Blue", 1, 30}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+
+    CHECK(sameReached(system.reachableWithin("A", RouteCriterion::Time, 5), {{"A", 0}, {"B", 2}, {"E", 3}, {"C", 5}}));
+    CHECK(sameReached(system.reachableWithin("A", RouteCriterion::Time, 4), {{"A", 0}, {"B", 2}, {"E", 3}}));
+    CHECK(sameReached(system.reachableWithin("A", RouteCriterion::Cost, 30), {{"A", 0}, {"B", 10}, {"C", 20}, {"D", 30}}));
+    CHECK(sameReached(system.reachableWithin("A", RouteCriterion::LeastStops, 2),
+                      {{"A", 0}, {"B", 1}, {"C", 2}, {"E", 2}}));
+    CHECK(sameReached(system.reachableWithin("D", RouteCriterion::Time, 0), {{"D", 0}}));
+    CHECK(system.reachableWithin("A", RouteCriterion::Time, -1).empty());
+    CHECK(system.reachableWithin("A", RouteCriterion::Distance, 100).empty());
+    CHECK(system.reachableWithin("Nowhere", RouteCriterion::Time, 100).empty());
+
+    // Entry i of the many-source form is the single search from sources[i]
+    const std::vector<std::string> sources = {"A", "C", "Nowhere", "E", "D"};
+    for (const RouteCriterion criterion : {RouteCriterion::LeastStops, RouteCriterion::Time, RouteCriterion::Cost}) {
+        for (const unsigned threads : {1u, 4u}) {
+            const std::vector<std::vector<ReachableStation>> all = system.reachableWithin(sources, criterion, 6, threads);
+            CHECK(all.size() == sources.size());
+            for (size_t i = 0; i < all.size() && i < sources.size(); ++i) {
+                CHECK(reachedOf(all[i]) == reachedOf(system.reachableWithin(sources[i], criterion, 6)));
+            }
+        }
+    }
+
+    // Bands split one search at their bounds, D at 9 is beyond the last
+    const std::vector<IsochroneBand> bands = system.isochroneBands("A", RouteCriterion::Time, {2, 5, 8});
+    CHECK(bands.size() == 3);
+    if (bands.size() == 3) {
+        CHECK(bands[0].upTo == 2 && bands[0].stations == std::vector<std::string>({"A", "B"}));
+        CHECK(bands[1].upTo == 5 && bands[1].stations == std::vector<std::string>({"E", "C"}));
+        CHECK(bands[2].upTo == 8 && bands[2].stations.empty());
+    }
+    CHECK(system.isochroneBands("A", RouteCriterion::Time, {}).empty());
+
+    CHECK(apply(system, {update(NetworkUpdate::Kind::CloseStation, "C")}));
+    CHECK(sameReached(system.reachableWithin("A", RouteCriterion::Time, 100), {{"A", 0}, {"B", 2}, {"E", 3}}));
+    CHECK(system.reachableWithin("C", RouteCriterion::Time, 100).empty());
+    system.clearUpdates();
+    CHECK(sameReached(system.reachableWithin("A", RouteCriterion::Time, 9),
+                      {{"A", 0}, {"B", 2}, {"E", 3}, {"C", 5}, {"D", 9}}));
+}
+
+// Names starting with the query come first, then names with a word
+// starting with it, then names containing it, each alphabetically; only
+// a query nothing contains is taken as misspelt
+void testStationSearch() {
+    const TestNetwork network({{"Rajiv Chowk", "Rajouri Garden", "Blue", 2, 10},
+                               {"Rajouri Garden", "Sector Raj Nagar", "Blue", 2, 10},
+                               {"Sector Raj Nagar", "Maharaja Surajmal", "Blue", 2, 10},
+                               {"Rajiv Chowk", "Chandni Chowk", "Yellow", 2, 10},
+                               {"Chandni Chowk", "Kashmere Gate", "Yellow", 2, 10},
+                               {"Rajiv Chowk", "New Delhi", "Yellow", 2, 10}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    using Names = std::vector<std::string>;
+
+    const Names raj = {"Rajiv Chowk", "Rajouri Garden", "Sector Raj Nagar", "Maharaja Surajmal"};
+    CHECK(system.findStations("raj", 10) == raj);
+    CHECK(system.findStations("RAJ", 10) == raj);
+    CHECK(system.findStations(" raj.", 10) == raj);
+    CHECK(system.findStations("raj", 3) == Names(raj.begin(), raj.begin() + 3));
+    CHECK(system.findStations("chowk", 10) == Names({"Chandni Chowk", "Rajiv Chowk"}));
+    CHECK(system.findStations("rajiv-chowk", 10) == Names({"Rajiv Chowk"}));
+    CHECK(system.findStations("jmal", 10) == Names({"Maharaja Surajmal"}));
+    // Under three characters only the starts of words are looked at
+    CHECK(system.findStations("ga", 10) == Names({"Kashmere Gate", "Rajouri Garden"}));
+
+    CHECK(system.findStations("", 3) == Names({"Chandni Chowk", "Kashmere Gate", "Maharaja Surajmal"}));
+    CHECK(system.findStations("raj", 0).empty());
+    CHECK(system.findStations("xyzzy", 10).empty());
+
+    // Misspelt: the closest names by shared trigrams, none if too far off
+    const Names misspelt = system.findStations("kashmiri gate", 10);
+    CHECK(!misspelt.empty() && misspelt.front() == "Kashmere Gate");
+    CHECK(system.findStations("rajuri garden", 1) == Names({"Rajouri Garden"}));
+}
+
+// Red runs A-B-C; Blue is faster and cheaper from B to C. A route from A
+// changes to Blue only while that saves more than the penalty, and the
+// times and costs it reports are the real ones
+void testTransferPenalties() {
+    const TestNetwork network({{"A", "B", "Red", 3, 10}, {"B", "C", "Red", 7, 30}, {"B", "C", "Blue", 5, 20}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    auto withPenalty = [&](RouteCriterion criterion, int minutes, int cost, const std::string& from = "A") {
+        TransferPenalties penalties;
+        penalties.minutes = minutes;
+        penalties.cost = cost;
+        return system.findPathWithTransfers(from, "C", criterion, penalties);
+    };
+
+    for (const int minutes : {0, 1}) {
+        const std::vector<PathSegment> change = withPenalty(RouteCriterion::Time, minutes, 0);
+        CHECK(linesOf(change) == std::vector<std::string>({"", "Red", "Blue"}));
+        CHECK(totalTime(change) == 8);
+        CHECK(!change.empty() && change.back().transfers == 1);
+    }
+    const std::vector<PathSegment> stay = withPenalty(RouteCriterion::Time, 3, 0);
+    CHECK(linesOf(stay) == std::vector<std::string>({"", "Red", "Red"}));
+    CHECK(totalTime(stay) == 10);
+    CHECK(!stay.empty() && stay.back().transfers == 0);
+    CHECK(sameRoute(withPenalty(RouteCriterion::Time, 0, 0), system.findPathByTime("A", "C")));
+
+    CHECK(linesOf(withPenalty(RouteCriterion::Cost, 0, 5)) == std::vector<std::string>({"", "Red", "Blue"}));
+    CHECK(totalCost(withPenalty(RouteCriterion::Cost, 0, 5)) == 30);
+    CHECK(linesOf(withPenalty(RouteCriterion::Cost, 0, 15)) == std::vector<std::string>({"", "Red", "Red"}));
+    CHECK(totalCost(withPenalty(RouteCriterion::Cost, 0, 15)) == 40);
+
+    // Boarding at the start is not a change
+    CHECK(linesOf(withPenalty(RouteCriterion::Time, 100, 100, "B")) == std::vector<std::string>({"", "Blue"}));
+    // Stops and distance carry no penalty
+    CHECK(sameRoute(withPenalty(RouteCriterion::LeastStops, 100, 100), system.findPathLeastStops("A", "C")));
+    CHECK(sameRoute(withPenalty(RouteCriterion::Distance, 100, 100), system.findPathByDistance("A", "C")));
+
+    // With Red closed past B the change is the only way, penalty or not
+    CHECK(apply(system, {update(NetworkUpdate::Kind::CloseSegment, "B", "C", "Red")}));
+    CHECK(totalTime(withPenalty(RouteCriterion::Time, 100, 0)) == 8);
+    system.clearUpdates();
+    CHECK(totalTime(withPenalty(RouteCriterion::Time, 100, 0)) == 10);
+    CHECK(withPenalty(RouteCriterion::Time, 0, 0, "Nowhere").empty());
+}
+
+// (time, cost, changes) of each route of a Pareto set, in the order given
+std::vector<std::tuple<long long, long long, int>> criteriaOf(const std::vector<ParetoRoute>& routes) {
+    std::vector<std::tuple<long long, long long, int>> criteria;
+    for (const ParetoRoute& route : routes) criteria.emplace_back(route.time, route.cost, route.transfers);
+    return criteria;
+}
+
+// Each route's totals are those of its path, and no route is at least as
+// good as another on all three criteria
+bool consistentParetoSet(const std::vector<ParetoRoute>& routes) {
+    for (const ParetoRoute& route : routes) {
+        if (route.path.empty() || totalTime(route.path) != route.time || totalCost(route.path) != route.cost
+            || route.path.back().transfers != route.transfers) {
+            return false;
+        }
+        for (const ParetoRoute& other : routes) {
+            if (&other != &route && other.time <= route.time && other.cost <= route.cost
+                && other.transfers <= route.transfers) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// From A to D: Red then Blue is fastest, Red throughout has no change,
+// Green-Yellow-Green is cheapest, and Pink throughout loses to Red on
+// everything
+void testParetoRoutes() {
+    const TestNetwork network({{"A", "B", "Red", 2, 40},
+                               {"B", "D", "Red", 5, 50},
+                               {"B", "D", "Blue", 2, 40},
+                               {"A", "E", "Green", 10, 5},
+                               {"E", "F", "Yellow", 10, 5},
+                               {"F", "D", "Green", 10, 5},
+                               {"A", "C", "Pink", 5, 60},
+                               {"C", "D", "Pink", 5, 60}});
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+    using Criteria = std::vector<std::tuple<long long, long long, int>>;
+
+    const std::vector<ParetoRoute> routes = system.findParetoRoutes("A", "D");
+    CHECK(criteriaOf(routes) == Criteria({{4, 80, 1}, {7, 90, 0}, {30, 15, 2}}));
+    CHECK(consistentParetoSet(routes));
+    CHECK(!routes.empty() && sameRoute(routes.front().path, system.findPathByTime("A", "D")));
+    CHECK(!routes.empty() && sameRoute(routes.back().path, system.findPathByCost("A", "D")));
+    CHECK(!routes.empty() && linesOf(routes.back().path) == std::vector<std::string>({"", "Green", "Yellow", "Green"}));
+
+    // Fewer changes allowed: the routes that need more drop out
+    CHECK(criteriaOf(system.findParetoRoutes("A", "D", 1)) == Criteria({{4, 80, 1}, {7, 90, 0}}));
+    CHECK(criteriaOf(system.findParetoRoutes("A", "D", 0)) == Criteria({{7, 90, 0}}));
+    CHECK(system.findParetoRoutes("A", "Nowhere").empty());
+
+    // Without Red past B, Pink is the route without a change
+    CHECK(apply(system, {update(NetworkUpdate::Kind::CloseSegment, "B", "D", "Red")}));
+    const std::vector<ParetoRoute> closed = system.findParetoRoutes("A", "D");
+    CHECK(criteriaOf(closed) == Criteria({{4, 80, 1}, {10, 120, 0}, {30, 15, 2}}));
+    CHECK(consistentParetoSet(closed));
+}
+
+using Stops = std::vector<std::pair<std::string, std::string>>; // (station, line taken to reach it)
+
+Stops stopsOf(const std::vector<PathSegment>& path) {
+    Stops stops;
+    for (const PathSegment& segment : path) stops.emplace_back(segment.stationName, segment.lineTakenToReach);
+    return stops;
+}
+
+// Every route from `from` to `to` over the rows that visits no station
+// twice, with its total time or cost, found by trying them all
+void enumerateRoutes(const std::vector<Row>& rows, const std::string& to, bool byCost, Stops& route, long long value,
+                     std::vector<std::pair<long long, Stops>>& routes) {
+    if (route.back().first == to) {
+        routes.emplace_back(value, route);
+        return;
+    }
+    for (const Row& row : rows) {
+        for (const bool forward : {true, false}) {
+            const std::string& here = forward ? row.from : row.to;
+            const std::string& next = forward ? row.to : row.from;
+            if (here != route.back().first) continue;
+            if (std::any_of(route.begin(), route.end(), [&](const auto& stop) { return stop.first == next; })) continue;
+            route.emplace_back(next, row.line);
+            enumerateRoutes(rows, to, byCost, route, value + (byCost ? row.cost : row.time), routes);
+            route.pop_back();
+        }
+    }
+}
+
+// Seven loopless routes lead from A to D, four of them in 4 minutes; the
+// k best are the k best of all seven by value, each listed once, whatever
+// order the ties come in
+void testAlternativeRoutes() {
+    const std::vector<Row> rows = {{"A", "B", "Red", 1, 10},  {"B", "D", "Red", 1, 10},  {"B", "D", "Pink", 3, 5},
+                                   {"A", "C", "Blue", 2, 5},  {"C", "D", "Blue", 2, 5},  {"B", "C", "Green", 1, 30},
+                                   {"A", "D", "Yellow", 5, 25}};
+    const TestNetwork network(rows);
+    MetroSystem system;
+    if (!network.load(system)) return fail("load");
+
+    for (const RouteCriterion criterion : {RouteCriterion::Time, RouteCriterion::Cost}) {
+        const bool byCost = criterion == RouteCriterion::Cost;
+        std::vector<std::pair<long long, Stops>> all;
+        Stops start = {{"A", ""}};
+        enumerateRoutes(rows, "D", byCost, start, 0, all);
+        std::sort(all.begin(), all.end());
+        CHECK(all.size() == 7);
+
+        for (const size_t k : {size_t(1), size_t(3), size_t(7), size_t(20)}) {
+            const std::vector<std::vector<PathSegment>> routes = system.findAlternativeRoutes("A", "D", criterion, k);
+            CHECK(routes.size() == std::min(k, all.size()));
+            std::vector<Stops> seen;
+            for (size_t i = 0; i < routes.size() && i < all.size(); ++i) {
+                const long long value = byCost ? totalCost(routes[i]) : totalTime(routes[i]);
+                CHECK(value == all[i].first);
+                const Stops stops = stopsOf(routes[i]);
+                CHECK(std::find(seen.begin(), seen.end(), stops) == seen.end());
+                CHECK(std::find_if(all.begin(), all.end(), [&](const auto& route) { return route.second == stops; })
+                      != all.end());
+                seen.push_back(stops);
+            }
+            CHECK(!routes.empty()
+                  && sameRoute(routes.front(), byCost ? system.findPathByCost("A", "D") : system.findPathByTime("A", "D")));
+
+            // The spur searches may run on several threads; the answer stays the same
+            const std::vector<std::vector<PathSegment>> threaded = system.findAlternativeRoutes("A", "D", criterion, k, 4);
+            CHECK(threaded.size() == routes.size());
+            for (size_t i = 0; i < threaded.size() && i < routes.size(); ++i) CHECK(sameRoute(threaded[i], routes[i]));
+        }
+    }
+
+    CHECK(system.findAlternativeRoutes("A", "D", RouteCriterion::Time, 0).empty());
+    CHECK(system.findAlternativeRoutes("A", "Nowhere", RouteCriterion::Time, 3).empty());
+
+    // With B closed, only the routes by C and the Yellow line are left
+    CHECK(apply(system, {update(NetworkUpdate::Kind::CloseStation, "B")}));
+    const std::vector<std::vector<PathSegment>> closed = system.findAlternativeRoutes("A", "D", RouteCriterion::Time, 5);
+    CHECK(closed.size() == 2);
+    if (closed.size() == 2) {
+        CHECK(stopsOf(closed[0]) == Stops({{"A", ""}, {"C", "Blue"}, {"D", "Blue"}}));
+        CHECK(stopsOf(closed[1]) == Stops({{"A", ""}, {"D", "Yellow"}}));
+    }
+}
+
+// ---- Analytics ----
+
+std::unordered_map<std::string, double> stationBetweenness(const NetworkCentrality& centrality) {
+    std::unordered_map<std::string, double> betweenness;
+    for (const StationCentrality& station : centrality.stations) betweenness[station.station] = station.betweenness;
+    return betweenness;
+}
+
+// Segments keyed "from-to line", stations in either order
+std::unordered_map<std::string, double> segmentBetweenness(const NetworkCentrality& centrality) {
+    std::unordered_map<std::string, double> betweenness;
+    for (const SegmentCentrality& segment : centrality.segments) {
+        const auto [first, second] = std::minmax(segment.from, segment.to);
+        betweenness[first + "-" + second + " " + segment.line] = segment.betweenness;
+    }
+    return betweenness;
+}
+
+bool near(double a, double b) {
+    return std::abs(a - b) < 1e-9;
+}
+
+bool sameBetweenness(const std::unordered_map<std::string, double>& actual,
+                     const std::unordered_map<std::string, double>& expected) {
+    if (actual.size() != expected.size()) return false;
+    for (const auto& [name, value] : expected) {
+        const auto it = actual.find(name);
+        if (it == actual.end() || !near(it->second, value)) return false;
+    }
+    return true;
+}
+
+bool highestFirst(const NetworkCentrality& centrality) {
+    auto higher = [](const auto& a, const auto& b) { return a.betweenness > b.betweenness; };
+    return std::is_sorted(centrality.stations.begin(), centrality.stations.end(), higher)
+           && std::is_sorted(centrality.segments.begin(), centrality.segments.end(), higher);
+}
+
+// Betweenness counted by hand: on the line A-B-C-D-E each pair of
+// stations counts once for the stations and segments between them; on a
+// square, a pair with two equally good routes counts half for each
+void testCentrality() {
+    const TestNetwork line({{"A", "B", "Red", 1, 10}, {"B", "C", "Red", 1, 10}, {"C", "D", "Red", 1, 10},
+                            {"D", "E", "Red", 1, 10}});
+    MetroSystem system;
+    if (!line.load(system)) return fail("load");
+
+    const NetworkCentrality exact = system.computeCentrality(RouteCriterion::LeastStops, 0, 1);
+    CHECK(exact.sources == 5 && !exact.sampled);
+    CHECK(sameBetweenness(stationBetweenness(exact), {{"A", 0}, {"B", 3}, {"C", 4}, {"D", 3}, {"E", 0}}));
+    CHECK(sameBetweenness(segmentBetweenness(exact),
+                          {{"A-B Red", 4}, {"B-C Red", 6}, {"C-D Red", 6}, {"D-E Red", 4}}));
+    CHECK(highestFirst(exact));
+    CHECK(system.computeCentrality(RouteCriterion::Distance).stations.empty());
+
+    // Time, cost and any number of threads agree on a line
+    for (const RouteCriterion criterion : {RouteCriterion::LeastStops, RouteCriterion::Time, RouteCriterion::Cost}) {
+        for (const unsigned threads : {1u, 4u}) {
+            const NetworkCentrality other = system.computeCentrality(criterion, 0, threads);
+            CHECK(sameBetweenness(stationBetweenness(other), stationBetweenness(exact)));
+            CHECK(sameBetweenness(segmentBetweenness(other), segmentBetweenness(exact)));
+        }
+    }
+
+    // A sample of every station is no sample; a smaller one is scaled up
+    // to all sources, and the ends of the line are still never between
+    const NetworkCentrality whole = system.computeCentrality(RouteCriterion::LeastStops, 5, 2, 7);
+    CHECK(!whole.sampled && whole.sources == 5);
+    CHECK(sameBetweenness(stationBetweenness(whole), stationBetweenness(exact)));
+    const NetworkCentrality sample = system.computeCentrality(RouteCriterion::LeastStops, 2, 2, 7);
+    CHECK(sample.sampled && sample.sources == 2);
+    std::unordered_map<std::string, double> estimate = stationBetweenness(sample);
+    CHECK(estimate.size() == 5 && near(estimate["A"], 0) && near(estimate["E"], 0));
+    CHECK(estimate["B"] >= 0 && estimate["C"] >= 0 && estimate["D"] >= 0);
+    CHECK(estimate["B"] <= 10 && estimate["C"] <= 10 && estimate["D"] <= 10); // At most every pair
+    CHECK(sameBetweenness(stationBetweenness(system.computeCentrality(RouteCriterion::LeastStops, 2, 1, 7)), estimate));
+
+    // With C closed, no route passes anywhere and its segments are left out
+    CHECK(apply(system, {update(NetworkUpdate::Kind::CloseStation, "C")}));
+    const NetworkCentrality closed = system.computeCentrality(RouteCriterion::LeastStops);
+    CHECK(sameBetweenness(stationBetweenness(closed), {{"A", 0}, {"B", 0}, {"C", 0}, {"D", 0}, {"E", 0}}));
+    CHECK(sameBetweenness(segmentBetweenness(closed), {{"A-B Red", 1}, {"D-E Red", 1}}));
+
+    // By stops, A-C and B-D each have two routes round the square; by
+    // time, only B-D does
+    const TestNetwork square({{"A", "B", "Red", 1, 10}, {"B", "C", "Red", 1, 10}, {"C", "D", "Red", 5, 10},
+                              {"D", "A", "Red", 5, 10}});
+    MetroSystem squareSystem;
+    if (!square.load(squareSystem)) return fail("load");
+    const NetworkCentrality byStops = squareSystem.computeCentrality(RouteCriterion::LeastStops);
+    CHECK(sameBetweenness(stationBetweenness(byStops), {{"A", 0.5}, {"B", 0.5}, {"C", 0.5}, {"D", 0.5}}));
+    CHECK(sameBetweenness(segmentBetweenness(byStops),
+                          {{"A-B Red", 2}, {"B-C Red", 2}, {"C-D Red", 2}, {"A-D Red", 2}}));
+    const NetworkCentrality byTime = squareSystem.computeCentrality(RouteCriterion::Time);
+    CHECK(sameBetweenness(stationBetweenness(byTime), {{"A", 0.5}, {"B", 1}, {"C", 0.5}, {"D", 0}}));
+    CHECK(sameBetweenness(segmentBetweenness(byTime),
+                          {{"A-B Red", 2.5}, {"B-C Red", 2.5}, {"C-D Red", 1.5}, {"A-D Red", 1.5}}));
+    CHECK(highestFirst(byTime));
+}
+
+// ---- Worker threads ----
+
+// Every index is visited once, by a worker in range, also when calls nest
+// and run side by side, and a second call runs on the threads of the first
+void testParallelFor() {
+    constexpr size_t kCount = 2000;
+    constexpr unsigned kThreads = 4;
+    std::vector<std::atomic<int>> visits(kCount);
+    std::atomic<bool> workerInRange{true};
+    auto visit = [&](unsigned worker, size_t i) {
+        if (worker >= kThreads) workerInRange = false;
+        visits[i]++;
+    };
+
+    parallelFor(kCount, kThreads, visit);
+    std::thread beside([&] { parallelFor(kCount, kThreads, visit); });
+    parallelFor(kCount / 100, kThreads, [&](unsigned, size_t outer) {
+        parallelFor(100, kThreads, [&](unsigned worker, size_t inner) { visit(worker, outer * 100 + inner); });
+    });
+    beside.join();
+    bool allThrice = true;
+    for (const std::atomic<int>& count : visits) allThrice = allThrice && count == 3;
+    CHECK(allThrice);
+    CHECK(workerInRange);
+
+    // A fresh thread has seen no earlier round; a pool thread remembers.
+    // Which pool threads pick up a call is up to the scheduler, so give
+    // them a few calls to meet again.
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<bool> remembered{false};
+    for (int round = 0; round < 50 && !remembered; ++round) {
+        parallelFor(kThreads * 4, kThreads, [&](unsigned, size_t) {
+            thread_local int lastRound = -1;
+            if (std::this_thread::get_id() != caller && lastRound >= 0 && lastRound != round) remembered = true;
+            lastRound = round;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        });
+    }
+    CHECK(remembered);
+}
+
+struct Test {
+    const char* name;
+    void (*run)();
+};
+
+const Test kTests[] = {
+    {"csv-load-issues", testCsvLoadIssues},
+    {"route-cache", testRouteCache},
+    {"update-close-reopen", testUpdateCloseReopen},
+    {"update-temporary-segments", testUpdateTemporarySegments},
+    {"update-snapshots", testUpdateSnapshots},
+    {"update-weight-order", testUpdateWeightOrder},
+    {"hierarchies-under-updates", testHierarchiesUnderUpdates},
+    {"snapshot-freshness", testSnapshotFreshness},
+    {"snapshot-round-trip", testSnapshotRoundTrip},
+    {"snapshot-corruption", testSnapshotCorruption},
+    {"earliest-arrival", testEarliestArrival},
+    {"reachability", testReachability},
+    {"station-search", testStationSearch},
+    {"transfer-penalties", testTransferPenalties},
+    {"pareto-routes", testParetoRoutes},
+    {"alternative-routes", testAlternativeRoutes},
+    {"centrality", testCentrality},
+    {"parallel-for", testParallelFor},
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int run = 0;
+    for (const Test& test : kTests) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) selected = selected || std::string(argv[i]) == test.name;
+        if (!selected) continue;
+        const int before = failures;
+        test.run();
+        run++;
+        std::printf("%s %s\n", failures == before ? "ok  " : "FAIL", test.name);
+    }
+    std::printf("%d test(s), %d failed check(s)\n", run, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+#include "metrosystem.h"
+#include "parallel.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+#include <QSaveFile>
+#include <random>
+
+// Betweenness centrality by Brandes' algorithm. One search per source
+// settles every station; in settling order, each station then passes its
+// count of best routes (sigma) on to the stations it is the best way to,
+// and in reverse order each passes its dependency (delta, the share of
+// routes from the source through it) back to the stations before it.
+// Sources are independent, so they are spread over worker threads, each
+// adding into accumulators of its own that are summed at the end.
+
+namespace {
+
+// Per-thread buffers of the passes after each search, indexed by station
+struct BrandesWorkspace {
+    std::vector<StationId> order; // Settled stations, in settling order
+    std::vector<uint32_t> rank;   // Station -> index in order; valid for settled stations only
+    std::vector<double> sigma;
+    std::vector<double> delta;
+
+    void reset(size_t stationCount) {
+        order.clear();
+        if (rank.size() != stationCount) {
+            rank.assign(stationCount, 0);
+            sigma.assign(stationCount, 0.0);
+            delta.assign(stationCount, 0.0);
+        }
+    }
+};
+
+// Adds the dependencies of every station and arc on routes from source
+// into stationScores and arcScores. An arc u -> w lies on a best route if
+// it is tight (w's value is u's plus the arc) and w was settled after u;
+// the second test keeps the routes acyclic over zero-weight arcs, and both
+// passes use the same test so they agree on which routes there are.
+template <typename Weight>
+void accumulateDependencies(const MetroGraph& graph, StationId source, std::vector<double>& stationScores,
+                            std::vector<double>& arcScores) {
+    using Value = typename Weight::Value;
+    SearchWorkspace<Value>& workspace = threadSearchWorkspace<Value>();
+    thread_local BrandesWorkspace brandes;
+    brandes.reset(graph.stationCount());
+    withThreadDijkstraQueue<Weight>(graph, [&](auto& queue) {
+        runShortestPathKernel<Weight>(graph, source, queue, workspace, [&](StationId v, Value) {
+            brandes.rank[v] = static_cast<uint32_t>(brandes.order.size());
+            brandes.order.push_back(v);
+            brandes.sigma[v] = 0.0;
+            brandes.delta[v] = 0.0;
+            return false;
+        });
+    });
+
+    const std::vector<StationId>& order = brandes.order;
+    auto onBestRoute = [&](StationId u, uint32_t rankU, EdgeId e) {
+        const StationId w = graph.targets[e];
+        return w != u && workspace.distance(w) == workspace.distance(u) + Weight::weight(graph, e) &&
+               brandes.rank[w] > rankU;
+    };
+    brandes.sigma[source] = 1.0;
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        const StationId u = order[i];
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            if (onBestRoute(u, i, e)) brandes.sigma[graph.targets[e]] += brandes.sigma[u];
+        }
+    }
+    for (uint32_t i = static_cast<uint32_t>(order.size()); i-- > 0;) {
+        const StationId u = order[i];
+        double delta = 0.0;
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            if (!onBestRoute(u, i, e)) continue;
+            const StationId w = graph.targets[e];
+            const double share = brandes.sigma[u] / brandes.sigma[w] * (1.0 + brandes.delta[w]);
+            arcScores[e] += share;
+            delta += share;
+        }
+        brandes.delta[u] = delta;
+        if (u != source) stationScores[u] += delta;
+    }
+}
+
+// Sums the dependencies over sources into stationScores and arcScores,
+// spreading the sources over `threads` workers. False if cancelled.
+template <typename Weight>
+bool sumDependencies(const MetroGraph& graph, const std::vector<StationId>& sources, unsigned threads,
+                     std::vector<double>& stationScores, std::vector<double>& arcScores, const CancelFlag* cancel) {
+    if (threads == 0) threads = defaultThreadCount();
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, sources.size())));
+    std::vector<std::vector<double>> workerStations(threads, std::vector<double>(graph.stationCount(), 0.0));
+    std::vector<std::vector<double>> workerArcs(threads, std::vector<double>(graph.edgeCount(), 0.0));
+    parallelFor(sources.size(), threads, [&](unsigned worker, size_t i) {
+        if (isCancelled(cancel)) return;
+        accumulateDependencies<Weight>(graph, sources[i], workerStations[worker], workerArcs[worker]);
+    });
+    if (isCancelled(cancel)) return false;
+
+    stationScores.assign(graph.stationCount(), 0.0);
+    arcScores.assign(graph.edgeCount(), 0.0);
+    for (unsigned w = 0; w < threads; ++w) {
+        for (size_t v = 0; v < stationScores.size(); ++v) stationScores[v] += workerStations[w][v];
+        for (size_t e = 0; e < arcScores.size(); ++e) arcScores[e] += workerArcs[w][e];
+    }
+    return true;
+}
+
+// A CSV field, quoted if it would otherwise split or end early
+std::string csvField(const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) return text;
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+bool writeCsv(const std::string& filename, const std::string& text, std::string& errorMsg) {
+    QSaveFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMsg = "Failed to open CSV for writing: " + filename;
+        return false;
+    }
+    file.write(text.data(), static_cast<qint64>(text.size()));
+    if (!file.commit()) {
+        errorMsg = "Failed to write CSV: " + filename + " (" + file.errorString().toStdString() + ")";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+NetworkCentrality MetroSystem::computeCentrality(RouteCriterion criterion, size_t sampleSources, unsigned threads,
+                                                 uint64_t seed, const CancelFlag* cancel) const {
+    NetworkCentrality centrality;
+    const std::shared_ptr<const NetworkState> network = this->network();
+    const MetroGraph& graph = network->graph;
+    const size_t stationCount = graph.stationCount();
+    if (stationCount == 0 || criterion == RouteCriterion::Distance) return centrality;
+
+    std::vector<StationId> sources(stationCount);
+    for (StationId v = 0; v < stationCount; ++v) sources[v] = v;
+    if (sampleSources > 0 && sampleSources < stationCount) {
+        std::mt19937_64 rng(seed);
+        std::shuffle(sources.begin(), sources.end(), rng);
+        sources.resize(sampleSources);
+        centrality.sampled = true;
+    }
+    centrality.sources = sources.size();
+
+    std::vector<double> stationScores;
+    std::vector<double> arcScores;
+    bool done = false;
+    switch (criterion) {
+    case RouteCriterion::LeastStops:
+        done = sumDependencies<HopWeight>(graph, sources, threads, stationScores, arcScores, cancel);
+        break;
+    case RouteCriterion::Time:
+        done = sumDependencies<TimeWeight>(graph, sources, threads, stationScores, arcScores, cancel);
+        break;
+    case RouteCriterion::Cost:
+        done = sumDependencies<CostWeight>(graph, sources, threads, stationScores, arcScores, cancel);
+        break;
+    case RouteCriterion::Distance:
+        break;
+    }
+    if (!done) return NetworkCentrality();
+
+    // Every pair was counted once from each end; a sample stands in for
+    // all sources in proportion
+    const double scale = 0.5 * static_cast<double>(stationCount) / static_cast<double>(sources.size());
+    centrality.stations.reserve(stationCount);
+    for (StationId v = 0; v < stationCount; ++v) {
+        centrality.stations.push_back(StationCentrality{stationNames_[v], stationScores[v] * scale});
+    }
+    centrality.segments.reserve(graph.edgeCount() / 2);
+    for (StationId u = 0; u < stationCount; ++u) {
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            const StationId v = graph.targets[e];
+            const LineId line = graph.lines[e];
+            // Each segment once, from its first arc; closed arcs are
+            // self-loops. A segment listed twice in the CSV has parallel
+            // arcs, and routes may ride either, so all of them are summed.
+            if (u >= v) continue;
+            bool seen = false;
+            for (EdgeId other = graph.edgesBegin(u); other < e && !seen; ++other) {
+                seen = graph.targets[other] == v && graph.lines[other] == line;
+            }
+            if (seen) continue;
+            double score = 0.0;
+            for (EdgeId other = e; other < graph.edgesEnd(u); ++other) {
+                if (graph.targets[other] == v && graph.lines[other] == line) score += arcScores[other];
+            }
+            for (EdgeId back = graph.edgesBegin(v); back < graph.edgesEnd(v); ++back) {
+                if (graph.targets[back] == u && graph.lines[back] == line) score += arcScores[back];
+            }
+            centrality.segments.push_back(SegmentCentrality{stationNames_[u], stationNames_[v],
+                                                            network->lineNames[line], score * scale});
+        }
+    }
+    std::stable_sort(centrality.stations.begin(), centrality.stations.end(),
+                     [](const StationCentrality& a, const StationCentrality& b) { return a.betweenness > b.betweenness; });
+    std::stable_sort(centrality.segments.begin(), centrality.segments.end(),
+                     [](const SegmentCentrality& a, const SegmentCentrality& b) { return a.betweenness > b.betweenness; });
+    return centrality;
+}
+
+bool writeStationCentralityCsv(const NetworkCentrality& centrality, const std::string& filename, std::string& errorMsg) {
+    std::string text = "Station,Betweenness\n";
+    for (const StationCentrality& station : centrality.stations) {
+        text += csvField(station.station) + "," + std::to_string(station.betweenness) + "\n";
+    }
+    return writeCsv(filename, text, errorMsg);
+}
+
+bool writeSegmentCentralityCsv(const NetworkCentrality& centrality, const std::string& filename, std::string& errorMsg) {
+    std::string text = "From Station,To Station,Line,Betweenness\n";
+    for (const SegmentCentrality& segment : centrality.segments) {
+        text += csvField(segment.from) + "," + csvField(segment.to) + "," + csvField(segment.line) + "," +
+                std::to_string(segment.betweenness) + "\n";
+    }
+    return writeCsv(filename, text, errorMsg);
+}
@@ -0,0 +1,41 @@
+#ifndef NETWORKANALYTICS_H
+#define NETWORKANALYTICS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Betweenness centrality of a network (see MetroSystem::computeCentrality).
+// A station's betweenness is the number of pairs of other stations whose
+// best routes run through it, a pair with several equally good routes
+// counting for the share of them that does; a segment's is the same over
+// the routes riding it, its own two stations included. Each pair counts
+// once, whichever way it is travelled.
+
+struct StationCentrality {
+    std::string station;
+    double betweenness = 0.0;
+};
+
+// A segment of one line, named by its stations in ID order
+struct SegmentCentrality {
+    std::string from;
+    std::string to;
+    std::string line;
+    double betweenness = 0.0;
+};
+
+struct NetworkCentrality {
+    size_t sources = 0;   // Source stations searched
+    bool sampled = false; // Estimated from a sample of sources and scaled to all of them
+    std::vector<StationCentrality> stations; // Highest first
+    std::vector<SegmentCentrality> segments; // Highest first; closed segments are left out
+};
+
+// CSV export, highest first: "Station,Betweenness" and
+// "From Station,To Station,Line,Betweenness". Names are quoted when they
+// hold a comma or a quote.
+bool writeStationCentralityCsv(const NetworkCentrality& centrality, const std::string& filename, std::string& errorMsg);
+bool writeSegmentCentralityCsv(const NetworkCentrality& centrality, const std::string& filename, std::string& errorMsg);
+
+#endif // NETWORKANALYTICS_H
@@ -0,0 +1,99 @@
+#include "networkgenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+bool generateNetwork(const NetworkSpec& spec, const std::string& path, GeneratedNetwork& out) {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) return false;
+    std::vector<char> buffer(1 << 20);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    std::fprintf(file, "From Station,To Station,Time (min),Distance (km),Cost (INR),Line,From Lat,From Lon,To Lat,To Lon\n");
+
+    std::mt19937 rng(spec.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    // Roughly square area that keeps station spacing around a kilometre
+    constexpr double kKmPerDegree = 111.0;
+    constexpr double kCenterLat = 28.6;
+    constexpr double kCenterLon = 77.2;
+    const double lonKmPerDegree = kKmPerDegree * std::cos(kCenterLat * 3.14159265358979323846 / 180.0);
+    const double sideKm = std::max(10.0, std::sqrt(static_cast<double>(spec.stations)) * 1.2);
+
+    std::vector<std::pair<double, double>> position; // (x km, y km) by station
+    position.reserve(spec.stations);
+    // Spatial grid of 2 km cells for finding a station to interchange with
+    constexpr double kCellKm = 2.0;
+    std::unordered_map<int64_t, std::vector<uint32_t>> grid;
+    auto cellOf = [&](double x, double y) {
+        return (static_cast<int64_t>(std::floor(x / kCellKm)) << 32) ^ static_cast<int64_t>(std::floor(y / kCellKm) + (1LL << 31));
+    };
+    auto addStation = [&](double x, double y) {
+        position.emplace_back(x, y);
+        const uint32_t id = static_cast<uint32_t>(position.size() - 1);
+        grid[cellOf(x, y)].push_back(id);
+        return id;
+    };
+
+    const size_t lines = std::max<size_t>(1, spec.lines);
+    const size_t stopsPerLine = std::max<size_t>(2, spec.stations / lines);
+    size_t edges = 0;
+    for (size_t line = 0; line < lines; ++line) {
+        double x = unit(rng) * sideKm;
+        double y = unit(rng) * sideKm;
+        double heading = unit(rng) * 2 * 3.14159265358979323846;
+        uint32_t previous = addStation(x, y);
+        for (size_t stop = 1; stop < stopsPerLine; ++stop) {
+            heading += (unit(rng) - 0.5) * 0.6;
+            const double stepKm = 0.6 + unit(rng) * 1.4;
+            x = std::clamp(x + std::cos(heading) * stepKm, 0.0, sideKm);
+            y = std::clamp(y + std::sin(heading) * stepKm, 0.0, sideKm);
+            if (x <= 0.0 || x >= sideKm || y <= 0.0 || y >= sideKm) heading += 3.14159265358979323846 / 2;
+
+            uint32_t current = UINT32_MAX;
+            if (unit(rng) < spec.interchangeRate) {
+                auto it = grid.find(cellOf(x, y));
+                if (it != grid.end()) {
+                    for (uint32_t candidate : it->second) {
+                        if (candidate != previous) {
+                            current = candidate;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (current == UINT32_MAX) {
+                current = addStation(x, y);
+            } else {
+                x = position[current].first;
+                y = position[current].second;
+            }
+
+            const double km = std::hypot(position[current].first - position[previous].first,
+                                         position[current].second - position[previous].second);
+            int time;
+            int cost;
+            if (spec.weights == "uniform") {
+                time = std::uniform_int_distribution<int>(spec.minTime, spec.maxTime)(rng);
+                cost = std::uniform_int_distribution<int>(spec.minCost, spec.maxCost)(rng);
+            } else {
+                // About 35 km/h with some noise; fares in steps of 5 by length
+                time = std::clamp(static_cast<int>(std::lround(km / 0.6 + unit(rng))), spec.minTime, spec.maxTime);
+                cost = std::clamp(spec.minCost + 5 * static_cast<int>(km), spec.minCost, spec.maxCost);
+            }
+            auto lat = [&](uint32_t s) { return kCenterLat + (position[s].second - sideKm / 2) / kKmPerDegree; };
+            auto lon = [&](uint32_t s) { return kCenterLon + (position[s].first - sideKm / 2) / lonKmPerDegree; };
+            std::fprintf(file, "S%u,S%u,%d,%.1f,%d,Line %zu,%.6f,%.6f,%.6f,%.6f\n",
+                         previous, current, time, km, cost, line + 1, lat(previous), lon(previous), lat(current), lon(current));
+            edges++;
+            previous = current;
+        }
+    }
+    const bool ok = std::fclose(file) == 0;
+    out.stations = position.size();
+    out.edges = edges;
+    return ok;
+}
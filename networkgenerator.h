@@ -0,0 +1,35 @@
+#ifndef NETWORKGENERATOR_H
+#define NETWORKGENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Synthetic metro networks in the 10-column CSV schema of
+// metroFinalData.csv, for metrobench and the engine equivalence test.
+
+// What the generator builds. Lines are random walks across a city-sized
+// area; at each step a line either opens a new station or, with
+// probability interchangeRate, runs through an existing station nearby,
+// which becomes an interchange.
+struct NetworkSpec {
+    size_t stations = 10000;
+    size_t lines = 20;
+    double interchangeRate = 0.1;
+    std::string weights = "distance"; // "distance": time/cost follow length; "uniform": drawn independently
+    int minTime = 1;
+    int maxTime = 6;
+    int minCost = 10;
+    int maxCost = 60;
+    uint32_t seed = 42;
+};
+
+struct GeneratedNetwork {
+    size_t stations = 0;
+    size_t edges = 0;
+};
+
+// Writes the network to path; false if the file could not be written
+bool generateNetwork(const NetworkSpec& spec, const std::string& path, GeneratedNetwork& out);
+
+#endif // NETWORKGENERATOR_H
@@ -0,0 +1,363 @@
+#include "metrosystem.h"
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <limits>
+
+// Live updates are kept as a list of disruptions on top of the loaded
+// network. Each batch derives a new NetworkState from the loaded graph and
+// the full list, publishes it with one pointer swap, and then drops only
+// the cached routes the batch can have changed.
+
+namespace {
+
+constexpr size_t kCriterionCount = 4;
+using CriterionSet = std::array<bool, kCriterionCount>; // Indexed by RouteCriterion
+
+constexpr CriterionSet kAllCriteria = {true, true, true, true};
+
+// Returned by the line lookup below for a name no line has
+constexpr LineId kUnknownLine = std::numeric_limits<LineId>::max() - 1;
+
+CriterionSet onlyCriterion(RouteCriterion criterion) {
+    CriterionSet set{};
+    set[static_cast<size_t>(criterion)] = true;
+    return set;
+}
+
+// Which cached routes a batch makes wrong. Closures and weight increases
+// only affect routes that use the segment; anything that can make some
+// route shorter (reopening, adding, lowering a weight) affects every route
+// of the criteria concerned.
+struct RouteInvalidation {
+    struct Segment {
+        std::string a;
+        std::string b;
+        std::string line; // Empty for every line
+        CriterionSet criteria;
+    };
+    CriterionSet everyRoute{};
+    std::vector<std::string> stations; // Routes through these, for every criterion
+    std::vector<Segment> segments;
+
+    bool affects(RouteCriterion criterion, const std::vector<PathSegment>& path) const {
+        const size_t c = static_cast<size_t>(criterion);
+        if (everyRoute[c]) return true;
+        for (size_t i = 0; i < path.size(); ++i) {
+            for (const std::string& station : stations) {
+                if (path[i].stationName == station) return true;
+            }
+            if (i == 0) continue;
+            const std::string& from = path[i - 1].stationName;
+            const std::string& to = path[i].stationName;
+            for (const Segment& segment : segments) {
+                if (!segment.criteria[c]) continue;
+                const bool sameStations = (from == segment.a && to == segment.b) || (from == segment.b && to == segment.a);
+                if (sameStations && (segment.line.empty() || segment.line == path[i].lineTakenToReach)) return true;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+// The loaded graph with every disruption applied. Weights are set before
+// closures are, since a closed arc no longer leads to its station. A closed
+// arc is pointed back at its own station: it can never improve a label, so
+// the search kernels skip it without a check of their own, and closures and
+// weight changes leave every EdgeId as it was. Temporary segments do not:
+// insertEdges puts their arcs into the runs of their stations, which moves
+// every later arc up. So no loaded-graph EdgeId may be used on a derived
+// graph that has temporary segments. The hierarchies are not queried while
+// there are any, and the hierarchies and the timetable learn what became
+// of the loaded arcs from loadedArcChanges, which is indexed by loaded
+// EdgeIds.
+//
+// The state graph is updated, not rebuilt: weights are read from the graph
+// and closures change no state or ride, only where closed arcs lead, so
+// the loaded one is copied and the rides of the closed arcs re-pointed.
+// Only temporary segments, which bring new arcs, new states and shifted
+// EdgeIds, rebuild it in full.
+std::shared_ptr<MetroSystem::NetworkState> MetroSystem::deriveNetwork(const Disruptions& disruptions) const {
+    const NetworkState& loaded = *loadedNetwork_;
+    auto network = std::make_shared<NetworkState>();
+    network->graph = loaded.graph;
+    network->lineNames = loaded.lineNames;
+    network->lineNames.insert(network->lineNames.end(), disruptions.extraLines.begin(), disruptions.extraLines.end());
+    network->maxSpeedKmPerMinute = loaded.maxSpeedKmPerMinute;
+    network->disruptions = disruptions;
+    MetroGraph& graph = network->graph;
+
+    if (!disruptions.temporarySegments.empty()) {
+        std::vector<Edge> temporary;
+        temporary.reserve(disruptions.temporarySegments.size());
+        for (const auto& entry : disruptions.temporarySegments) {
+            temporary.push_back(entry.second);
+            raiseAStarBound(*network, entry.second.from, entry.second.to, entry.second.time);
+        }
+        graph.insertEdges(temporary);
+    }
+
+    // Calls visit(e) for both arcs of every segment the key covers
+    auto forEachArc = [&graph](const SegmentKey& key, auto visit) {
+        for (StationId u : {key.a, key.b}) {
+            const StationId v = u == key.a ? key.b : key.a;
+            for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+                if (graph.targets[e] == v && (key.line == kAnyLine || graph.lines[e] == key.line)) visit(e);
+            }
+        }
+    };
+
+    // All-lines weights first, so that the one-line entries, which hold
+    // every value set for their line, have the last word on it
+    for (const bool allLines : {true, false}) {
+        for (const auto& entry : disruptions.weights) {
+            if ((entry.first.line == kAnyLine) != allLines) continue;
+            const int time = entry.second.first;
+            const int cost = entry.second.second;
+            forEachArc(entry.first, [&](EdgeId e) {
+                if (time >= 0) graph.times[e] = time;
+                if (cost >= 0) graph.costs[e] = cost;
+                graph.widenWeightRanges(graph.times[e], graph.costs[e]);
+            });
+            if (time >= 0) raiseAStarBound(*network, entry.first.a, entry.first.b, time);
+        }
+    }
+
+    std::vector<EdgeId> closedArcs;
+    for (const SegmentKey& key : disruptions.closedSegments) {
+        forEachArc(key, [&](EdgeId e) {
+            // The arc's source is whichever end it does not lead to
+            graph.targets[e] = graph.targets[e] == key.a ? key.b : key.a;
+            closedArcs.push_back(e);
+        });
+    }
+    for (StationId station : disruptions.closedStations) {
+        for (EdgeId e = graph.edgesBegin(station); e < graph.edgesEnd(station); ++e) {
+            const StationId neighbor = graph.targets[e];
+            for (EdgeId back = graph.edgesBegin(neighbor); back < graph.edgesEnd(neighbor); ++back) {
+                if (graph.targets[back] == station) {
+                    graph.targets[back] = neighbor;
+                    closedArcs.push_back(back);
+                }
+            }
+            graph.targets[e] = station;
+            closedArcs.push_back(e);
+        }
+    }
+
+    // Compare every loaded arc with what became of it. Temporary arcs sit
+    // after the loaded ones in each station's run, so a loaded arc keeps
+    // its place in the run.
+    if (!disruptions.empty()) {
+        const MetroGraph& before = loaded.graph;
+        network->loadedArcChanges.assign(before.edgeCount(), 0);
+        for (StationId u = 0; u < before.stationCount(); ++u) {
+            const EdgeId shift = graph.edgesBegin(u) - before.edgesBegin(u);
+            for (EdgeId e = before.edgesBegin(u); e < before.edgesEnd(u); ++e) {
+                const EdgeId now = e + shift;
+                uint8_t change = 0;
+                if (graph.targets[now] != before.targets[e]) change |= kArcClosed;
+                if (graph.times[now] != before.times[e]) change |= kArcTimeChanged;
+                if (graph.costs[now] != before.costs[e]) change |= kArcCostChanged;
+                network->timeLowered = network->timeLowered || graph.times[now] < before.times[e];
+                network->costLowered = network->costLowered || graph.costs[now] < before.costs[e];
+                network->loadedArcChanges[e] = change;
+            }
+        }
+    }
+
+    if (disruptions.temporarySegments.empty()) {
+        network->transfers = loaded.transfers;
+        network->transfers.retargetRides(graph, closedArcs);
+    } else {
+        network->transfers.build(graph);
+    }
+    return network;
+}
+
+bool MetroSystem::applyUpdates(const std::vector<NetworkUpdate>& updates, std::string& errorMsg) {
+    std::lock_guard<std::mutex> updateLock(updateMutex_);
+    if (loadedNetwork_->graph.empty()) {
+        errorMsg = "No network loaded.";
+        return false;
+    }
+    const std::shared_ptr<const NetworkState> current = network();
+    const MetroGraph& currentGraph = current->graph;
+    const MetroGraph& loadedGraph = loadedNetwork_->graph;
+    Disruptions disruptions = current->disruptions;
+    RouteInvalidation invalidation;
+
+    auto lineId = [&](const std::string& name) {
+        if (name.empty()) return kAnyLine;
+        const std::vector<std::string>& loadedLines = loadedNetwork_->lineNames;
+        auto it = std::find(loadedLines.begin(), loadedLines.end(), name);
+        if (it != loadedLines.end()) return static_cast<LineId>(it - loadedLines.begin());
+        auto extra = std::find(disruptions.extraLines.begin(), disruptions.extraLines.end(), name);
+        if (extra != disruptions.extraLines.end()) {
+            return static_cast<LineId>(loadedLines.size() + (extra - disruptions.extraLines.begin()));
+        }
+        return kUnknownLine;
+    };
+    // True if the loaded network or a temporary segment has this segment
+    auto segmentExists = [&](const SegmentKey& key) {
+        for (EdgeId e = loadedGraph.edgesBegin(key.a); e < loadedGraph.edgesEnd(key.a); ++e) {
+            if (key.covers(key.a, loadedGraph.targets[e], loadedGraph.lines[e])) return true;
+        }
+        for (const auto& entry : disruptions.temporarySegments) {
+            if (key.covers(entry.second.from, entry.second.to, entry.second.line)) return true;
+        }
+        return false;
+    };
+
+    for (size_t i = 0; i < updates.size(); ++i) {
+        const NetworkUpdate& update = updates[i];
+        const std::string where = "Update " + std::to_string(i + 1) + ": ";
+        const StationId from = stationId(update.from);
+        if (from == kInvalidStation) {
+            errorMsg = where + "unknown station: " + update.from;
+            return false;
+        }
+
+        if (update.kind == NetworkUpdate::Kind::CloseStation) {
+            disruptions.closedStations.insert(from);
+            invalidation.stations.push_back(update.from);
+            continue;
+        }
+        if (update.kind == NetworkUpdate::Kind::ReopenStation) {
+            if (disruptions.closedStations.erase(from)) invalidation.everyRoute = kAllCriteria;
+            continue;
+        }
+
+        const StationId to = stationId(update.to);
+        if (to == kInvalidStation || to == from) {
+            errorMsg = where + (to == from ? "a segment needs two different stations" : "unknown station: " + update.to);
+            return false;
+        }
+        SegmentKey key{std::min(from, to), std::max(from, to), kAnyLine};
+
+        if (update.kind == NetworkUpdate::Kind::AddTemporarySegment) {
+            if (update.line.empty() || update.time < 0 || update.cost < 0 || update.distance < 0.0) {
+                errorMsg = where + "a temporary segment needs a line and non-negative time, cost and distance";
+                return false;
+            }
+            LineId line = lineId(update.line);
+            if (line == kUnknownLine) {
+                line = static_cast<LineId>(loadedNetwork_->lineNames.size() + disruptions.extraLines.size());
+                disruptions.extraLines.push_back(update.line);
+            }
+            key.line = line;
+            disruptions.temporarySegments[key] = Edge{from, to, update.time, update.distance, update.cost, line};
+            invalidation.everyRoute = kAllCriteria;
+            continue;
+        }
+
+        key.line = lineId(update.line);
+        if (key.line == kUnknownLine) {
+            errorMsg = where + "unknown line: " + update.line;
+            return false;
+        }
+        const RouteInvalidation::Segment usedBy{update.from, update.to, update.line, kAllCriteria};
+
+        switch (update.kind) {
+        case NetworkUpdate::Kind::CloseSegment:
+            if (!segmentExists(key)) {
+                errorMsg = where + "no segment " + update.from + " - " + update.to + (update.line.empty() ? "" : " on " + update.line);
+                return false;
+            }
+            disruptions.closedSegments.insert(key);
+            invalidation.segments.push_back(usedBy);
+            break;
+        case NetworkUpdate::Kind::ReopenSegment:
+            if (disruptions.closedSegments.erase(key)) invalidation.everyRoute = kAllCriteria;
+            break;
+        case NetworkUpdate::Kind::RemoveTemporarySegment:
+            for (auto it = disruptions.temporarySegments.begin(); it != disruptions.temporarySegments.end();) {
+                if (key.covers(it->second.from, it->second.to, it->second.line)) {
+                    it = disruptions.temporarySegments.erase(it);
+                    invalidation.segments.push_back(usedBy);
+                } else {
+                    ++it;
+                }
+            }
+            break;
+        case NetworkUpdate::Kind::SetSegmentWeights: {
+            if ((update.time < 0 && update.cost < 0) || !segmentExists(key)) {
+                errorMsg = where + (update.time < 0 && update.cost < 0
+                                        ? "nothing to change"
+                                        : "no segment " + update.from + " - " + update.to + (update.line.empty() ? "" : " on " + update.line));
+                return false;
+            }
+            // Later updates win, whatever lines they name: an all-lines
+            // value also overwrites the one-line entries of the pair, and a
+            // new one-line entry starts from the all-lines one, so it holds
+            // every value set for its line (deriveNetwork applies it last)
+            auto set = [&update](std::pair<int, int>& weights) {
+                if (update.time >= 0) weights.first = update.time;
+                if (update.cost >= 0) weights.second = update.cost;
+            };
+            if (key.line == kAnyLine) {
+                auto it = disruptions.weights.lower_bound(SegmentKey{key.a, key.b, 0});
+                for (; it != disruptions.weights.end() && it->first.a == key.a && it->first.b == key.b; ++it) set(it->second);
+            }
+            auto existing = disruptions.weights.find(key);
+            if (existing == disruptions.weights.end()) {
+                auto all = disruptions.weights.find(SegmentKey{key.a, key.b, kAnyLine});
+                const std::pair<int, int> start = all == disruptions.weights.end() ? std::make_pair(-1, -1) : all->second;
+                existing = disruptions.weights.emplace(key, start).first;
+            }
+            set(existing->second);
+            // Compare with what the arcs have now: a lower value can shorten
+            // any route, a higher one only the routes that use the segment.
+            for (EdgeId e = currentGraph.edgesBegin(from); e < currentGraph.edgesEnd(from); ++e) {
+                if (!key.covers(from, currentGraph.targets[e], currentGraph.lines[e])) continue;
+                const std::pair<int, RouteCriterion> changes[] = {{currentGraph.times[e], RouteCriterion::Time},
+                                                                  {currentGraph.costs[e], RouteCriterion::Cost}};
+                const int updated[] = {update.time, update.cost};
+                for (int w = 0; w < 2; ++w) {
+                    if (updated[w] < 0 || updated[w] == changes[w].first) continue;
+                    if (updated[w] < changes[w].first) {
+                        invalidation.everyRoute[static_cast<size_t>(changes[w].second)] = true;
+                    } else {
+                        invalidation.segments.push_back({update.from, update.to, update.line, onlyCriterion(changes[w].second)});
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    std::shared_ptr<NetworkState> next = deriveNetwork(disruptions);
+    next->version = ++networkVersion_;
+    size_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(publishMutex_);
+        std::atomic_store(&network_, std::shared_ptr<const NetworkState>(std::move(next)));
+        dropped = routeCache_.eraseIf([&invalidation](const RouteKey& key, const std::vector<PathSegment>& path) {
+            return invalidation.affects(key.criterion, path);
+        });
+    }
+    qDebug() << "Applied" << updates.size() << "network update(s); dropped" << dropped << "cached route(s).";
+    errorMsg = "";
+    return true;
+}
+
+void MetroSystem::clearUpdates() {
+    std::lock_guard<std::mutex> updateLock(updateMutex_);
+    if (network()->disruptions.empty()) return;
+    std::lock_guard<std::mutex> lock(publishMutex_);
+    std::atomic_store(&network_, loadedNetwork_);
+    routeCache_.clear(); // Everything reopened; any route may be shorter now
+}
+
+bool MetroSystem::hasUpdates() const {
+    return !network()->disruptions.empty();
+}
+
+uint64_t MetroSystem::networkVersion() const {
+    return network()->version;
+}
@@ -0,0 +1,141 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller passes 0
+inline unsigned defaultThreadCount() {
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1 : hw;
+}
+
+// Threads shared by every parallelFor, started on first use and kept until
+// the process exits, so what a body keeps in thread_local workspaces is
+// still there on the next call. The pool grows to the most helpers one
+// call has asked for.
+class WorkerPool {
+public:
+    static WorkerPool& instance() {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    // Runs task on a pool thread, first starting threads until there are
+    // at least `threads`
+    void post(std::function<void()> task, unsigned threads) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (threads_.size() < threads) threads_.emplace_back([this] { work(); });
+        tasks_.push_back(std::move(task));
+        wake_.notify_one();
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) thread.join();
+    }
+
+private:
+    WorkerPool() = default;
+
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+// One parallelFor call as its helpers see it. A helper that starts after
+// the caller has closed the call finds nothing left to do and leaves
+// without touching the caller's stack; the caller only waits for helpers
+// that did start.
+class ParallelCall {
+public:
+    bool enter() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) return false;
+        running_++;
+        return true;
+    }
+    void leave() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--running_ == 0) idle_.notify_all();
+    }
+    void close() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        closed_ = true;
+        idle_.wait(lock, [this] { return running_ == 0; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    unsigned running_ = 0;
+    bool closed_ = false;
+};
+
+// Calls body(worker, index) for every index in [0, count), spread over up to
+// `threads` threads (0 = one per core): the calling thread and helpers from
+// WorkerPool. Indices are handed out one at a time from a shared counter,
+// so uneven work balances itself, and the caller works through them itself
+// if the helpers are busy elsewhere, so calls may nest or run side by side.
+// worker is in [0, threads) and lets the body pick its own per-thread
+// workspace.
+template <typename Body>
+void parallelFor(size_t count, unsigned threads, Body body) {
+    if (threads == 0) threads = defaultThreadCount();
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) body(0u, i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto run = [&](unsigned worker) {
+        for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+             i = next.fetch_add(1, std::memory_order_relaxed)) {
+            body(worker, i);
+        }
+    };
+    const auto call = std::make_shared<ParallelCall>();
+    WorkerPool& pool = WorkerPool::instance();
+    for (unsigned w = 1; w < threads; ++w) {
+        pool.post(
+            [call, &run, w] {
+                if (!call->enter()) return;
+                run(w);
+                call->leave();
+            },
+            threads - 1);
+    }
+    run(0);
+    call->close();
+}
+
+#endif // PARALLEL_H
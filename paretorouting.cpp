@@ -0,0 +1,209 @@
+#include "metrosystem.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+
+// Multi-criteria routing over the (station, line) state graph. A label is
+// one way of reaching a state, as its time, cost and changes of line so
+// far; a state keeps every label that no other label there beats on all
+// three (its bag). Labels are settled in order of time, then cost, then
+// changes, each plus the exact remaining time and cost to end, so the
+// routes to end come out fastest first and a settled label is never beaten
+// later at its own state (Martins' label-setting algorithm, A*-ordered).
+//
+// Labels are pruned three ways: a new label beaten in its state's bag is
+// dropped, and drops the bag's labels it beats in turn; a label with more
+// changes than allowed is dropped; and a label that, even with the
+// remaining time and cost added, cannot beat a route already found is
+// dropped. The remaining times and costs come from two searches from end,
+// which are exact bounds because every segment runs both ways.
+
+namespace {
+
+constexpr uint32_t kNoLabel = std::numeric_limits<uint32_t>::max();
+
+struct ParetoLabel {
+    long long time;
+    long long cost;
+    StateId state;
+    uint32_t parent;    // Label this one extends, kNoLabel at the start
+    EdgeId edge;        // Ride from the parent's state, kInvalidEdge for a change of line
+    uint32_t nextInBag; // Next label of the state's bag
+    uint32_t transfers;
+    bool dead;          // Beaten after it was queued; skipped when popped
+};
+
+// Queue entry: a label under its key (value so far plus the bound to end)
+struct ParetoKey {
+    long long time;
+    long long cost;
+    uint32_t transfers;
+    uint32_t label;
+    bool operator>(const ParetoKey& other) const {
+        return std::tie(time, cost, transfers) > std::tie(other.time, other.cost, other.transfers);
+    }
+};
+
+// a is at least as good as b on every criterion
+bool covers(long long aTime, long long aCost, uint32_t aTransfers, long long bTime, long long bCost, uint32_t bTransfers) {
+    return aTime <= bTime && aCost <= bCost && aTransfers <= bTransfers;
+}
+
+// Labels, bags and queue of the calling thread's searches, kept from one
+// query to the next. Bags are linked lists through the label pool, headed
+// per state; like SearchWorkspace, a head from an older epoch reads as an
+// empty bag, so a query does not clear them.
+struct ParetoWorkspace {
+    std::vector<ParetoLabel> labels;
+    std::vector<uint32_t> bagHeads;
+    std::vector<uint32_t> bagEpochs;
+    uint32_t epoch = 0;
+    std::vector<ParetoKey> queue;
+    std::vector<uint32_t> routes; // Settled labels at end, fastest first
+
+    void reset(size_t stateCount) {
+        labels.clear();
+        queue.clear();
+        routes.clear();
+        if (bagHeads.size() != stateCount || ++epoch == 0) {
+            bagHeads.assign(stateCount, kNoLabel);
+            bagEpochs.assign(stateCount, 0);
+            epoch = 1;
+        }
+    }
+    uint32_t& bagHead(StateId s) {
+        if (bagEpochs[s] != epoch) {
+            bagEpochs[s] = epoch;
+            bagHeads[s] = kNoLabel;
+        }
+        return bagHeads[s];
+    }
+};
+
+// Slots of the two searches from end; the state graph search itself uses
+// no SearchWorkspace
+constexpr int kTimeBoundSlot = 0;
+constexpr int kCostBoundSlot = 1;
+
+// Fills workspace with every station's least Weight to end
+template <typename Weight, int Slot>
+void boundsTo(const MetroGraph& graph, StationId end, SearchWorkspace<typename Weight::Value>& workspace,
+              const CancelFlag* cancel) {
+    withThreadDijkstraQueue<Weight, Slot>(graph, [&](auto& queue) {
+        runShortestPathKernel<Weight>(graph, end, queue, workspace,
+                                      [cancel](StationId, typename Weight::Value) { return isCancelled(cancel); });
+    });
+}
+
+} // namespace
+
+std::vector<ParetoRoute> MetroSystem::paretoRoutes(const NetworkState& network, StationId start, StationId end,
+                                                   int maxTransfers, const CancelFlag* cancel) const {
+    const MetroGraph& graph = network.graph;
+    const TransferGraph& states = network.transfers;
+    SearchWorkspace<TimeWeight::Value>& timeBound = threadSearchWorkspace<TimeWeight::Value, kTimeBoundSlot>();
+    SearchWorkspace<CostWeight::Value>& costBound = threadSearchWorkspace<CostWeight::Value, kCostBoundSlot>();
+    boundsTo<TimeWeight, kTimeBoundSlot>(graph, end, timeBound, cancel);
+    if (!timeBound.reached(start) || isCancelled(cancel)) return {};
+    boundsTo<CostWeight, kCostBoundSlot>(graph, end, costBound, cancel);
+    if (isCancelled(cancel)) return {};
+
+    thread_local ParetoWorkspace workspace;
+    workspace.reset(states.stateCount());
+    std::vector<ParetoLabel>& labels = workspace.labels;
+    std::vector<ParetoKey>& queue = workspace.queue;
+    const auto later = std::greater<ParetoKey>();
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+
+    // True if a route found so far is at least as good as the given values
+    auto beatenByRoute = [&](long long time, long long cost, uint32_t transfers) {
+        for (uint32_t route : workspace.routes) {
+            const ParetoLabel& found = labels[route];
+            if (covers(found.time, found.cost, found.transfers, time, cost, transfers)) return true;
+        }
+        return false;
+    };
+
+    // Adds a label to state's bag and the queue, unless it is pruned
+    auto insert = [&](StateId state, long long time, long long cost, uint32_t transfers, uint32_t parent, EdgeId edge) {
+        METRO_STAT(counters.relaxed++);
+        const StationId station = states.station(state);
+        if (transfers > static_cast<uint32_t>(maxTransfers) || !timeBound.reached(station)) return;
+        const ParetoKey key{time + timeBound.distance(station), cost + costBound.distance(station), transfers,
+                            static_cast<uint32_t>(labels.size())};
+        if (beatenByRoute(key.time, key.cost, key.transfers)) return;
+        uint32_t* link = &workspace.bagHead(state);
+        while (*link != kNoLabel) {
+            ParetoLabel& other = labels[*link];
+            if (covers(other.time, other.cost, other.transfers, time, cost, transfers)) return;
+            if (covers(time, cost, transfers, other.time, other.cost, other.transfers)) {
+                other.dead = true;
+                *link = other.nextInBag;
+            } else {
+                link = &other.nextInBag;
+            }
+        }
+        labels.push_back(ParetoLabel{time, cost, state, parent, edge, workspace.bagHead(state), transfers, false});
+        workspace.bagHead(state) = key.label;
+        queue.push_back(key);
+        std::push_heap(queue.begin(), queue.end(), later);
+        METRO_STAT(counters.pushes++);
+    };
+
+    // Boarding at the start is free: every line there starts a route
+    for (StateId s = states.statesBegin(start); s < states.statesEnd(start); ++s) {
+        insert(s, 0, 0, 0, kNoLabel, kInvalidEdge);
+    }
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), later);
+        const uint32_t current = queue.back().label;
+        queue.pop_back();
+        if (labels[current].dead) {
+            METRO_STAT(counters.stalePops++);
+            continue;
+        }
+        if (isCancelled(cancel)) return {};
+        METRO_STAT(counters.settled++);
+        // Copied: insert may grow the pool
+        const ParetoLabel label = labels[current];
+        const StationId u = states.station(label.state);
+        if (u == end) {
+            // Routes come fastest first, so only an earlier one can beat it
+            if (!beatenByRoute(label.time, label.cost, label.transfers)) workspace.routes.push_back(current);
+            continue; // Riding on past end cannot beat stopping there
+        }
+        for (uint32_t r = states.ridesBegin(label.state); r < states.ridesEnd(label.state); ++r) {
+            const EdgeId e = states.rideEdge(r);
+            insert(states.rideTarget(r), label.time + graph.times[e], label.cost + graph.costs[e], label.transfers,
+                   current, e);
+        }
+        for (StateId other = states.statesBegin(u); other < states.statesEnd(u); ++other) {
+            if (other != label.state) insert(other, label.time, label.cost, label.transfers + 1u, current, kInvalidEdge);
+        }
+    }
+
+    std::vector<ParetoRoute> routes;
+    routes.reserve(workspace.routes.size());
+    thread_local std::vector<ContractionHierarchy::PathStep> steps;
+    for (uint32_t route : workspace.routes) {
+        steps.clear();
+        for (uint32_t l = route; labels[l].parent != kNoLabel; l = labels[l].parent) {
+            if (labels[l].edge != kInvalidEdge) steps.emplace_back(states.station(labels[l].state), labels[l].edge);
+        }
+        std::reverse(steps.begin(), steps.end());
+        const ParetoLabel& label = labels[route];
+        routes.push_back(ParetoRoute{buildPath(network, start, steps), label.time, label.cost,
+                                     static_cast<int>(label.transfers)});
+    }
+    return routes;
+}
+
+std::vector<ParetoRoute> MetroSystem::findParetoRoutes(const std::string& start, const std::string& end, int maxTransfers,
+                                                       const CancelFlag* cancel) const {
+    StationId startId = stationId(start);
+    StationId endId = stationId(end);
+    if (startId == kInvalidStation || endId == kInvalidStation) return {};
+    if (startId == endId) return {ParetoRoute{{PathSegment(start, "", 0, 0, true)}, 0, 0, 0}};
+
+    const std::shared_ptr<const NetworkState> network = this->network();
+    return paretoRoutes(*network, startId, endId, std::max(maxTransfers, 0), cancel);
+}
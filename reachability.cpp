@@ -0,0 +1,73 @@
+#include "metrosystem.h"
+#include "parallel.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+
+// Budgeted one-to-all searches. The kernel settles stations in order of
+// their value, so the first station settled beyond the budget ends the
+// search and everything collected before it is within reach.
+template <typename Weight>
+void MetroSystem::collectReachable(const NetworkState& network, StationId source, long long budget,
+                                   std::vector<ReachableStation>& stations) const {
+    using Value = typename Weight::Value;
+    const MetroGraph& graph = network.graph;
+    SearchWorkspace<Value>& workspace = threadSearchWorkspace<Value>();
+    withThreadDijkstraQueue<Weight>(graph, [&](auto& queue) {
+        runShortestPathKernel<Weight>(graph, source, queue, workspace,
+                                      [&](StationId v, Value value) {
+                                          if (value > budget) return true;
+                                          stations.push_back(ReachableStation{stationNames_[v], value});
+                                          return false;
+                                      });
+    });
+}
+
+void MetroSystem::reachable(const NetworkState& network, StationId source, RouteCriterion criterion, long long budget,
+                            std::vector<ReachableStation>& stations) const {
+    // A closed station is left out of every route, its own included
+    if (budget < 0 || network.disruptions.closedStations.count(source)) return;
+    switch (criterion) {
+    case RouteCriterion::LeastStops: collectReachable<HopWeight>(network, source, budget, stations); break;
+    case RouteCriterion::Time: collectReachable<TimeWeight>(network, source, budget, stations); break;
+    case RouteCriterion::Cost: collectReachable<CostWeight>(network, source, budget, stations); break;
+    case RouteCriterion::Distance: break;
+    }
+}
+
+std::vector<ReachableStation> MetroSystem::reachableWithin(const std::string& source, RouteCriterion criterion,
+                                                           long long budget) const {
+    std::vector<ReachableStation> stations;
+    const StationId sourceId = stationId(source);
+    if (sourceId == kInvalidStation) return stations;
+    const std::shared_ptr<const NetworkState> network = this->network();
+    reachable(*network, sourceId, criterion, budget, stations);
+    return stations;
+}
+
+std::vector<std::vector<ReachableStation>> MetroSystem::reachableWithin(const std::vector<std::string>& sources,
+                                                                        RouteCriterion criterion, long long budget,
+                                                                        unsigned threads) const {
+    std::vector<std::vector<ReachableStation>> results(sources.size());
+    // Every source sees the same network, even if an update lands meanwhile
+    const std::shared_ptr<const NetworkState> network = this->network();
+    parallelFor(sources.size(), threads, [&](unsigned, size_t i) {
+        const StationId sourceId = stationId(sources[i]);
+        if (sourceId != kInvalidStation) reachable(*network, sourceId, criterion, budget, results[i]);
+    });
+    return results;
+}
+
+std::vector<IsochroneBand> MetroSystem::isochroneBands(const std::string& source, RouteCriterion criterion,
+                                                       const std::vector<long long>& bounds) const {
+    std::vector<IsochroneBand> bands;
+    if (bounds.empty()) return bands;
+    for (long long bound : bounds) bands.push_back(IsochroneBand{bound, {}});
+
+    // Stations come nearest first, so the band index only moves forward
+    size_t band = 0;
+    for (ReachableStation& station : reachableWithin(source, criterion, bounds.back())) {
+        while (station.value > bands[band].upTo) band++;
+        bands[band].stations.push_back(std::move(station.station));
+    }
+    return bands;
+}
@@ -0,0 +1,105 @@
+#include "routequeryrunner.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
+
+RouteQueryRunner::RouteQueryRunner(MetroSystem& metroSystem, QObject* parent)
+    : QObject(parent), metroSystem_(metroSystem) {
+    // A cancelled search may still be winding down while its replacement
+    // starts, so keep at least two workers.
+    pool_.setMaxThreadCount(std::max(2, QThread::idealThreadCount()));
+}
+
+RouteQueryRunner::~RouteQueryRunner() {
+    cancelAndWait();
+}
+
+void RouteQueryRunner::loadNetwork(const QStringList& candidateFiles) {
+    // Loading replaces the network under any running search
+    cancelAndWait();
+    loading_ = true;
+
+    auto* watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher]() {
+        const QString errorMessage = watcher->result();
+        watcher->deleteLater();
+        loading_ = false;
+        emit loadFinished(errorMessage.isEmpty(), errorMessage);
+    });
+
+    // Returns an empty string on success, otherwise the last load error
+    watcher->setFuture(QtConcurrent::run(&pool_, [this, candidateFiles]() {
+        if (candidateFiles.isEmpty()) return QString("No data file given.");
+        std::string errorMsg;
+        for (const QString& file : candidateFiles) {
+            qDebug() << "Attempting to load data from:" << file;
+            if (metroSystem_.loadMetroDataCached(file.toStdString(), errorMsg,
+                                                 [this](int percent) { emit loadProgress(percent); })) {
+                return QString();
+            }
+        }
+        return QString::fromStdString(errorMsg);
+    }));
+}
+
+void RouteQueryRunner::findRoute(const RouteQuery& query) {
+    cancelRoute();
+    auto cancel = std::make_shared<CancelFlag>(false);
+    activeQuery_ = cancel;
+    const quint64 generation = queryGeneration_;
+
+    auto* watcher = new QFutureWatcher<RouteQueryResult>(this);
+    connect(watcher, &QFutureWatcher<RouteQueryResult>::finished, this, [this, watcher, generation]() {
+        RouteQueryResult result = watcher->result();
+        watcher->deleteLater();
+        if (generation != queryGeneration_) return; // Superseded or cancelled meanwhile
+        activeQuery_.reset();
+        emit routeReady(result);
+    });
+
+    watcher->setFuture(QtConcurrent::run(&pool_, [this, query, cancel]() {
+        QElapsedTimer timer;
+        timer.start();
+        RouteQueryResult result;
+        result.query = query;
+        if (!query.isochroneBounds.empty()) {
+            result.bands = metroSystem_.isochroneBands(query.source.toStdString(), query.criterion, query.isochroneBounds);
+        } else if (query.departureMinute >= 0) {
+            result.path = metroSystem_.findEarliestArrival(query.source.toStdString(), query.destination.toStdString(),
+                                                           query.departureMinute, cancel.get());
+        } else if (query.pareto) {
+            result.routes = metroSystem_.findParetoRoutes(query.source.toStdString(), query.destination.toStdString(),
+                                                          MetroSystem::kDefaultParetoTransfers, cancel.get());
+            if (!result.routes.empty()) result.path = result.routes.front().path;
+        } else if (query.alternatives > 1) {
+            result.alternatives = metroSystem_.findAlternativeRoutes(query.source.toStdString(),
+                                                                     query.destination.toStdString(), query.criterion,
+                                                                     static_cast<size_t>(query.alternatives), 1,
+                                                                     cancel.get());
+            if (!result.alternatives.empty()) result.path = result.alternatives.front();
+        } else if (query.penaliseTransfers) {
+            result.path = metroSystem_.findPathWithTransfers(query.source.toStdString(), query.destination.toStdString(),
+                                                             query.criterion, query.transferPenalties, cancel.get());
+        } else {
+            result.path = metroSystem_.findPath(query.source.toStdString(), query.destination.toStdString(),
+                                                query.criterion, cancel.get(), &result.stats);
+        }
+        result.elapsedMs = timer.elapsed();
+        return result;
+    }));
+}
+
+void RouteQueryRunner::cancelRoute() {
+    if (activeQuery_) {
+        activeQuery_->store(true);
+        activeQuery_.reset();
+    }
+    ++queryGeneration_;
+}
+
+void RouteQueryRunner::cancelAndWait() {
+    cancelRoute();
+    pool_.waitForDone();
+}
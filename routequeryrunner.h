@@ -0,0 +1,71 @@
+#ifndef ROUTEQUERYRUNNER_H
+#define ROUTEQUERYRUNNER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <memory>
+
+#include "metrosystem.h"
+
+// One route request from the window, carried through to its result
+struct RouteQuery {
+    QString source;
+    QString destination;
+    RouteCriterion criterion = RouteCriterion::Time;
+    QString criterionLabel; // As shown in the criteria combo box
+    int departureMinute = -1; // Minutes after midnight for a timetable query, -1 otherwise
+    bool penaliseTransfers = false; // Route with findPathWithTransfers and these penalties
+    TransferPenalties transferPenalties;
+    bool pareto = false; // Every trade-off between time, cost and line changes (findParetoRoutes)
+    int alternatives = 1; // Above 1, this many ranked routes (findAlternativeRoutes)
+    std::vector<long long> isochroneBounds; // If set, the reach from source in these bands instead of a route
+};
+
+struct RouteQueryResult {
+    RouteQuery query;
+    std::vector<PathSegment> path;
+    qint64 elapsedMs = 0;
+    SearchStats stats; // Counters of the search (searchstats.h)
+    std::vector<IsochroneBand> bands; // For an isochrone query
+    std::vector<ParetoRoute> routes;  // For a Pareto query, fastest first; path is the first of them
+    std::vector<std::vector<PathSegment>> alternatives; // For an alternatives query, best first; path is the first
+};
+
+// Runs loading and route searches for a MetroSystem on a worker pool so the
+// GUI thread never blocks on them. Results are delivered on the thread the
+// runner lives in. Only the latest route request matters: starting a new
+// one cancels the one still running, and a superseded result is dropped.
+class RouteQueryRunner : public QObject {
+    Q_OBJECT
+
+public:
+    explicit RouteQueryRunner(MetroSystem& metroSystem, QObject* parent = nullptr);
+    ~RouteQueryRunner();
+
+    // Tries the files in order with loadMetroDataCached until one loads.
+    // Any running query is cancelled and waited for first.
+    void loadNetwork(const QStringList& candidateFiles);
+    void findRoute(const RouteQuery& query);
+    void cancelRoute();
+    // Cancels everything and blocks until the workers are idle
+    void cancelAndWait();
+
+    bool isLoading() const { return loading_; }
+    bool isSearching() const { return activeQuery_ != nullptr; }
+
+signals:
+    void loadProgress(int percent);
+    void loadFinished(bool ok, const QString& errorMessage);
+    void routeReady(const RouteQueryResult& result);
+
+private:
+    MetroSystem& metroSystem_;
+    QThreadPool pool_;
+    bool loading_ = false;
+    quint64 queryGeneration_ = 0;
+    std::shared_ptr<CancelFlag> activeQuery_; // Cancel flag of the running query
+};
+
+#endif // ROUTEQUERYRUNNER_H
@@ -0,0 +1,298 @@
+#ifndef SEARCHKERNELS_H
+#define SEARCHKERNELS_H
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "metrograph.h"
+#include "searchstats.h"
+#include "searchworkspace.h"
+
+// Search kernels are templates over a weight policy (what an arc costs)
+// and a queue policy (in which order stations are expanded). Every
+// combination compiles to its own loop with the weight read straight from
+// the CSR arrays, so nothing on the hot path branches on the criterion.
+
+// ---- Weight policies ----
+
+// Integer policies also report the range of their arc weights, which
+// decides whether a bucket queue can be used.
+
+struct HopWeight {
+    using Value = long long;
+    static Value weight(const MetroGraph&, EdgeId) { return 1; }
+    static Value minWeight(const MetroGraph&) { return 1; }
+    static Value maxWeight(const MetroGraph&) { return 1; }
+};
+
+struct TimeWeight {
+    using Value = long long;
+    static Value weight(const MetroGraph& graph, EdgeId e) { return graph.times[e]; }
+    static Value minWeight(const MetroGraph& graph) { return graph.minTime; }
+    static Value maxWeight(const MetroGraph& graph) { return graph.maxTime; }
+};
+
+struct CostWeight {
+    using Value = long long;
+    static Value weight(const MetroGraph& graph, EdgeId e) { return graph.costs[e]; }
+    static Value minWeight(const MetroGraph& graph) { return graph.minCost; }
+    static Value maxWeight(const MetroGraph& graph) { return graph.maxCost; }
+};
+
+struct DistanceWeight {
+    using Value = double;
+    static Value weight(const MetroGraph& graph, EdgeId e) { return graph.distances[e]; }
+};
+
+template <typename Weight>
+constexpr typename Weight::Value unreachedValue() {
+    return std::numeric_limits<typename Weight::Value>::max();
+}
+
+// ---- Queue policies ----
+//
+// All queues hand out (key, station) entries in non-decreasing key order
+// and are reset with clear(), so one queue can serve many searches.
+
+// Binary min-heap ordered on the key only, like the original
+// priority_queue<pair<long long, string>> it replaces. It runs the same
+// std::push_heap/pop_heap steps a priority_queue does, but on a vector it
+// owns, so clear() keeps the storage for the next search.
+template <typename Value>
+class BinaryHeapQueue {
+public:
+    using Entry = std::pair<Value, StationId>;
+
+    void clear() { heap_.clear(); }
+    void push(Value key, StationId node) {
+        heap_.push_back(Entry{key, node});
+        std::push_heap(heap_.begin(), heap_.end(), KeyGreater());
+    }
+    bool empty() const { return heap_.empty(); }
+    Entry top() { return heap_.front(); }
+    Entry pop() {
+        std::pop_heap(heap_.begin(), heap_.end(), KeyGreater());
+        Entry entry = heap_.back();
+        heap_.pop_back();
+        return entry;
+    }
+
+private:
+    struct KeyGreater {
+        bool operator()(const Entry& a, const Entry& b) const { return a.first > b.first; }
+    };
+    std::vector<Entry> heap_;
+};
+
+// First-in first-out. Only valid with unit weights (HopWeight), where it
+// turns the kernel into a plain BFS.
+template <typename Value>
+class FifoQueue {
+public:
+    using Entry = std::pair<Value, StationId>;
+
+    void clear() {
+        entries_.clear();
+        head_ = 0;
+    }
+    void push(Value key, StationId node) { entries_.push_back(Entry{key, node}); }
+    bool empty() const { return head_ == entries_.size(); }
+    Entry top() { return entries_[head_]; }
+    Entry pop() { return entries_[head_++]; }
+
+private:
+    std::vector<Entry> entries_;
+    size_t head_ = 0;
+};
+
+// Dial's monotone bucket queue for integer weights in [0, maxArcWeight].
+// Every queued key lies in [current, current + maxArcWeight], so
+// maxArcWeight + 1 circular buckets indexed by key hold them without
+// collisions and a bucket only needs to store station IDs; the key of a
+// popped station is the current bucket's key.
+template <typename Value>
+class BucketQueue {
+public:
+    using Entry = std::pair<Value, StationId>;
+
+    explicit BucketQueue(Value maxArcWeight) : buckets_(static_cast<size_t>(maxArcWeight) + 1) {}
+
+    Value maxArcWeight() const { return static_cast<Value>(buckets_.size() - 1); }
+
+    void clear() {
+        for (std::vector<StationId>& bucket : buckets_) bucket.clear();
+        current_ = 0;
+        size_ = 0;
+    }
+    void push(Value key, StationId node) {
+        buckets_[static_cast<size_t>(key) % buckets_.size()].push_back(node);
+        size_++;
+    }
+    bool empty() const { return size_ == 0; }
+    Entry top() {
+        std::vector<StationId>& bucket = advance();
+        return Entry{current_, bucket.back()};
+    }
+    Entry pop() {
+        std::vector<StationId>& bucket = advance();
+        Entry entry{current_, bucket.back()};
+        bucket.pop_back();
+        size_--;
+        return entry;
+    }
+
+private:
+    // Moves current_ to the first non-empty bucket; the queue must not be empty
+    std::vector<StationId>& advance() {
+        while (buckets_[static_cast<size_t>(current_) % buckets_.size()].empty()) current_++;
+        return buckets_[static_cast<size_t>(current_) % buckets_.size()];
+    }
+
+    std::vector<std::vector<StationId>> buckets_;
+    Value current_ = 0;
+    size_t size_ = 0;
+};
+
+// Largest arc weight for which a bucket queue is used. Above this the
+// empty buckets between successive keys cost more than the heap saves.
+constexpr long long kMaxBucketWeight = 1024;
+
+// Calls body(queue) with the cheapest queue that keeps Dijkstra exact for
+// this weight on this graph: buckets when all weights are small
+// non-negative integers, otherwise a binary heap.
+template <typename Weight, typename Body>
+auto withDijkstraQueue(const MetroGraph& graph, Body body) {
+    using Value = typename Weight::Value;
+    if constexpr (std::is_integral<Value>::value) {
+        if (Weight::minWeight(graph) >= 0 && Weight::maxWeight(graph) <= kMaxBucketWeight) {
+            BucketQueue<Value> queue(Weight::maxWeight(graph));
+            return body(queue);
+        }
+    }
+    BinaryHeapQueue<Value> queue;
+    return body(queue);
+}
+
+// Calls body(queue) with the calling thread's cheapest exact queue for arc
+// weights in [minWeight, maxWeight]. The queue keeps its storage from one
+// search to the next. Bodies must not nest unless they use different
+// slots: a second search on the same thread and slot would share the queue.
+template <typename Value, int Slot = 0, typename Body>
+auto withThreadQueue(Value minWeight, Value maxWeight, Body body) {
+    if constexpr (std::is_integral<Value>::value) {
+        if (minWeight >= 0 && maxWeight <= kMaxBucketWeight) {
+            thread_local std::unique_ptr<BucketQueue<Value>> buckets;
+            if (!buckets || buckets->maxArcWeight() != maxWeight) {
+                buckets = std::make_unique<BucketQueue<Value>>(maxWeight);
+            }
+            return body(*buckets);
+        }
+    }
+    thread_local BinaryHeapQueue<Value> heap;
+    return body(heap);
+}
+
+// Same choice as withDijkstraQueue, made by withThreadQueue
+template <typename Weight, int Slot = 0, typename Body>
+auto withThreadDijkstraQueue(const MetroGraph& graph, Body body) {
+    using Value = typename Weight::Value;
+    if constexpr (std::is_integral<Value>::value) {
+        return withThreadQueue<Value, Slot>(Weight::minWeight(graph), Weight::maxWeight(graph), body);
+    } else {
+        return withThreadQueue<Value, Slot>(Value(), Value(), body); // Not integral: always the heap
+    }
+}
+
+// ---- Kernels ----
+
+// Label-setting search over any graph whose nodes are numbered from 0,
+// such as the transfer states (see transferrouting.cpp). Nodes are
+// expanded in queue order: expand(node, value, relax) calls
+// relax(next, candidate, arc) for each arc leaving node, and
+// stop(node, value) is called as each node is settled and ends the search
+// by returning true. The search starts a new
+// epoch in workspace and leaves every reached node's value, parent and
+// parent arc there. Returns true if stopped by the predicate.
+template <typename Value, typename Queue, typename Expand, typename StopPredicate>
+bool runLabelSettingKernel(size_t nodeCount, uint32_t source, Queue& queue, SearchWorkspace<Value>& workspace,
+                           Expand expand, StopPredicate stop) {
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    workspace.reset(nodeCount);
+    queue.clear();
+    workspace.label(source, 0, kInvalidStation, kInvalidEdge);
+    queue.push(0, source);
+    METRO_STAT(counters.pushes++);
+
+    uint32_t curr = source;
+    auto relax = [&](uint32_t next, Value candidate, EdgeId arc) {
+        METRO_STAT(counters.relaxed++);
+        if (candidate < workspace.distance(next)) {
+            workspace.label(next, candidate, curr, arc);
+            queue.push(candidate, next);
+            METRO_STAT(counters.pushes++);
+        }
+    };
+    while (!queue.empty()) {
+        auto top = queue.pop();
+        const Value currentValue = top.first;
+        curr = top.second;
+        if (currentValue > workspace.distance(curr)) {
+            METRO_STAT(counters.stalePops++);
+            continue; // stale entry
+        }
+        METRO_STAT(counters.settled++);
+        if (stop(curr, currentValue)) {
+            return true;
+        }
+        expand(curr, currentValue, relax);
+    }
+    return false;
+}
+
+// Label-setting search from source over the stations of graph, with arc
+// weights from the Weight policy: the same loop as runLabelSettingKernel,
+// written out over the CSR arrays. Routing through the generic expand and
+// relax callbacks cost about a third of the query time here.
+template <typename Weight, typename Queue, typename StopPredicate>
+bool runShortestPathKernel(const MetroGraph& graph, StationId source, Queue& queue,
+                           SearchWorkspace<typename Weight::Value>& workspace,
+                           StopPredicate stop) {
+    using Value = typename Weight::Value;
+    METRO_STAT(SearchCounters& counters = threadSearchCounters());
+    workspace.reset(graph.stationCount());
+    queue.clear();
+    workspace.label(source, 0, kInvalidStation, kInvalidEdge);
+    queue.push(0, source);
+    METRO_STAT(counters.pushes++);
+
+    while (!queue.empty()) {
+        auto top = queue.pop();
+        const Value currentValue = top.first;
+        const StationId curr = top.second;
+        if (currentValue > workspace.distance(curr)) {
+            METRO_STAT(counters.stalePops++);
+            continue; // stale entry
+        }
+        METRO_STAT(counters.settled++);
+        if (stop(curr, currentValue)) {
+            return true;
+        }
+        METRO_STAT(counters.relaxed += graph.edgesEnd(curr) - graph.edgesBegin(curr));
+        for (EdgeId e = graph.edgesBegin(curr); e < graph.edgesEnd(curr); ++e) {
+            const StationId next = graph.targets[e];
+            const Value candidate = currentValue + Weight::weight(graph, e);
+            if (candidate < workspace.distance(next)) {
+                workspace.label(next, candidate, curr, e);
+                queue.push(candidate, next);
+                METRO_STAT(counters.pushes++);
+            }
+        }
+    }
+    return false;
+}
+
+#endif // SEARCHKERNELS_H
@@ -0,0 +1,180 @@
+#ifndef SEARCHSTATS_H
+#define SEARCHSTATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+
+// Search instrumentation. Building with METRO_ENABLE_STATS=0 (the CMake
+// option of the same name) turns every METRO_STAT(...) into nothing, so the
+// kernels compile exactly as they would without it.
+#ifndef METRO_ENABLE_STATS
+#define METRO_ENABLE_STATS 1
+#endif
+
+#if METRO_ENABLE_STATS
+#define METRO_STAT(statement) statement
+#else
+#define METRO_STAT(statement)
+#endif
+
+// Work done by one search
+struct SearchCounters {
+    uint64_t settled = 0;     // Stations taken off the queue and expanded
+    uint64_t relaxed = 0;     // Arcs examined from settled stations
+    uint64_t pushes = 0;      // Queue insertions
+    uint64_t stalePops = 0;   // Entries popped after a better one had been settled
+    uint64_t reconstructNanos = 0; // Turning the search result into PathSegments
+    uint64_t hierarchyFallbacks = 0; // Hierarchy queries that live updates sent to Dijkstra
+};
+
+// Counters of the search running on this thread. A query resets them
+// before it starts and reads them when it is done; kernels only add to them.
+inline SearchCounters& threadSearchCounters() {
+    thread_local SearchCounters counters;
+    return counters;
+}
+
+// Adds the lifetime of the enclosing scope to the thread's reconstructNanos
+class ReconstructTimer {
+public:
+    ReconstructTimer() : start_(std::chrono::steady_clock::now()) {}
+    ~ReconstructTimer() {
+        threadSearchCounters().reconstructNanos += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    }
+    ReconstructTimer(const ReconstructTimer&) = delete;
+    ReconstructTimer& operator=(const ReconstructTimer&) = delete;
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Running sums of SearchCounters over many searches, safe to add to from
+// several threads
+class SearchCounterTotals {
+public:
+    void add(const SearchCounters& counters) {
+        settled_.fetch_add(counters.settled, std::memory_order_relaxed);
+        relaxed_.fetch_add(counters.relaxed, std::memory_order_relaxed);
+        pushes_.fetch_add(counters.pushes, std::memory_order_relaxed);
+        stalePops_.fetch_add(counters.stalePops, std::memory_order_relaxed);
+        reconstructNanos_.fetch_add(counters.reconstructNanos, std::memory_order_relaxed);
+        hierarchyFallbacks_.fetch_add(counters.hierarchyFallbacks, std::memory_order_relaxed);
+        searches_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    SearchCounters sum() const {
+        SearchCounters result;
+        result.settled = settled_.load(std::memory_order_relaxed);
+        result.relaxed = relaxed_.load(std::memory_order_relaxed);
+        result.pushes = pushes_.load(std::memory_order_relaxed);
+        result.stalePops = stalePops_.load(std::memory_order_relaxed);
+        result.reconstructNanos = reconstructNanos_.load(std::memory_order_relaxed);
+        result.hierarchyFallbacks = hierarchyFallbacks_.load(std::memory_order_relaxed);
+        return result;
+    }
+    uint64_t searches() const { return searches_.load(std::memory_order_relaxed); }
+
+    void reset() {
+        for (auto* counter : {&settled_, &relaxed_, &pushes_, &stalePops_, &reconstructNanos_, &hierarchyFallbacks_,
+                              &searches_}) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> settled_{0};
+    std::atomic<uint64_t> relaxed_{0};
+    std::atomic<uint64_t> pushes_{0};
+    std::atomic<uint64_t> stalePops_{0};
+    std::atomic<uint64_t> reconstructNanos_{0};
+    std::atomic<uint64_t> hierarchyFallbacks_{0};
+    std::atomic<uint64_t> searches_{0};
+};
+
+// Everything known about one findPath call
+struct SearchStats {
+    SearchCounters counters;
+    double totalMs = 0.0;       // Whole call, including name lookup and cache
+    double reconstructMs = 0.0; // Part of totalMs spent building the PathSegments
+    bool cacheHit = false;      // Served from the route cache; the counters are zero
+};
+
+// Lock-free latency histogram with power-of-two microsecond buckets:
+// bucket 0 counts calls under 1 us, bucket i calls in [2^(i-1), 2^i) us,
+// and the last bucket everything slower. Percentiles are read as the upper
+// edge of the bucket they fall in, so they are within a factor of two.
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 32;
+
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> buckets{};
+        uint64_t count = 0;
+        double totalMicros = 0.0;
+
+        double meanMicros() const { return count ? totalMicros / count : 0.0; }
+        // Upper bound of the q-quantile (0 < q <= 1)
+        double percentileMicros(double q) const {
+            if (count == 0) return 0.0;
+            const uint64_t rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) return static_cast<double>(uint64_t(1) << i);
+            }
+            return static_cast<double>(uint64_t(1) << (kBuckets - 1));
+        }
+    };
+
+    void record(double micros) {
+        size_t bucket = 0;
+        for (uint64_t whole = micros > 0 ? static_cast<uint64_t>(micros) : 0; whole > 0 && bucket + 1 < kBuckets; whole >>= 1) {
+            bucket++;
+        }
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        totalNanos_.fetch_add(static_cast<uint64_t>(micros * 1000.0), std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot result;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            result.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            result.count += result.buckets[i];
+        }
+        result.totalMicros = totalNanos_.load(std::memory_order_relaxed) / 1000.0;
+        return result;
+    }
+
+    void reset() {
+        for (auto& bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+        totalNanos_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> totalNanos_{0};
+};
+
+// Wall time of each phase of the last load, in milliseconds. For a snapshot
+// readMs covers mapping, checking and decoding the file; there is no parse
+// or build phase.
+struct LoadTimings {
+    double readMs = 0.0;  // Opening and mapping the file
+    double parseMs = 0.0; // Parsing rows and interning names
+    double buildMs = 0.0; // CSR graph and weight ranges
+    double indexMs = 0.0; // Name lookup table and A* bound
+    double totalMs = 0.0;
+    bool fromSnapshot = false;
+};
+
+using StatsClock = std::chrono::steady_clock;
+
+inline double millisecondsSince(StatsClock::time_point since) {
+    return std::chrono::duration<double, std::milli>(StatsClock::now() - since).count();
+}
+
+#endif // SEARCHSTATS_H
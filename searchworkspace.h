@@ -0,0 +1,63 @@
+#ifndef SEARCHWORKSPACE_H
+#define SEARCHWORKSPACE_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "metrograph.h"
+
+// Per-thread scratch labels for shortest path searches. A worker keeps one
+// workspace for all the searches it runs, so the labels are allocated only
+// once. Value is the weight policy's label type (see searchkernels.h).
+//
+// Every label carries the epoch of the search that wrote it, and a label
+// from an older epoch reads as unreached: starting a search is one
+// increment instead of a pass over all stations. Distance, parent and
+// parent arc sit in one record, so a relaxation touches one cache line.
+template <typename Value>
+class SearchWorkspace {
+public:
+    static constexpr Value kUnreached = std::numeric_limits<Value>::max();
+
+    // Starts a new search over stationCount stations. Only a change of
+    // size, or the epoch counter wrapping around, touches the labels.
+    void reset(size_t stationCount) {
+        if (labels_.size() != stationCount || ++epoch_ == 0) {
+            labels_.assign(stationCount, Label{kUnreached, kInvalidStation, kInvalidEdge, 0});
+            epoch_ = 1;
+        }
+    }
+
+    bool reached(StationId v) const { return labels_[v].epoch == epoch_; }
+    Value distance(StationId v) const { return reached(v) ? labels_[v].distance : kUnreached; }
+    StationId parent(StationId v) const { return reached(v) ? labels_[v].parent : kInvalidStation; }
+    // Arc from parent(v) to v that gave v its distance
+    EdgeId parentEdge(StationId v) const { return reached(v) ? labels_[v].parentEdge : kInvalidEdge; }
+
+    void label(StationId v, Value distance, StationId parent, EdgeId parentEdge) {
+        labels_[v] = Label{distance, parent, parentEdge, epoch_};
+    }
+
+private:
+    struct Label {
+        Value distance;
+        StationId parent;
+        EdgeId parentEdge;
+        uint32_t epoch;
+    };
+
+    std::vector<Label> labels_;
+    uint32_t epoch_ = 0;
+};
+
+// Workspace of the calling thread, for searches that run one at a time on
+// it. A search that needs two at once (one per direction) takes them from
+// different slots.
+template <typename Value, int Slot = 0>
+SearchWorkspace<Value>& threadSearchWorkspace() {
+    thread_local SearchWorkspace<Value> workspace;
+    return workspace;
+}
+
+#endif // SEARCHWORKSPACE_H
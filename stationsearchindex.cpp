@@ -0,0 +1,221 @@
+#include "stationsearchindex.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Distinct trigrams of " " + text, as three bytes packed into an integer.
+// The leading space makes the first letters of the text (and, as folding
+// keeps single spaces, of every word) trigrams of their own.
+void trigramsOf(std::string_view text, std::vector<uint32_t>& trigrams) {
+    trigrams.clear();
+    for (size_t i = 0; i + 2 < text.size() + 1; ++i) {
+        const auto at = [&text](size_t j) { return static_cast<uint32_t>(static_cast<unsigned char>(j == 0 ? ' ' : text[j - 1])); };
+        trigrams.push_back(at(i) << 16 | at(i + 1) << 8 | at(i + 2));
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+} // namespace
+
+std::string StationSearchIndex::fold(std::string_view text) {
+    std::string folded;
+    folded.reserve(text.size());
+    for (char c : text) {
+        const unsigned char u = static_cast<unsigned char>(c);
+        if ((u >= '0' && u <= '9') || (u >= 'a' && u <= 'z') || u >= 0x80) {
+            folded.push_back(c); // Bytes of UTF-8 sequences are kept as they are
+        } else if (u >= 'A' && u <= 'Z') {
+            folded.push_back(static_cast<char>(u - 'A' + 'a'));
+        } else if (!folded.empty() && folded.back() != ' ') {
+            folded.push_back(' ');
+        }
+    }
+    if (!folded.empty() && folded.back() == ' ') folded.pop_back();
+    return folded;
+}
+
+void StationSearchIndex::build(const std::vector<std::string>& names) {
+    clear();
+    keyOffsets_.reserve(names.size() + 1);
+    for (const std::string& name : names) {
+        keyOffsets_.push_back(static_cast<uint32_t>(keyChars_.size()));
+        keyChars_ += fold(name);
+    }
+    keyOffsets_.push_back(static_cast<uint32_t>(keyChars_.size()));
+
+    sorted_.resize(names.size());
+    for (StationId id = 0; id < names.size(); ++id) sorted_[id] = id;
+    std::sort(sorted_.begin(), sorted_.end(), [this](StationId a, StationId b) {
+        const std::string_view keyA = key(a);
+        const std::string_view keyB = key(b);
+        return keyA != keyB ? keyA < keyB : a < b;
+    });
+
+    // (trigram, station) pairs grouped by trigram; stations stay in ID order
+    std::vector<std::pair<uint32_t, StationId>> pairs;
+    std::vector<uint32_t> trigrams;
+    trigramCounts_.reserve(names.size());
+    for (StationId id = 0; id < names.size(); ++id) {
+        trigramsOf(key(id), trigrams);
+        trigramCounts_.push_back(static_cast<uint16_t>(std::min<size_t>(trigrams.size(), UINT16_MAX)));
+        for (uint32_t trigram : trigrams) pairs.emplace_back(trigram, id);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    postings_.reserve(pairs.size());
+    for (const auto& pair : pairs) {
+        if (trigrams_.empty() || trigrams_.back() != pair.first) {
+            trigrams_.push_back(pair.first);
+            postingOffsets_.push_back(static_cast<uint32_t>(postings_.size()));
+        }
+        postings_.push_back(pair.second);
+    }
+    postingOffsets_.push_back(static_cast<uint32_t>(postings_.size()));
+}
+
+void StationSearchIndex::clear() {
+    keyChars_.clear();
+    keyOffsets_.clear();
+    sorted_.clear();
+    trigramCounts_.clear();
+    trigrams_.clear();
+    postingOffsets_.clear();
+    postings_.clear();
+}
+
+void StationSearchIndex::search(std::string_view query, size_t limit, std::vector<StationId>& matches) const {
+    matches.clear();
+    if (limit == 0 || sorted_.empty()) return;
+    const std::string folded = fold(query);
+
+    // Names starting with the query form one run of the sorted order
+    auto run = std::lower_bound(sorted_.begin(), sorted_.end(), folded,
+                                [this](StationId station, const std::string& q) { return key(station) < q; });
+    const size_t prefixMatches = static_cast<size_t>(
+        std::find_if_not(run, sorted_.end(), [&](StationId station) { return startsWith(key(station), folded); }) - run);
+    matches.assign(run, run + std::min(prefixMatches, limit));
+    if (folded.empty() || matches.size() == limit) return;
+
+    // Posting lists of the query's trigrams, shortest first. A trigram no
+    // station has gets an empty list; it still counts for the similarity.
+    struct Postings {
+        const StationId* begin;
+        const StationId* end;
+        bool inner; // A trigram of the query itself, not just of its padding
+        size_t size() const { return static_cast<size_t>(end - begin); }
+        bool contains(StationId station) const { return std::binary_search(begin, end, station); }
+    };
+    std::vector<uint32_t> queryTrigrams;
+    trigramsOf(folded, queryTrigrams);
+    if (queryTrigrams.empty()) return; // A single character only matches at the start
+    const uint32_t padTrigram = static_cast<uint32_t>(' ') << 16 | static_cast<unsigned char>(folded[0]) << 8
+                                | static_cast<unsigned char>(folded[1]);
+    const bool padIsInner = folded.find(folded.substr(0, 2).insert(0, 1, ' ')) != std::string::npos;
+    std::vector<Postings> lists;
+    for (uint32_t trigram : queryTrigrams) {
+        Postings list{nullptr, nullptr, trigram != padTrigram || padIsInner};
+        auto it = std::lower_bound(trigrams_.begin(), trigrams_.end(), trigram);
+        if (it != trigrams_.end() && *it == trigram) {
+            const size_t index = static_cast<size_t>(it - trigrams_.begin());
+            list.begin = postings_.data() + postingOffsets_[index];
+            list.end = postings_.data() + postingOffsets_[index + 1];
+        }
+        lists.push_back(list);
+    }
+    std::sort(lists.begin(), lists.end(), [](const Postings& a, const Postings& b) { return a.size() < b.size(); });
+
+    auto byKey = [this](StationId a, StationId b) {
+        const std::string_view keyA = key(a);
+        const std::string_view keyB = key(b);
+        return keyA != keyB ? keyA < keyB : a < b;
+    };
+
+    // A word of the name starts with the query, or the name contains it.
+    // Such a name has every trigram of the query (queries under three
+    // characters: its padded one, i.e. a word starting with them), so the
+    // candidates are the shortest such list, checked against the others.
+    std::vector<std::pair<int, StationId>> literal; // (1 word start or 2 substring, station)
+    const auto shortest = std::find_if(lists.begin(), lists.end(), [](const Postings& list) { return list.inner; });
+    const Postings& seeds = folded.size() < 3 ? lists.front() : *shortest;
+    for (const StationId* it = seeds.begin; it != seeds.end; ++it) {
+        const StationId station = *it;
+        const std::string_view name = key(station);
+        if (startsWith(name, folded)) continue; // Listed above already
+        bool candidate = true;
+        for (const Postings& list : lists) {
+            if (&list != &seeds && (list.inner || folded.size() < 3) && !list.contains(station)) {
+                candidate = false;
+                break;
+            }
+        }
+        if (!candidate) continue;
+        int tier = 0;
+        for (size_t pos = name.find(folded); pos != std::string_view::npos; pos = name.find(folded, pos + 1)) {
+            tier = name[pos - 1] == ' ' ? 1 : 2;
+            if (tier == 1) break;
+        }
+        if (tier != 0) literal.emplace_back(tier, station);
+    }
+    if (prefixMatches > 0 || !literal.empty()) {
+        const size_t wanted = std::min(limit - matches.size(), literal.size());
+        std::partial_sort(literal.begin(), literal.begin() + wanted, literal.end(),
+                          [&byKey](const std::pair<int, StationId>& a, const std::pair<int, StationId>& b) {
+                              return a.first != b.first ? a.first < b.first : byKey(a.second, b.second);
+                          });
+        for (size_t i = 0; i < wanted; ++i) matches.push_back(literal[i].second);
+        return;
+    }
+
+    // Nothing matches literally: look for misspellings. A fuzzy match
+    // shares at least kMinSimilarity of the query's trigrams, so it is in
+    // one of the lists left after dropping that many minus one of the
+    // longest; those are counted in full, the longest ones only for the
+    // stations already found. The counters are per thread and zeroed
+    // again after each query.
+    const size_t needed = std::max<size_t>(1, static_cast<size_t>(std::ceil(kMinSimilarity * lists.size() - 1e-9)));
+    const size_t seedLists = lists.size() - needed + 1;
+    thread_local std::vector<uint16_t> shared;
+    thread_local std::vector<StationId> touched;
+    if (shared.size() < sorted_.size()) shared.resize(sorted_.size(), 0);
+    touched.clear();
+    for (size_t i = 0; i < seedLists; ++i) {
+        for (const StationId* it = lists[i].begin; it != lists[i].end; ++it) {
+            if (shared[*it]++ == 0) touched.push_back(*it);
+        }
+    }
+    for (size_t i = seedLists; i < lists.size(); ++i) {
+        // Look the few stations up, or stream the list past the many
+        if (touched.size() * 16 < lists[i].size()) {
+            for (StationId station : touched) shared[station] += lists[i].contains(station);
+        } else {
+            for (const StationId* it = lists[i].begin; it != lists[i].end; ++it) {
+                if (shared[*it] != 0) shared[*it]++;
+            }
+        }
+    }
+
+    std::vector<std::pair<double, StationId>> fuzzy;
+    for (StationId station : touched) {
+        const uint16_t count = shared[station];
+        shared[station] = 0;
+        const double similarity = static_cast<double>(count) / (lists.size() + trigramCounts_[station] - count);
+        if (similarity >= kMinSimilarity) fuzzy.emplace_back(similarity, station);
+    }
+    const size_t wanted = std::min(limit, fuzzy.size());
+    std::partial_sort(fuzzy.begin(), fuzzy.begin() + wanted, fuzzy.end(),
+                      [&byKey](const std::pair<double, StationId>& a, const std::pair<double, StationId>& b) {
+                          return a.first != b.first ? a.first > b.first : byKey(a.second, b.second);
+                      });
+    for (size_t i = 0; i < wanted; ++i) matches.push_back(fuzzy[i].second);
+}
+
+size_t StationSearchIndex::memoryFootprint() const {
+    return keyChars_.capacity() + keyOffsets_.capacity() * sizeof(uint32_t) + sorted_.capacity() * sizeof(StationId)
+           + trigramCounts_.capacity() * sizeof(uint16_t) + trigrams_.capacity() * sizeof(uint32_t)
+           + postingOffsets_.capacity() * sizeof(uint32_t) + postings_.capacity() * sizeof(StationId);
+}
@@ -0,0 +1,63 @@
+#ifndef STATIONSEARCHINDEX_H
+#define STATIONSEARCHINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metrograph.h"
+
+// Type-ahead search over station names, built once per load.
+//
+// Names are folded (ASCII lowercase, runs of spaces and punctuation made a
+// single space) and kept in one character buffer. Two structures sit on
+// top of that:
+//   - the stations sorted by folded name, so the stations starting with
+//     the query are one binary search and a contiguous run;
+//   - trigram postings: for every three-character window of " " + folded
+//     name, the stations containing it, in CSR form. A query's trigrams
+//     pick the candidates for word-start, substring and misspelt matches
+//     without looking at the other stations.
+//
+// Matches are ranked: name starts with the query, then a word of the name
+// does, then the name contains it; ties go alphabetically. Only if nothing
+// matches that way is the query taken as misspelt, and the names most
+// similar to it by shared trigrams are returned instead.
+class StationSearchIndex {
+public:
+    // Misspelt matches share at least this fraction of their trigrams with
+    // the query (Jaccard similarity)
+    static constexpr double kMinSimilarity = 0.3;
+
+    void build(const std::vector<std::string>& names);
+    void clear();
+    bool empty() const { return sorted_.empty(); }
+
+    // Best `limit` matches for the query, best first. An empty query lists
+    // the stations alphabetically.
+    void search(std::string_view query, size_t limit, std::vector<StationId>& matches) const;
+
+    // Every station, alphabetically by folded name
+    const std::vector<StationId>& sortedStations() const { return sorted_; }
+    size_t memoryFootprint() const; // Bytes held by the index
+
+    static std::string fold(std::string_view text);
+
+private:
+    std::string_view key(StationId station) const {
+        return std::string_view(keyChars_).substr(keyOffsets_[station], keyOffsets_[station + 1] - keyOffsets_[station]);
+    }
+
+    std::string keyChars_;               // Folded names back to back
+    std::vector<uint32_t> keyOffsets_;   // StationId -> start in keyChars_, plus the end
+    std::vector<StationId> sorted_;      // Stations by folded name
+    std::vector<uint16_t> trigramCounts_; // Distinct trigrams per station
+    // Postings: trigrams_ sorted, the stations holding trigrams_[i] are
+    // postings_[postingOffsets_[i] .. postingOffsets_[i + 1]) in ID order
+    std::vector<uint32_t> trigrams_;
+    std::vector<uint32_t> postingOffsets_;
+    std::vector<StationId> postings_;
+};
+
+#endif // STATIONSEARCHINDEX_H
@@ -0,0 +1,45 @@
+#include "stationsearchmodel.h"
+
+StationSearchModel::StationSearchModel(const MetroSystem& metroSystem, QObject* parent)
+    : QAbstractListModel(parent), metroSystem_(metroSystem) {}
+
+void StationSearchModel::setQuery(const QString& query) {
+    beginResetModel();
+    query_ = query.toStdString();
+    rows_.clear();
+    exhausted_ = false;
+    endResetModel();
+    // The first page right away; views only ask for more as they scroll
+    fetchMore(QModelIndex());
+}
+
+void StationSearchModel::reload() {
+    setQuery(QString::fromStdString(query_));
+}
+
+int StationSearchModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : rows_.size();
+}
+
+QVariant StationSearchModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rows_.size()) return QVariant();
+    if (role == Qt::DisplayRole || role == Qt::EditRole) return rows_[index.row()];
+    return QVariant();
+}
+
+bool StationSearchModel::canFetchMore(const QModelIndex& parent) const {
+    return !parent.isValid() && !exhausted_;
+}
+
+void StationSearchModel::fetchMore(const QModelIndex& parent) {
+    if (parent.isValid() || exhausted_) return;
+    // Ranking is deterministic, so a longer search starts with the rows
+    // already shown; only the tail is new
+    const size_t wanted = static_cast<size_t>(rows_.size()) + kPageSize;
+    const std::vector<std::string> names = metroSystem_.findStations(query_, wanted);
+    exhausted_ = names.size() < wanted;
+    if (names.size() <= static_cast<size_t>(rows_.size())) return;
+    beginInsertRows(QModelIndex(), rows_.size(), static_cast<int>(names.size()) - 1);
+    for (size_t i = rows_.size(); i < names.size(); ++i) rows_.append(QString::fromStdString(names[i]));
+    endInsertRows();
+}
@@ -0,0 +1,38 @@
+#ifndef STATIONSEARCHMODEL_H
+#define STATIONSEARCHMODEL_H
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <string>
+
+#include "metrosystem.h"
+
+// Station names matching a query, best first, fetched from the network's
+// search index a page at a time as a view scrolls down (canFetchMore /
+// fetchMore). An empty query lists every station alphabetically, so the
+// same model serves the station combo boxes and their completers without
+// ever copying the whole name list into Qt.
+class StationSearchModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    static constexpr int kPageSize = 50;
+
+    explicit StationSearchModel(const MetroSystem& metroSystem, QObject* parent = nullptr);
+
+    void setQuery(const QString& query);
+    void reload(); // After the network was (re)loaded
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+private:
+    const MetroSystem& metroSystem_;
+    std::string query_;
+    QStringList rows_;
+    bool exhausted_ = false; // The last fetch came back short
+};
+
+#endif // STATIONSEARCHMODEL_H
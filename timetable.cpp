@@ -0,0 +1,292 @@
+#include "timetable.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+constexpr int kUnreachedTime = std::numeric_limits<int>::max();
+constexpr uint32_t kNotBoarded = std::numeric_limits<uint32_t>::max();
+
+// A stretch of track a trip runs over: arcs[i] leaves stations[i]
+struct Route {
+    std::vector<StationId> stations;
+    std::vector<EdgeId> arcs;
+};
+
+Route reversed(const MetroGraph& graph, const Route& route) {
+    Route back;
+    for (size_t i = route.arcs.size(); i-- > 0;) {
+        back.stations.push_back(graph.targets[route.arcs[i]]);
+        back.arcs.push_back(graph.reverseArc(route.stations[i], route.arcs[i]));
+    }
+    return back;
+}
+
+// Fewest-hop route from one station to another over the arcs of one line
+bool lineRoute(const MetroGraph& graph, LineId line, StationId from, StationId to, Route& route) {
+    std::vector<EdgeId> parentEdge(graph.stationCount(), kInvalidEdge);
+    std::vector<StationId> parent(graph.stationCount(), kInvalidStation);
+    std::queue<StationId> queue;
+    parent[from] = from;
+    queue.push(from);
+    while (!queue.empty() && parent[to] == kInvalidStation) {
+        const StationId u = queue.front();
+        queue.pop();
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            const StationId v = graph.targets[e];
+            if (graph.lines[e] != line || parent[v] != kInvalidStation) continue;
+            parent[v] = u;
+            parentEdge[v] = e;
+            queue.push(v);
+        }
+    }
+    if (parent[to] == kInvalidStation) return false;
+
+    route = Route();
+    for (StationId v = to; v != from; v = parent[v]) {
+        route.stations.push_back(parent[v]);
+        route.arcs.push_back(parentEdge[v]);
+    }
+    std::reverse(route.stations.begin(), route.stations.end());
+    std::reverse(route.arcs.begin(), route.arcs.end());
+    return true;
+}
+
+// Splits a line into runs: maximal stretches whose inner stations have
+// exactly two neighbours on the line. Terminals and junctions end a run,
+// so a branching line gets one run per branch; a loop becomes one run.
+std::vector<Route> lineRuns(const MetroGraph& graph, LineId line) {
+    std::unordered_map<StationId, std::vector<StationId>> neighbours;
+    for (StationId u = 0; u < graph.stationCount(); ++u) {
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            if (graph.lines[e] != line || graph.targets[e] == u) continue;
+            std::vector<StationId>& list = neighbours[u];
+            if (std::find(list.begin(), list.end(), graph.targets[e]) == list.end()) list.push_back(graph.targets[e]);
+        }
+    }
+
+    std::vector<bool> used(graph.edgeCount(), false);
+    // Marks every arc of the line between u and v, in both directions
+    auto markUsed = [&](StationId u, StationId v) {
+        for (StationId a : {u, v}) {
+            const StationId b = a == u ? v : u;
+            for (EdgeId e = graph.edgesBegin(a); e < graph.edgesEnd(a); ++e) {
+                if (graph.lines[e] == line && graph.targets[e] == b) used[e] = true;
+            }
+        }
+    };
+    auto unusedArc = [&](StationId u) {
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            if (graph.lines[e] == line && graph.targets[e] != u && !used[e]) return e;
+        }
+        return kInvalidEdge;
+    };
+    auto walk = [&](StationId u, EdgeId e) {
+        Route run;
+        while (e != kInvalidEdge) {
+            const StationId v = graph.targets[e];
+            markUsed(u, v);
+            run.stations.push_back(u);
+            run.arcs.push_back(e);
+            if (neighbours[v].size() != 2) break;
+            u = v;
+            e = unusedArc(u);
+        }
+        return run;
+    };
+
+    // Stations in ID order so the runs do not depend on hash order
+    std::vector<StationId> stations;
+    stations.reserve(neighbours.size());
+    for (const auto& entry : neighbours) stations.push_back(entry.first);
+    std::sort(stations.begin(), stations.end());
+
+    std::vector<Route> runs;
+    for (StationId u : stations) {
+        if (neighbours[u].size() == 2) continue;
+        for (EdgeId e = unusedArc(u); e != kInvalidEdge; e = unusedArc(u)) runs.push_back(walk(u, e));
+    }
+    // Whatever is left is made of loops
+    for (StationId u : stations) {
+        for (EdgeId e = unusedArc(u); e != kInvalidEdge; e = unusedArc(u)) runs.push_back(walk(u, e));
+    }
+    return runs;
+}
+
+// Labels of the calling thread's scans, kept from one query to the next
+// so a query allocates nothing. They are refilled rather than stamped with
+// an epoch: the scan reads a trip's boarding at every connection, and a
+// stamp check there costs more than refilling the arrays once per query.
+struct ScanWorkspace {
+    std::vector<int> arrival;
+    // Connection each station was last reached by, and where its trip was boarded
+    std::vector<uint32_t> reachedBy;
+    std::vector<uint32_t> boardedAt;
+    std::vector<uint32_t> tripBoarding;
+
+    void reset(size_t stationCount, size_t tripCount) {
+        arrival.assign(stationCount, kUnreachedTime);
+        reachedBy.resize(stationCount);
+        boardedAt.resize(stationCount);
+        tripBoarding.assign(tripCount, kNotBoarded);
+    }
+};
+
+} // namespace
+
+bool Timetable::build(const MetroGraph& graph, const std::vector<ServicePattern>& patterns, int transferMinutes,
+                      std::string& errorMsg) {
+    clear();
+    stationCount_ = graph.stationCount();
+    transferMinutes_ = transferMinutes;
+
+    // Trips are generated trip by trip, so within a trip the connections
+    // are in running order; the sort below keeps that order among
+    // connections with equal times.
+    std::vector<Connection> generated;
+    std::vector<EdgeId> generatedEdges;
+    std::vector<uint32_t> positions;
+    uint32_t tripCount = 0;
+    auto addTrips = [&](const ServicePattern& pattern, const Route& route) {
+        const int headway = std::max(pattern.headway, 0);
+        for (int start = pattern.firstDeparture; start <= pattern.lastDeparture; start += headway) {
+            int clock = start;
+            for (size_t i = 0; i < route.arcs.size(); ++i) {
+                const EdgeId e = route.arcs[i];
+                generated.push_back(Connection{clock, clock + graph.times[e], route.stations[i], graph.targets[e], tripCount});
+                generatedEdges.push_back(e);
+                positions.push_back(static_cast<uint32_t>(i));
+                clock += graph.times[e];
+            }
+            tripCount++;
+            if (headway == 0) break;
+        }
+    };
+
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const ServicePattern& pattern = patterns[i];
+        std::vector<Route> routes;
+        if (pattern.from == kInvalidStation && pattern.to == kInvalidStation) {
+            routes = lineRuns(graph, pattern.line);
+        } else {
+            Route route;
+            if (pattern.from >= stationCount_ || pattern.to >= stationCount_ || pattern.from == pattern.to
+                || !lineRoute(graph, pattern.line, pattern.from, pattern.to, route)) {
+                errorMsg = "Pattern " + std::to_string(i + 1) + ": its stations are not connected by its line";
+                clear();
+                return false;
+            }
+            routes.push_back(std::move(route));
+        }
+        for (const Route& route : routes) {
+            addTrips(pattern, route);
+            addTrips(pattern, reversed(graph, route));
+        }
+    }
+
+    std::vector<uint32_t> order(generated.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&generated](uint32_t a, uint32_t b) {
+        if (generated[a].departure != generated[b].departure) return generated[a].departure < generated[b].departure;
+        return generated[a].arrival < generated[b].arrival;
+    });
+
+    connections_.reserve(order.size());
+    connectionEdges_.reserve(order.size());
+    tripPositions_.reserve(order.size());
+    for (uint32_t index : order) {
+        connections_.push_back(generated[index]);
+        connectionEdges_.push_back(generatedEdges[index]);
+        tripPositions_.push_back(positions[index]);
+    }
+
+    tripOffsets_.assign(tripCount + 1, 0);
+    for (const Connection& c : connections_) tripOffsets_[c.trip + 1]++;
+    for (uint32_t t = 0; t < tripCount; ++t) tripOffsets_[t + 1] += tripOffsets_[t];
+    tripConnections_.resize(connections_.size());
+    for (uint32_t i = 0; i < connections_.size(); ++i) {
+        tripConnections_[tripOffsets_[connections_[i].trip] + tripPositions_[i]] = i;
+    }
+    errorMsg = "";
+    return true;
+}
+
+void Timetable::clear() {
+    connections_.clear();
+    connectionEdges_.clear();
+    tripPositions_.clear();
+    tripOffsets_.clear();
+    tripConnections_.clear();
+    stationCount_ = 0;
+    transferMinutes_ = kDefaultTransferMinutes;
+}
+
+bool Timetable::earliestArrival(StationId source, StationId target, int departure,
+                                const std::vector<uint8_t>& closedArcs, uint8_t closedBits, std::vector<Step>& steps,
+                                const std::atomic<bool>* cancel) const {
+    steps.clear();
+    if (source >= stationCount_ || target >= stationCount_ || source == target) return false;
+
+    thread_local ScanWorkspace workspace;
+    workspace.reset(stationCount_, tripCount());
+    std::vector<int>& arrival = workspace.arrival;
+    arrival[source] = departure;
+
+    auto first = std::lower_bound(connections_.begin(), connections_.end(), departure,
+                                  [](const Connection& c, int time) { return c.departure < time; });
+    for (uint32_t i = static_cast<uint32_t>(first - connections_.begin()); i < connections_.size(); ++i) {
+        const Connection& c = connections_[i];
+        // Everything from here on leaves too late to arrive any earlier
+        if (c.departure >= arrival[target]) break;
+        if ((i & 4095) == 0 && cancel && cancel->load(std::memory_order_relaxed)) return false;
+
+        uint32_t& boarding = workspace.tripBoarding[c.trip];
+        if (!closedArcs.empty() && (closedArcs[connectionEdges_[i]] & closedBits)) {
+            boarding = kNotBoarded; // The vehicle cannot run on; everyone gets off
+            continue;
+        }
+        if (boarding == kNotBoarded) {
+            const int reached = arrival[c.from];
+            if (reached == kUnreachedTime) continue;
+            const int change = c.from == source ? 0 : transferMinutes_;
+            if (static_cast<long long>(reached) + change > c.departure) continue;
+            boarding = i;
+        }
+        if (c.arrival < arrival[c.to]) {
+            arrival[c.to] = c.arrival;
+            workspace.reachedBy[c.to] = i;
+            workspace.boardedAt[c.to] = boarding;
+        }
+    }
+    if (arrival[target] == kUnreachedTime) return false;
+
+    // Walk back ride by ride; each ride is a stretch of one trip. Arrivals
+    // only decrease along the way, the bound guards against zero-time loops.
+    StationId station = target;
+    for (size_t rides = 0; station != source; ++rides) {
+        if (rides > stationCount_) {
+            steps.clear();
+            return false;
+        }
+        const uint32_t alight = workspace.reachedBy[station];
+        const uint32_t board = workspace.boardedAt[station];
+        const uint32_t trip = connections_[alight].trip;
+        for (uint32_t position = tripPositions_[alight] + 1; position-- > tripPositions_[board];) {
+            const uint32_t index = tripConnections_[tripOffsets_[trip] + position];
+            const Connection& c = connections_[index];
+            steps.push_back(Step{c.to, connectionEdges_[index], c.departure, c.arrival});
+        }
+        station = connections_[board].from;
+    }
+    std::reverse(steps.begin(), steps.end());
+    return true;
+}
+
+size_t Timetable::memoryFootprint() const {
+    return connections_.capacity() * sizeof(Connection) + connectionEdges_.capacity() * sizeof(EdgeId)
+           + tripPositions_.capacity() * sizeof(uint32_t) + tripOffsets_.capacity() * sizeof(uint32_t)
+           + tripConnections_.capacity() * sizeof(uint32_t);
+}
@@ -0,0 +1,91 @@
+#ifndef TIMETABLE_H
+#define TIMETABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "metrograph.h"
+
+// One row of a timetable file: vehicles of `line` run between two stations
+// in both directions, leaving each end every `headway` minutes from
+// firstDeparture up to lastDeparture (minutes after midnight). A headway of
+// 0 is a single departure from each end, so a list of rows with first ==
+// last spells out an explicit timetable.
+struct ServicePattern {
+    LineId line;
+    // Both kInvalidStation: every run of the line, i.e. each stretch of it
+    // between terminals and junctions, is served on its own
+    StationId from = kInvalidStation;
+    StationId to = kInvalidStation;
+    int firstDeparture = 0;
+    int lastDeparture = 0;
+    int headway = 0;
+};
+
+// Scheduled service compiled for the Connection Scan Algorithm.
+//
+// Every trip (one vehicle running a pattern once) is cut into connections,
+// one per segment it runs over, and all connections are sorted by
+// departure time into one array. An earliest-arrival query is a single
+// forward scan over that array starting at the departure time: a
+// connection is usable if the traveller is already on its trip or has
+// reached its departure station in time to board, and the scan stops once
+// no later departure can improve the arrival at the target.
+class Timetable {
+public:
+    static constexpr int kDefaultTransferMinutes = 2;
+
+    // One hop of a journey: the station reached, the graph arc the vehicle
+    // ran over, and when it left and arrived (minutes after midnight)
+    struct Step {
+        StationId station;
+        EdgeId edge;
+        int departure;
+        int arrival;
+    };
+
+    // Segment times come from the graph arcs. Changing vehicles takes
+    // transferMinutes; staying on board or starting a journey does not.
+    // Returns false if a pattern's stations are not joined by its line.
+    bool build(const MetroGraph& graph, const std::vector<ServicePattern>& patterns, int transferMinutes,
+               std::string& errorMsg);
+    void clear();
+    bool empty() const { return connections_.empty(); }
+
+    // Earliest arrival at target leaving source at `departure` or later.
+    // closedArcs, if not empty, holds flags per graph arc (indexed by
+    // EdgeId); no vehicle may run over an arc whose flags share a bit with
+    // closedBits, and a trip that reaches one ends there. Returns false if
+    // target cannot be reached that day or cancel was set.
+    bool earliestArrival(StationId source, StationId target, int departure, const std::vector<uint8_t>& closedArcs,
+                         uint8_t closedBits, std::vector<Step>& steps, const std::atomic<bool>* cancel = nullptr) const;
+
+    size_t connectionCount() const { return connections_.size(); }
+    size_t tripCount() const { return tripOffsets_.empty() ? 0 : tripOffsets_.size() - 1; }
+    int transferMinutes() const { return transferMinutes_; }
+    size_t memoryFootprint() const; // Bytes held by the timetable
+
+private:
+    // Only what the scan reads, so the array streams through the cache
+    struct Connection {
+        int departure;
+        int arrival;
+        StationId from;
+        StationId to;
+        uint32_t trip;
+    };
+
+    std::vector<Connection> connections_; // Sorted by departure
+    // Cold data per connection, read only to rebuild a journey
+    std::vector<EdgeId> connectionEdges_;
+    std::vector<uint32_t> tripPositions_; // Index of the connection within its trip
+    // Connections of each trip in running order: indices into connections_
+    std::vector<uint32_t> tripOffsets_;
+    std::vector<uint32_t> tripConnections_;
+    size_t stationCount_ = 0;
+    int transferMinutes_ = kDefaultTransferMinutes;
+};
+
+#endif // TIMETABLE_H
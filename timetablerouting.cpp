@@ -0,0 +1,158 @@
+#include "metrosystem.h"
+#include <QDebug>
+#include <QFile>
+#include <charconv>
+#include <string_view>
+
+// Timetable file: a header line, then one service pattern per line,
+//   Line,From Station,To Station,First Departure,Last Departure,Headway (min)
+// with times as H:MM after midnight (hours may run past 23 for service
+// after midnight). From and To may both be left empty to serve every run
+// of the line.
+
+namespace {
+
+bool parseMinutes(std::string_view text, int& minutes) {
+    const size_t colon = text.find(':');
+    if (colon == std::string_view::npos || text.size() - colon != 3) return false;
+    int hours = 0;
+    int mins = 0;
+    const char* end = text.data() + colon;
+    if (std::from_chars(text.data(), end, hours).ptr != end || hours < 0) return false;
+    if (std::from_chars(end + 1, text.data() + text.size(), mins).ptr != text.data() + text.size()) return false;
+    if (mins < 0 || mins > 59) return false;
+    minutes = hours * 60 + mins;
+    return true;
+}
+
+bool parseHeadway(std::string_view text, int& headway) {
+    const char* end = text.data() + text.size();
+    return std::from_chars(text.data(), end, headway).ptr == end && headway >= 0;
+}
+
+} // namespace
+
+std::string MetroSystem::timetablePathFor(const std::string& csvFile) {
+    const std::string suffix = ".csv";
+    const bool hasSuffix = csvFile.size() >= suffix.size()
+                           && csvFile.compare(csvFile.size() - suffix.size(), suffix.size(), suffix) == 0;
+    return (hasSuffix ? csvFile.substr(0, csvFile.size() - suffix.size()) : csvFile) + ".timetable.csv";
+}
+
+bool MetroSystem::loadTimetable(const std::string& filename, std::string& errorMsg, int transferMinutes) {
+    timetable_.clear();
+    const NetworkState& loaded = *loadedNetwork_;
+    if (loaded.graph.empty()) {
+        errorMsg = "Load the network before its timetable.";
+        return false;
+    }
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorMsg = "Failed to open timetable: " + filename;
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+    const std::string_view text(contents.constData(), static_cast<size_t>(contents.size()));
+
+    std::unordered_map<std::string_view, LineId> lineIds;
+    for (LineId id = 0; id < loaded.lineNames.size(); ++id) lineIds.emplace(loaded.lineNames[id], id);
+
+    std::vector<ServicePattern> patterns;
+    int lineNumber = 0;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t newline = text.find('\n', pos);
+        if (newline == std::string_view::npos) newline = text.size();
+        const std::string_view line = text.substr(pos, newline - pos);
+        pos = newline + 1;
+        if (++lineNumber == 1 || trimView(line).empty()) continue; // Header and blank lines
+
+        const std::string where = "Timetable line " + std::to_string(lineNumber) + ": ";
+        std::string_view fields[6];
+        size_t fieldStart = 0;
+        for (int i = 0; i < 6; ++i) {
+            const size_t comma = i < 5 ? line.find(',', fieldStart) : line.size();
+            if (comma == std::string_view::npos) {
+                errorMsg = where + "expected 6 columns";
+                return false;
+            }
+            fields[i] = trimView(line.substr(fieldStart, comma - fieldStart));
+            fieldStart = comma + 1;
+        }
+
+        ServicePattern pattern;
+        auto lineIt = lineIds.find(fields[0]);
+        if (lineIt == lineIds.end()) {
+            errorMsg = where + "unknown line: " + std::string(fields[0]);
+            return false;
+        }
+        pattern.line = lineIt->second;
+        if (fields[1].empty() != fields[2].empty()) {
+            errorMsg = where + "give both From and To, or neither";
+            return false;
+        }
+        for (int i = 1; i <= 2 && !fields[i].empty(); ++i) {
+            const StationId station = stationId(std::string(fields[i]));
+            if (station == kInvalidStation) {
+                errorMsg = where + "unknown station: " + std::string(fields[i]);
+                return false;
+            }
+            (i == 1 ? pattern.from : pattern.to) = station;
+        }
+        if (!parseMinutes(fields[3], pattern.firstDeparture) || !parseMinutes(fields[4], pattern.lastDeparture)
+            || pattern.lastDeparture < pattern.firstDeparture) {
+            errorMsg = where + "departures must be H:MM with the last not before the first";
+            return false;
+        }
+        if (!parseHeadway(fields[5], pattern.headway)) {
+            errorMsg = where + "headway must be a whole number of minutes";
+            return false;
+        }
+        patterns.push_back(pattern);
+    }
+
+    if (!timetable_.build(loaded.graph, patterns, transferMinutes, errorMsg)) {
+        errorMsg = "Timetable " + filename + ": " + errorMsg;
+        return false;
+    }
+    qInfo() << "Timetable loaded:" << patterns.size() << "patterns," << timetable_.tripCount() << "trips,"
+            << timetable_.connectionCount() << "connections.";
+    errorMsg = "";
+    return true;
+}
+
+bool MetroSystem::hasTimetable() const {
+    return !timetable_.empty();
+}
+
+std::vector<PathSegment> MetroSystem::findEarliestArrival(const std::string& start, const std::string& end,
+                                                          int departureMinute, const CancelFlag* cancel) const {
+    StationId startId = stationId(start);
+    StationId endId = stationId(end);
+    if (startId == kInvalidStation || endId == kInvalidStation || timetable_.empty()) return {};
+    if (startId == endId) return {PathSegment(start, "", 0, 0, true)};
+
+    // The timetable runs over the loaded graph's arcs; the network marks
+    // the ones the live updates have closed
+    const NetworkState& loaded = *loadedNetwork_;
+    const std::shared_ptr<const NetworkState> network = this->network();
+
+    std::vector<Timetable::Step> steps;
+    if (!timetable_.earliestArrival(startId, endId, departureMinute, network->loadedArcChanges, kArcClosed, steps,
+                                    cancel)) {
+        return {};
+    }
+
+    std::vector<PathSegment> path;
+    path.reserve(steps.size() + 1);
+    path.push_back(PathSegment(stationNames_[startId], "", 0, 0, true));
+    int clock = departureMinute;
+    for (const Timetable::Step& step : steps) {
+        PathSegment segment = segmentFor(loaded, step.station, step.edge);
+        segment.timeForSegment = step.arrival - step.departure;
+        segment.waitForSegment = step.departure - clock;
+        clock = step.arrival;
+        path.push_back(std::move(segment));
+    }
+    countTransfers(path);
+    return path;
+}
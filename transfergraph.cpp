@@ -0,0 +1,76 @@
+#include "transfergraph.h"
+#include <algorithm>
+
+void TransferGraph::build(const MetroGraph& graph) {
+    clear();
+    const size_t stationCount = graph.stationCount();
+
+    // A state per distinct line among each station's arcs. Arcs come in
+    // pairs, so the far end of every arc has a state for its line too.
+    stateOffsets_.reserve(stationCount + 1);
+    std::vector<LineId> lines;
+    for (StationId u = 0; u < stationCount; ++u) {
+        stateOffsets_.push_back(static_cast<StateId>(stateLines_.size()));
+        lines.assign(graph.lines.begin() + graph.edgesBegin(u), graph.lines.begin() + graph.edgesEnd(u));
+        std::sort(lines.begin(), lines.end());
+        lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+        for (LineId line : lines) {
+            stateStations_.push_back(u);
+            stateLines_.push_back(line);
+        }
+    }
+    stateOffsets_.push_back(static_cast<StateId>(stateLines_.size()));
+
+    rideOffsets_.reserve(stateCount() + 1);
+    rideEdges_.reserve(graph.edgeCount());
+    rideTargets_.reserve(graph.edgeCount());
+    for (StateId s = 0; s < stateCount(); ++s) {
+        rideOffsets_.push_back(static_cast<uint32_t>(rideEdges_.size()));
+        const StationId u = stateStations_[s];
+        for (EdgeId e = graph.edgesBegin(u); e < graph.edgesEnd(u); ++e) {
+            if (graph.lines[e] != stateLines_[s]) continue;
+            const StateId target = state(graph.targets[e], graph.lines[e]);
+            if (target == kInvalidState) continue;
+            rideEdges_.push_back(e);
+            rideTargets_.push_back(target);
+        }
+    }
+    rideOffsets_.push_back(static_cast<uint32_t>(rideEdges_.size()));
+}
+
+void TransferGraph::retargetRides(const MetroGraph& graph, const std::vector<EdgeId>& arcs) {
+    for (EdgeId e : arcs) {
+        // The arc's station is the run of offsets it falls in
+        const StationId u = static_cast<StationId>(
+            std::upper_bound(graph.offsets.begin(), graph.offsets.end(), e) - graph.offsets.begin() - 1);
+        const StateId from = state(u, graph.lines[e]);
+        if (from == kInvalidState) continue;
+        StateId target = state(graph.targets[e], graph.lines[e]);
+        if (target == kInvalidState) target = from;
+        for (uint32_t r = rideOffsets_[from]; r < rideOffsets_[from + 1]; ++r) {
+            if (rideEdges_[r] == e) rideTargets_[r] = target;
+        }
+    }
+}
+
+StateId TransferGraph::state(StationId u, LineId line) const {
+    const auto begin = stateLines_.begin() + stateOffsets_[u];
+    const auto end = stateLines_.begin() + stateOffsets_[u + 1];
+    const auto it = std::lower_bound(begin, end, line);
+    return it != end && *it == line ? static_cast<StateId>(it - stateLines_.begin()) : kInvalidState;
+}
+
+void TransferGraph::clear() {
+    stateOffsets_.clear();
+    stateStations_.clear();
+    stateLines_.clear();
+    rideOffsets_.clear();
+    rideEdges_.clear();
+    rideTargets_.clear();
+}
+
+size_t TransferGraph::memoryFootprint() const {
+    return stateOffsets_.capacity() * sizeof(StateId) + stateStations_.capacity() * sizeof(StationId)
+           + stateLines_.capacity() * sizeof(LineId) + rideOffsets_.capacity() * sizeof(uint32_t)
+           + rideEdges_.capacity() * sizeof(EdgeId) + rideTargets_.capacity() * sizeof(StateId);
+}
@@ -0,0 +1,61 @@
+#ifndef TRANSFERGRAPH_H
+#define TRANSFERGRAPH_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "metrograph.h"
+
+// A station together with one line serving it
+using StateId = uint32_t;
+constexpr StateId kInvalidState = std::numeric_limits<StateId>::max();
+
+// Station x line expansion of a MetroGraph for transfer-aware routing.
+//
+// Riding an arc moves between two states of its line, changing lines
+// moves between two states of one station. Only the ride arcs are stored,
+// as (base arc, target state) pairs in CSR form; their weights are read
+// from the base graph, so weight changes need no rebuild of their own.
+// Transfer arcs are not stored at all: the states of a station are
+// numbered consecutively, and every pair of them is one change of line.
+// The expansion adds 8 bytes per arc and 12 per state to the base graph.
+class TransferGraph {
+public:
+    // States are ordered by station, then line; a station's rides on one
+    // line keep their order in the base graph
+    void build(const MetroGraph& graph);
+    // After arcs of the graph this was built for were pointed at other
+    // stations (closures turn them into self-loops), re-reads their ride
+    // targets. Arcs must keep their EdgeIds and lines, so states and rides
+    // stay as they are; an arc whose new target has no state for its line
+    // keeps its ride pointed back at its own state, where it goes nowhere.
+    void retargetRides(const MetroGraph& graph, const std::vector<EdgeId>& arcs);
+    void clear();
+    bool empty() const { return stateLines_.empty(); }
+
+    size_t stateCount() const { return stateLines_.size(); }
+    size_t rideCount() const { return rideEdges_.size(); }
+    size_t memoryFootprint() const; // Bytes held by the arrays
+
+    StateId statesBegin(StationId u) const { return stateOffsets_[u]; }
+    StateId statesEnd(StationId u) const { return stateOffsets_[u + 1]; }
+    StateId state(StationId u, LineId line) const; // kInvalidState if the line does not serve u
+    StationId station(StateId s) const { return stateStations_[s]; }
+    LineId line(StateId s) const { return stateLines_[s]; }
+
+    uint32_t ridesBegin(StateId s) const { return rideOffsets_[s]; }
+    uint32_t ridesEnd(StateId s) const { return rideOffsets_[s + 1]; }
+    EdgeId rideEdge(uint32_t ride) const { return rideEdges_[ride]; }     // Arc of the base graph
+    StateId rideTarget(uint32_t ride) const { return rideTargets_[ride]; } // State it arrives in
+
+private:
+    std::vector<StateId> stateOffsets_; // StationId -> first state, plus the end
+    std::vector<StationId> stateStations_;
+    std::vector<LineId> stateLines_;
+    std::vector<uint32_t> rideOffsets_; // StateId -> first ride, plus the end
+    std::vector<EdgeId> rideEdges_;
+    std::vector<StateId> rideTargets_;
+};
+
+#endif // TRANSFERGRAPH_H
@@ -0,0 +1,80 @@
+#include "metrosystem.h"
+#include "searchkernels.h"
+#include "searchworkspace.h"
+
+namespace {
+
+// Workspace and queue slot of state graph searches. State and station
+// searches size their workspaces differently, so keeping them apart saves
+// refilling the labels whenever a thread switches between the two.
+constexpr int kStateSlot = 2;
+
+} // namespace
+
+// One label-setting search over the states, run by the same kernel as the
+// station searches. A state's arcs are its rides, weighed by the criterion,
+// and the changes to the other lines of its station, weighed by the
+// penalty; changes at the start station are free, so the search can board
+// any line there. It ends at the first state of end that is settled.
+template <typename Weight>
+std::vector<PathSegment> MetroSystem::transferPath(const NetworkState& network, StationId start, StationId end,
+                                                   typename Weight::Value penalty, const CancelFlag* cancel) const {
+    using Value = typename Weight::Value;
+    const MetroGraph& graph = network.graph;
+    const TransferGraph& states = network.transfers;
+    if (states.statesBegin(start) == states.statesEnd(start)) return {}; // No line calls at start
+
+    SearchWorkspace<Value>& workspace = threadSearchWorkspace<Value, kStateSlot>();
+    const Value minWeight = std::min<Value>(Weight::minWeight(graph), penalty);
+    const Value maxWeight = std::max<Value>(Weight::maxWeight(graph), penalty);
+    StateId reached = kInvalidState;
+    const bool found = withThreadQueue<Value, kStateSlot>(minWeight, maxWeight, [&](auto& queue) {
+        return runLabelSettingKernel(states.stateCount(), states.statesBegin(start), queue, workspace,
+                                     [&](StateId s, Value value, auto relax) {
+                                         for (uint32_t r = states.ridesBegin(s); r < states.ridesEnd(s); ++r) {
+                                             const EdgeId e = states.rideEdge(r);
+                                             relax(states.rideTarget(r), value + Weight::weight(graph, e), e);
+                                         }
+                                         const StationId u = states.station(s);
+                                         const Value change = value + (u == start ? 0 : penalty);
+                                         for (StateId other = states.statesBegin(u); other < states.statesEnd(u); ++other) {
+                                             if (other != s) relax(other, change, kInvalidEdge);
+                                         }
+                                     },
+                                     [&](StateId s, Value) {
+                                         if (states.station(s) == end) reached = s;
+                                         return reached != kInvalidState || isCancelled(cancel);
+                                     });
+    });
+    if (!found || isCancelled(cancel)) return {};
+
+    // Rides carry their base arc; changes of line carry none and add no segment
+    thread_local std::vector<ContractionHierarchy::PathStep> steps;
+    steps.clear();
+    for (StateId s = reached; workspace.parent(s) != kInvalidState; s = workspace.parent(s)) {
+        if (workspace.parentEdge(s) != kInvalidEdge) steps.emplace_back(states.station(s), workspace.parentEdge(s));
+    }
+    std::reverse(steps.begin(), steps.end());
+    return buildPath(network, start, steps);
+}
+
+std::vector<PathSegment> MetroSystem::findPathWithTransfers(const std::string& start, const std::string& end,
+                                                            RouteCriterion criterion, const TransferPenalties& penalties,
+                                                            const CancelFlag* cancel) {
+    StationId startId = stationId(start);
+    StationId endId = stationId(end);
+    if (startId == kInvalidStation || endId == kInvalidStation) return {};
+    if (startId == endId) return {PathSegment(start, "", 0, 0, true)};
+
+    const std::shared_ptr<const NetworkState> network = this->network();
+    switch (criterion) {
+    case RouteCriterion::Time:
+        return transferPath<TimeWeight>(*network, startId, endId, std::max(penalties.minutes, 0), cancel);
+    case RouteCriterion::Cost:
+        return transferPath<CostWeight>(*network, startId, endId, std::max(penalties.cost, 0), cancel);
+    case RouteCriterion::LeastStops:
+    case RouteCriterion::Distance:
+        break;
+    }
+    return findPath(start, end, criterion, cancel);
+}